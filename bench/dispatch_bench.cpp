@@ -0,0 +1,98 @@
+// Per-call overhead of the thunks BasicOperationProvider stores for native operations: the
+// index_sequence invoker against the previous chain of nested std::function wrappers, which
+// rebuilt one closure per argument on every call. Usage: bench/dispatch_bench [calls]
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <vector>
+#include "basic_operation_provider.h"
+#include "operations.h"
+
+// the previous wrapper, kept here for comparison
+template<typename R, typename S, typename... T>
+std::function<R(T...)> legacyBindFront(std::function<R(S, T...)> func, S arg) {
+    return [func, arg](T... rest) -> R {
+        return func(arg, rest...);
+    };
+}
+
+template<typename R, typename S, typename... T>
+std::function<Datum(const std::vector<Datum>::iterator&)> legacyWrap(std::function<R(S, T...)> func) {
+    return [func](const std::vector<Datum>::iterator& argsIt) -> Datum {
+        S firstArg = castArgument<S>(*(argsIt));
+        if constexpr (sizeof...(T) == 0) {
+            return castReturnValue<R>(func(firstArg));
+        } else {
+            auto restFunc = legacyWrap<R, T...>(legacyBindFront(func, firstArg));
+            return restFunc(argsIt + 1);
+        }
+    };
+}
+
+template<typename S, typename... T>
+static OperationFn legacyThunk(S(*fn)(T...)) {
+    std::function<S(T...)> func = fn;
+    return [func](std::vector<Datum>& args) -> Datum {
+        auto argsIt = args.begin();
+        return legacyWrap<S, T...>(func)(argsIt);
+    };
+}
+
+// volatile sink so the compiler cannot drop the measured calls
+static volatile double sink;
+
+// Nanoseconds per call of thunk; fill rebuilds the arguments before each call.
+template<typename Fill>
+static double nanosPerCall(const OperationFn& thunk, size_t calls, Fill fill) {
+    std::vector<Datum> args;
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < calls; ++i) {
+        fill(args);
+        sink = thunk(args).toGrade();
+    }
+    std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count() / static_cast<double>(calls);
+}
+
+static double require4(double value, double threshold, double below, double above) {
+    return require(value, threshold, below, above);
+}
+
+int main(int argc, char** argv) {
+    size_t calls = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 2000000;
+    ListValue* list = new ListValue();
+    list->addValue(0.5);
+    list->addValue(0.75, 2);
+
+    auto fillRequire = [](std::vector<Datum>& args) {
+        args.clear();
+        args.push_back(Datum::makeGrade(0.6));
+        args.push_back(Datum::makeGrade(0.5));
+        args.push_back(Datum::makeGrade(0.0));
+        args.push_back(Datum::makeGrade(1.0));
+    };
+    // map consumes its list; a copy-on-write copy costs one small allocation per call
+    auto fillMap = [&](std::vector<Datum>& args) {
+        args.clear();
+        args.push_back(Datum::makeGrade(0.0));
+        args.push_back(Datum::makeGrade(1.0));
+        args.push_back(Datum::makeGrade(0.0));
+        args.push_back(Datum::makeInteger(100));
+        args.push_back(Datum::makeList(list->copy()));
+    };
+
+    std::printf("%-16s %12s %12s  (ns/call, %zu calls)\n", "operation", "chained", "invoker", calls);
+    BasicOperationProvider provider;
+    provider.registerOperation("require", require4);
+    provider.registerOperation("map", map);
+    const OperationFn* requireFn = provider.resolveOperation("require", { DataType::TYPE_GRADE, DataType::TYPE_GRADE, DataType::TYPE_GRADE, DataType::TYPE_GRADE }).fn;
+    const OperationFn* mapFn = provider.resolveOperation("map", { DataType::TYPE_GRADE, DataType::TYPE_GRADE, DataType::TYPE_GRADE, DataType::TYPE_INTEGER, DataType::TYPE_LIST }).fn;
+
+    std::printf("%-16s %12.1f %12.1f\n", "require/4",
+                nanosPerCall(legacyThunk(require4), calls, fillRequire), nanosPerCall(*requireFn, calls, fillRequire));
+    std::printf("%-16s %12.1f %12.1f\n", "map/5",
+                nanosPerCall(legacyThunk(map), calls, fillMap), nanosPerCall(*mapFn, calls, fillMap));
+    delete list;
+    return 0;
+}
@@ -0,0 +1,74 @@
+// Scaling of drop and top against the previous heap-and-erase implementation, which is
+// quadratic in the number of dropped entries. Usage: bench/drop_bench [max-exponent]
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <limits>
+#include <queue>
+#include "data.h"
+#include "operations.h"
+
+// drop as it was: a bounded max-heap of the lowest n, then one erase per dropped entry
+static ListValue* heapDrop(unsigned long long n, ListValue* lv) {
+    auto cmp = [](const std::pair<double, size_t>& a, const std::pair<double, size_t>& b) {
+        return a.first < b.first;
+    };
+    std::priority_queue<std::pair<double, size_t>, std::vector<std::pair<double, size_t>>, decltype(cmp)> maxHeap(cmp);
+    for (size_t i = 0; i < lv->size(); ++i) {
+        double value = lv->getValueAt(i);
+        if (std::isnan(value)) continue;
+        maxHeap.emplace(value, i);
+        if (maxHeap.size() > n) maxHeap.pop();
+    }
+    std::vector<size_t> indices;
+    while (!maxHeap.empty()) {
+        indices.push_back(maxHeap.top().second);
+        maxHeap.pop();
+    }
+    std::sort(indices.begin(), indices.end(), std::greater<size_t>());
+    for (size_t idx : indices) lv->removeAt(idx);
+    return lv;
+}
+
+static double millis(const ListValue& list, const std::function<ListValue*(ListValue*)>& op) {
+    ListValue* work = list.copy();
+    work->mutableValues();  // detach outside the timed region
+    auto start = std::chrono::steady_clock::now();
+    ListValue* result = op(work);
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+    delete result;
+    return elapsed.count();
+}
+
+int main(int argc, char** argv) {
+    int maxExponent = argc > 1 ? std::atoi(argv[1]) : 7;
+    // the old implementation is only timed up to this size; beyond it, it takes minutes
+    const size_t heapLimit = 100000;
+    std::printf("%-10s %12s %12s %12s %12s  (ms)\n", "entries", "drop(n/2)", "top(5)", "heap drop", "heap top");
+
+    for (int e = 3; e <= maxExponent; ++e) {
+        size_t n = 1;
+        for (int i = 0; i < e; ++i) n *= 10;
+        ListValue list;
+        list.reserve(n);
+        unsigned state = 12345;
+        for (size_t i = 0; i < n; ++i) {
+            state = state * 1103515245u + 12345u;
+            double v = i % 32 == 7 ? std::numeric_limits<double>::quiet_NaN() : static_cast<double>(state >> 16) / 65536.0;
+            list.addValue(v);
+        }
+        double dropMs = millis(list, [&](ListValue* lv) { return drop(n / 2, lv); });
+        double topMs = millis(list, [](ListValue* lv) { return top(5, lv); });
+        if (n <= heapLimit) {
+            double heapDropMs = millis(list, [&](ListValue* lv) { return heapDrop(n / 2, lv); });
+            double heapTopMs = millis(list, [&](ListValue* lv) { return heapDrop(n - 5, lv); });
+            std::printf("%-10zu %12.3f %12.3f %12.3f %12.3f\n", n, dropMs, topMs, heapDropMs, heapTopMs);
+        } else {
+            std::printf("%-10zu %12.3f %12.3f %12s %12s\n", n, dropMs, topMs, "-", "-");
+        }
+    }
+    return 0;
+}
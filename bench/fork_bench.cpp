@@ -0,0 +1,63 @@
+// Cost of what-if probes on a course with many categories, of which few depend on the probed
+// input: a fork per probe against a fresh Context that evaluates everything again.
+// Usage: bench/fork_bench [categories] [probes]
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include "bytecode.h"
+#include "goal_seek.h"
+#include "operations.h"
+#include "parser.h"
+
+int main(int argc, char** argv) {
+    int categories = argc > 1 ? std::atoi(argv[1]) : 2000;
+    int probes = argc > 2 ? std::atoi(argv[2]) : 2000;
+    // a chain of assignment categories feeding the total; only the total reads the exam
+    std::string source = "a0: clamp(0 1 { 80% 90% 70% })\n";
+    for (int i = 1; i < categories; ++i) {
+        source += "a" + std::to_string(i) + ": clamp(0 1 { a" + std::to_string(i - 1) + " 85% })\n";
+    }
+    source += "total: { a" + std::to_string(categories - 1) + ": 0.4 exam: 0.6 }\n";
+    Program* prog = parseProgram(source);
+    OperationProvider* ops = createProvider();
+    prog->link({ ops });
+    CompiledProgram* compiled = compileProgram(*prog);
+
+    Context base;
+    base.dataProviders = { compiled };
+    base.operationProviders = { ops };
+    base.trackDependencies();
+    base.getCategoryValue("total");
+
+    auto start = std::chrono::steady_clock::now();
+    double sink = 0;
+    for (int p = 0; p < probes; ++p) {
+        Context* fork = base.fork();
+        fork->setCategoryValue("exam", new GradeValue(p / static_cast<double>(probes)));
+        sink += Datum::fromValue(fork->getCategoryValue("total")).toGrade();
+        delete fork;
+    }
+    std::chrono::duration<double, std::micro> forked = std::chrono::steady_clock::now() - start;
+
+    start = std::chrono::steady_clock::now();
+    for (int p = 0; p < probes; ++p) {
+        Context fresh;
+        fresh.dataProviders = { compiled };
+        fresh.operationProviders = { ops };
+        fresh.trackDependencies();
+        fresh.setCategoryValue("exam", new GradeValue(p / static_cast<double>(probes)));
+        sink -= Datum::fromValue(fresh.getCategoryValue("total")).toGrade();
+    }
+    std::chrono::duration<double, std::micro> rebuilt = std::chrono::steady_clock::now() - start;
+
+    GoalSeekResult seek = goalSeek(base, "exam", "total", 0.7);
+    std::printf("%d categories: fork %.2f us/probe, fresh context %.2f us/probe (check %g)\n",
+                categories, forked.count() / probes, rebuilt.count() / probes, sink);
+    std::printf("goal seek: exam >= %.6f after %zu probes, %zu categories recomputed\n",
+                seek.input, seek.probes, seek.recomputed);
+    delete compiled;
+    delete prog;
+    delete ops;
+    return 0;
+}
@@ -0,0 +1,64 @@
+// Throughput of the list kernels at every SIMD level the CPU supports, on lists of
+// 10^3 to 10^7 entries. Usage: bench/list_kernels_bench [max-exponent]
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <limits>
+#include <string>
+#include "data.h"
+#include "list_kernels.h"
+
+// volatile sink so the compiler cannot drop the measured work
+static volatile double sink;
+
+template<typename F>
+static double melemPerSecond(size_t n, F kernel) {
+    // roughly 3*10^7 elements per measurement, at least one pass
+    size_t reps = std::max<size_t>(1, 30000000 / n);
+    kernel();  // warm up caches and page in the arrays
+    auto start = std::chrono::steady_clock::now();
+    for (size_t r = 0; r < reps; ++r) kernel();
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    return static_cast<double>(n) * static_cast<double>(reps) / elapsed.count() / 1e6;
+}
+
+int main(int argc, char** argv) {
+    int maxExponent = argc > 1 ? std::atoi(argv[1]) : 7;
+    SimdLevel best = supportedSimdLevel();
+    std::printf("%-10s %-7s %10s %10s %10s %10s %10s %10s  (Melem/s)\n",
+                "entries", "level", "clamp", "maxOf", "map", "resolve", "mean", "min/max");
+
+    for (int e = 3; e <= maxExponent; ++e) {
+        size_t n = 1;
+        for (int i = 0; i < e; ++i) n *= 10;
+        ListValue list;
+        list.reserve(n);
+        for (size_t i = 0; i < n; ++i) {
+            double v = i % 16 == 5 ? std::numeric_limits<double>::quiet_NaN() : static_cast<double>(i % 97) / 96.0;
+            list.addValue(v, 1.0 + static_cast<double>(i % 3));
+        }
+        double* values = list.mutableValues();
+
+        for (SimdLevel level : { SimdLevel::SCALAR, SimdLevel::SSE2, SimdLevel::AVX2 }) {
+            if (level > best) break;
+            setSimdLevel(level);
+            // the kernels are idempotent on these bounds, so repeated runs see the same data
+            double clampRate = melemPerSecond(n, [&] { clampValues(values, n, 0.1, 0.9); });
+            double maxRate = melemPerSecond(n, [&] { raiseToValues(values, n, 0.2); });
+            double mapRate = melemPerSecond(n, [&] { mapValues(values, n, 0.0, 1.0, 0.0, 1.0); });
+            double resolveRate = melemPerSecond(n, [&] { resolveValues(values, n, std::numeric_limits<double>::quiet_NaN()); });
+            double meanRate = melemPerSecond(n, [&] { sink = list.weightedMean(); });
+            double extremesRate = melemPerSecond(n, [&] {
+                double lo, hi;
+                size_t count;
+                definedExtremes(values, n, lo, hi, count);
+                sink = lo + hi;
+            });
+            std::printf("%-10zu %-7s %10.1f %10.1f %10.1f %10.1f %10.1f %10.1f\n",
+                        n, simdLevelName(level), clampRate, maxRate, mapRate, resolveRate, meanRate, extremesRate);
+        }
+    }
+    setSimdLevel(best);
+    return 0;
+}
@@ -0,0 +1,90 @@
+#pragma once
+#include <cstddef>
+#include <cstring>
+#include <new>
+#include <string_view>
+#include <utility>
+
+// Bump allocator for data that lives exactly as long as its owner (e.g. a Program's AST).
+// Memory is released all at once when the arena is destroyed. Objects created with make() are
+// never destroyed individually, so they must not own memory outside the arena; objects that do
+// are created with makeOwned() and destroyed, in reverse order, together with the arena.
+class Arena {
+private:
+    struct Block {
+        Block* next;
+        size_t capacity;
+    };
+    struct Finalizer {
+        void (*destroy)(void*);
+        void* object;
+        Finalizer* next;
+    };
+
+    Block* blocks = nullptr;
+    char* cursor = nullptr;
+    char* limit = nullptr;
+    Finalizer* finalizers = nullptr;
+    size_t nextBlockSize;
+    size_t used = 0;
+
+    void* allocateSlow(size_t size, size_t align);
+
+    template<typename T>
+    static void destroyObject(void* object) {
+        static_cast<T*>(object)->~T();
+    }
+public:
+    static const size_t DEFAULT_FIRST_BLOCK_SIZE = 16 * 1024;
+    // Blocks start at firstBlockSize bytes and double from there. Arenas that hold only a few
+    // small nodes, such as those of roster rows, start small so each costs little memory.
+    explicit Arena(size_t firstBlockSize = DEFAULT_FIRST_BLOCK_SIZE) : nextBlockSize(firstBlockSize) {}
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+    ~Arena();
+
+    // Makes sure the next `bytes` bytes are served from one block. Use it to size the arena up
+    // front when the final size can be estimated, so teardown is a single free.
+    void reserve(size_t bytes);
+
+    void* allocate(size_t size, size_t align) {
+        char* p = reinterpret_cast<char*>((reinterpret_cast<size_t>(cursor) + align - 1) & ~(align - 1));
+        if (cursor && p + size <= limit) {
+            cursor = p + size;
+            used += size;
+            return p;
+        }
+        return allocateSlow(size, align);
+    }
+
+    template<typename T, typename... Args>
+    T* make(Args&&... args) {
+        return new (allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+    }
+
+    template<typename T, typename... Args>
+    T* makeOwned(Args&&... args) {
+        T* object = make<T>(std::forward<Args>(args)...);
+        finalizers = make<Finalizer>(Finalizer{&destroyObject<T>, object, finalizers});
+        return object;
+    }
+
+    // Copies count items into the arena; returns nullptr for an empty array.
+    template<typename T>
+    T* copyArray(const T* items, size_t count) {
+        if (count == 0) return nullptr;
+        T* out = static_cast<T*>(allocate(sizeof(T) * count, alignof(T)));
+        for (size_t i = 0; i < count; ++i) new (out + i) T(items[i]);
+        return out;
+    }
+
+    std::string_view copyString(std::string_view s) {
+        if (s.empty()) return std::string_view();
+        char* out = static_cast<char*>(allocate(s.size(), 1));
+        std::memcpy(out, s.data(), s.size());
+        return std::string_view(out, s.size());
+    }
+
+    // Bytes handed out so far, excluding alignment padding and unused block space.
+    size_t bytesUsed() const { return used; }
+};
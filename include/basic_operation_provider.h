@@ -3,7 +3,13 @@
 #include <functional>
 #include <string>
 #include <vector>
+#include <deque>
+#include <unordered_map>
+#include <unordered_set>
+#include <cstdint>
 #include <stdexcept>
+#include <tuple>
+#include <utility>
 
 
 // OperationSignature and matching logic
@@ -11,15 +17,23 @@ class OperationSignature {
 public:
     std::string name;
     std::vector<DataType> argumentTypes;
+    DataType returnType;
+    // A variadic signature takes its last argument type any number of times, also none.
+    bool variadic;
     
-    OperationSignature(const std::string& opName, const std::vector<DataType>& argTypes)
-        : name(opName), argumentTypes(argTypes) {}
+    OperationSignature(const std::string& opName, const std::vector<DataType>& argTypes, DataType retType = DataType::TYPE_GRADE,
+                       bool isVariadic = false)
+        : name(opName), argumentTypes(argTypes), returnType(retType), variadic(isVariadic) {}
     bool matches(const std::string& opName, const std::vector<DataType>& argTypes) const {
-        if (name != opName || argumentTypes.size() != argTypes.size()) {
+        if (name != opName) {
             return false;
         }
-        for (size_t i = 0; i < argumentTypes.size(); ++i) {
-            if (!canCast(argumentTypes[i], argTypes[i])) {
+        size_t fixed = variadic ? argumentTypes.size() - 1 : argumentTypes.size();
+        if (variadic ? argTypes.size() < fixed : argTypes.size() != fixed) {
+            return false;
+        }
+        for (size_t i = 0; i < argTypes.size(); ++i) {
+            if (!canCast(argTypes[i], argumentTypes[i < fixed ? i : fixed])) {
                 return false;
             }
         }
@@ -55,145 +69,169 @@ struct TypeToDataType<unsigned long long> {
     static constexpr DataType value = DataType::TYPE_INTEGER;
 };
 
+// Arguments are converted straight from their Datum; scalars never touch the heap. Only the
+// boxed GradeValue*/IntegerValue* parameter types allocate, and the operation owns those.
 template<typename T>
-T castArgument(Value* v);
+T castArgument(Datum& v);
 
 // Make explicit specializations inline to avoid multiple-definition errors
 template<>
-inline GradeValue* castArgument<GradeValue*>(Value* v) {
-    GradeValue* out = static_cast<GradeValue*>(castValue(v, DataType::TYPE_GRADE));
-    if (!out) {
+inline GradeValue* castArgument<GradeValue*>(Datum& v) {
+    if (!canCast(v.getType(), DataType::TYPE_GRADE)) {
         throw std::invalid_argument("Failed to cast argument to GradeValue.");
     }
-    return out;
+    return new GradeValue(v.toGrade());
 }
 
 template<>
-inline IntegerValue* castArgument<IntegerValue*>(Value* v) {
-    IntegerValue* out = static_cast<IntegerValue*>(castValue(v, DataType::TYPE_INTEGER));
-    if (!out) {
+inline IntegerValue* castArgument<IntegerValue*>(Datum& v) {
+    if (v.getType() != DataType::TYPE_INTEGER) {
         throw std::invalid_argument("Failed to cast argument to IntegerValue.");
     }
-    return out;
+    return new IntegerValue(v.getInteger());
 }
 
 template<>
-inline ListValue* castArgument<ListValue*>(Value* v) {
-    ListValue* out = static_cast<ListValue*>(castValue(v, DataType::TYPE_LIST));
-    if (!out) {
+inline ListValue* castArgument<ListValue*>(Datum& v) {
+    if (v.getType() != DataType::TYPE_LIST) {
         throw std::invalid_argument("Failed to cast argument to ListValue.");
     }
-    return out;
+    return v.releaseList();
 }
 
 template<>
-inline double castArgument<double>(Value* v) {
-    GradeValue* gv = static_cast<GradeValue*>(castValue(v, DataType::TYPE_GRADE));
-    if (!gv) {
+inline double castArgument<double>(Datum& v) {
+    if (!canCast(v.getType(), DataType::TYPE_GRADE)) {
         throw std::invalid_argument("Failed to cast argument to double.");
     }
-    delete v;
-    return gv->getVal();
+    return v.toGrade();
 }
 
 template<>
-inline unsigned long long castArgument<unsigned long long>(Value* v) {
-    IntegerValue* iv = static_cast<IntegerValue*>(castValue(v, DataType::TYPE_INTEGER));
-    if (!iv) {
+inline unsigned long long castArgument<unsigned long long>(Datum& v) {
+    if (v.getType() != DataType::TYPE_INTEGER) {
         throw std::invalid_argument("Failed to cast argument to unsigned long long.");
     }
-    delete v;
-    return iv->getVal();
+    return v.getInteger();
 }
 
 template<typename T>
-Value* castReturnValue(T retVal);
+Datum castReturnValue(T retVal);
 
 // Mark explicit return-value specializations inline as well
 template<>
-inline Value* castReturnValue<GradeValue*>(GradeValue* retVal) {
-    return retVal;
+inline Datum castReturnValue<GradeValue*>(GradeValue* retVal) {
+    return Datum::take(retVal);
 }
 
 template<>
-inline Value* castReturnValue<IntegerValue*>(IntegerValue* retVal) {
-    return retVal;
+inline Datum castReturnValue<IntegerValue*>(IntegerValue* retVal) {
+    return Datum::take(retVal);
 }
 
 template<>
-inline Value* castReturnValue<ListValue*>(ListValue* retVal) {
-    return retVal;
+inline Datum castReturnValue<ListValue*>(ListValue* retVal) {
+    return Datum::makeList(retVal);
 }
 
 template<>
-inline Value* castReturnValue<double>(double retVal) {
-    return new GradeValue(retVal);
+inline Datum castReturnValue<double>(double retVal) {
+    return Datum::makeGrade(retVal);
 }
 
 template<>
-inline Value* castReturnValue<unsigned long long>(unsigned long long retVal) {
-    return new IntegerValue(retVal);
+inline Datum castReturnValue<unsigned long long>(unsigned long long retVal) {
+    return Datum::makeInteger(retVal);
 }
 
-template<typename R, typename S, typename ...T>
-std::function<R(T...)> _bind_front(std::function<R(S, T...)> func, S arg) {
-    return [func, arg](T... rest) -> R {
-        return func(arg, rest...);
-    };
+// Converts every argument to its parameter type and calls func once. The conversions run left
+// to right (braced initialization), so argument casts happen in the order the old chained
+// wrappers used.
+template<typename R, typename... T, typename F, size_t... I>
+Datum _invokeOperation(const F& func, std::vector<Datum>& args, std::index_sequence<I...>) {
+    std::tuple<T...> converted{ castArgument<T>(args[I])... };
+    return castReturnValue<R>(std::apply(func, std::move(converted)));
 }
 
-template<typename R, typename S, typename... T>
-std::function<Value*(const std::vector<Value*>::iterator&)> _wrapOperation(std::function<R(S, T...)> func) {
-    return [func](const std::vector<Value*>::iterator& argsIt) -> Value* {
-        S firstArg = castArgument<S>(*(argsIt));
-        if constexpr (sizeof...(T) == 0) {
-            return castReturnValue<R>(func(firstArg));
-        } else {
-            auto restFunc = _wrapOperation<R, T...>(_bind_front(func, firstArg));
-            return restFunc(argsIt + 1);
+// The type-erased thunk stored for an operation; built once, at registration.
+template<typename R, typename... T, typename F>
+OperationFn _makeInvoker(F func) {
+    return [func](std::vector<Datum>& args) -> Datum {
+        if (args.size() != sizeof...(T)) {
+            throw std::invalid_argument("Incorrect number of arguments for operation.");
         }
+        return _invokeOperation<R, T...>(func, args, std::index_sequence_for<T...>());
     };
 }
 
-template<typename R>
-std::function<Value*(const std::vector<Value*>&)> _wrapOperation(std::function<R()> func) {
-    return [func](const std::vector<Value*>& /*args*/) -> Value* {
-        return castReturnValue<R>(func());
-    };
-}
-
-template<typename... T>
+template<typename R, typename... T>
 OperationSignature _makeSignature(const std::string& name) {
-    return OperationSignature(name, { TypeToDataType<T>::value... });
+    return OperationSignature(name, { TypeToDataType<T>::value... }, TypeToDataType<R>::value);
 }
 
 class BasicOperationProvider : public OperationProvider {
 private:
-    std::vector<std::pair<OperationSignature, std::function<Value*(std::vector<Value*>&)>>> operations;
+    // All overloads of one operation name with one arity, in registration order. For small
+    // arities, dispatch holds the winning overload for every argument type tuple (indexed in
+    // base 3 by DataType), or -1 if no overload accepts it.
+    struct OverloadSet {
+        std::vector<size_t> overloads; // indices into operations
+        std::vector<int32_t> dispatch;
+    };
+
+    // a deque keeps resolved OperationFn pointers valid when more operations are registered
+    std::deque<std::pair<OperationSignature, OperationFn>> operations;
+    std::unordered_map<std::string, uint32_t> nameIds;     // interned operation names
+    std::unordered_map<uint64_t, OverloadSet> overloadSets; // keyed by (name id, arity)
+    // variadic overloads by name id, in registration order; tried after the fixed-arity ones
+    std::unordered_map<uint32_t, std::vector<size_t>> variadicOverloads;
+    std::unordered_map<std::string, ElementwiseOp> elementwise;
+    std::unordered_set<std::string> pureOperations;
+    struct LazyOperation {
+        size_t minArgs;
+        size_t maxArgs;
+        LazyOperationFn fn;
+    };
+    std::unordered_map<std::string, LazyOperation> lazyOperations;
+
+    void rankOverloads(OverloadSet& set) const;
+    const std::pair<OperationSignature, OperationFn>* findOverload(const std::string& operationName, const std::vector<DataType>& argTypes) const;
 public:
     // NON-TEMPLATE member function declarations (implemented in .cpp)
     bool hasOperation(const std::string& operationName) const override;
-    Value* executeOperation(const std::string& operationName, std::vector<Value*>& arguments) const override;
-    void registerOperation(OperationSignature sig, std::function<Value*(std::vector<Value*>&)> func);
+    Datum executeOperation(const std::string& operationName, std::vector<Datum>& arguments) const override;
+    ResolvedOperation resolveOperation(const std::string& operationName, const std::vector<DataType>& argTypes) const override;
+    // Only operations declared with declarePure are pure; the others default to impure.
+    bool isPure(const std::string& operationName) const override;
+    // Declares that every overload registered under this name depends on nothing but its
+    // arguments (see OperationProvider::isPure), so its calls may be folded and shared.
+    void declarePure(const std::string& operationName);
+    std::optional<ElementwiseOp> elementwiseOperation(const std::string& operationName) const override;
+    // Declares that the operation registered under this name computes op (see
+    // OperationProvider::elementwiseOperation); only declare operations that call applyElementwise.
+    void declareElementwise(const std::string& operationName, ElementwiseOp op);
+    bool isLazy(const std::string& operationName) const override;
+    Datum executeLazyOperation(const std::string& operationName, LazyArguments& arguments) const override;
+    // Registers a lazy operation (see OperationProvider::isLazy) taking minArgs to maxArgs
+    // arguments; SIZE_MAX leaves the count open. A lazy operation has no overloads: func gets
+    // every call and checks the arguments it evaluates itself. Throws std::invalid_argument if
+    // the name is already registered.
+    void registerLazyOperation(const std::string& name, size_t minArgs, size_t maxArgs, LazyOperationFn func);
+    // Registers an overload; a variadic signature (at least one argument type) makes func receive
+    // every argument as it is passed. Calls whose arity has a matching fixed-arity overload use
+    // that one; the others try the variadic overloads in registration order.
+    void registerOperation(OperationSignature sig, OperationFn func);
 
     // member-template overloads remain inline so they can be instantiated
     template<typename S, typename... T>
     void registerOperation(const std::string& name, std::function<S(T...)> func) {
-        OperationSignature sig = _makeSignature<T...>(name);
-        std::function<Value*(std::vector<Value*>&)> wrappedFunc = [func](std::vector<Value*>& args) -> Value* {
-            if (args.size() != sizeof...(T)) {
-                throw std::invalid_argument("Incorrect number of arguments for operation.");
-            }
-            auto argsIt = args.begin();
-            return _wrapOperation<S, T...>(func)(argsIt);
-        };
-        registerOperation(sig, wrappedFunc);
+        registerOperation(_makeSignature<S, T...>(name), _makeInvoker<S, T...>(std::move(func)));
     }
 
+    // Function pointers are called directly, without an inner std::function.
     template<typename S, typename... T>
     void registerOperation(const std::string& name, S(*func)(T...)) {
-        std::function<S(T...)> f = func;
-        registerOperation<S, T...>(name, f);
+        registerOperation(_makeSignature<S, T...>(name), _makeInvoker<S, T...>(func));
     }
 };
 
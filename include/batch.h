@@ -0,0 +1,91 @@
+#pragma once
+#include <istream>
+#include <string>
+#include <vector>
+#include "eval.h"
+
+// One student of a roster: an identifier and the input categories read from its row.
+struct RosterRow {
+    std::string studentId;
+    Program* inputs;
+};
+
+// A table of per-student inputs, typically read from a CSV gradebook.
+class Roster {
+public:
+    std::vector<std::string> columns; // input category names, in file order
+    std::vector<RosterRow> rows;
+    Roster() = default;
+    Roster(const Roster&) = delete;
+    Roster& operator=(const Roster&) = delete;
+    ~Roster();
+};
+
+// Reads a CSV roster. The first line is a header "<id>,<category>,<category>,...";
+// every following line holds one student. Each cell is a GradeLang expression
+// (e.g. 85%, 0.9, 3, {80% 90%:2}, undef); empty cells leave the category unset so
+// it falls through to the loaded programs. Fields are not quoted.
+// Throws std::runtime_error on malformed input.
+Roster* parseRoster(std::istream& in);
+
+// Formats a value in GradeLang literal syntax, e.g. 0.85, 3, {0.8 0.9:2} or undef.
+std::string formatBatchValue(const Value* v);
+
+struct BatchRow {
+    std::vector<std::string> cells; // one formatted value per target
+    std::string error;              // first evaluation error of the row, empty if none
+};
+
+// A store of per-student inputs, such as a gradebook database, that BatchEvaluator queries for
+// a group of rows at a time instead of once per student and category.
+class RosterStore {
+public:
+    virtual ~RosterStore() = default;
+    // Looks up the categories of every student in one request: one entry per student, each with
+    // one entry per name, a new Value owned by the caller or nullptr where the store has none.
+    // Called from the worker threads, so it must be thread-safe; throws on failure.
+    virtual std::vector<std::vector<Value*>> getStudentValues(const std::vector<std::string>& studentIds,
+                                                              const std::vector<std::string>& categoryNames) = 0;
+};
+
+// What hoisting the student-invariant categories of a batch saved (see BatchEvaluator::run).
+struct BatchStats {
+    size_t invariantCategories = 0;  // planned categories no roster column reaches, computed once
+    size_t perStudentCategories = 0; // planned categories computed for every row
+    size_t sharedReads = 0;          // lookups rows answered from the invariant values
+    size_t storeRequests = 0;        // getStudentValues requests, one per group of rows
+    // Category computations the rows skipped: each row would compute every invariant category.
+    size_t savedEvaluations(size_t rows) const { return rows > 1 ? invariantCategories * (rows - 1) : 0; }
+};
+
+// Evaluates the same set of programs for every row of a roster. The programs and
+// operation providers are shared read-only between worker threads; each row gets
+// its own Context, with the row inputs taking precedence over the input store, if any,
+// and that over the programs.
+class BatchEvaluator {
+private:
+    std::vector<DataProvider*> programs;
+    std::vector<OperationProvider*> operations;
+    const SymbolTable* symbols;
+    RosterStore* store;
+public:
+    // symbols is the table the programs (and roster rows) are bound to, if any; every row
+    // Context uses it (see Context::setSymbolTable). store, if given, supplies the inputs the
+    // roster leaves out, by student id; it is not owned.
+    BatchEvaluator(const std::vector<DataProvider*>& programs, const std::vector<OperationProvider*>& operations,
+                   const SymbolTable* symbols = nullptr, RosterStore* store = nullptr);
+
+    // Evaluates the target categories for every roster row on up to `threads` workers
+    // (0 selects the hardware concurrency). Only categories the targets depend on are computed,
+    // following one EvalPlan for all rows. Categories that read no roster column, directly or
+    // through others, are the same for every student: they are computed once, before the rows,
+    // and published read-only to every row Context (see Context::setSharedValues). The store is
+    // asked once per group of rows for the plan's leaves, its inputs and the steps that read no
+    // other category; what it returns overrides the programs for that student, so categories
+    // reading a leaf are never shared. A store needs the dependency graphs of all programs
+    // (throws std::invalid_argument otherwise); if a request fails, every target of its rows is
+    // an error. Results are returned in roster order; stats, if given, receives the counters of
+    // the run.
+    std::vector<BatchRow> run(const Roster& roster, const std::vector<std::string>& targets, unsigned threads = 0,
+                              BatchStats* stats = nullptr) const;
+};
@@ -0,0 +1,130 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "eval.h"
+#include "list_pipeline.h"
+
+enum class OpCode : uint8_t {
+    PUSH_GRADE,    // push grades[operand]
+    PUSH_INTEGER,  // push integers[operand]
+    PUSH_LIST,     // push a copy of lists[operand]
+    LOAD_CATEGORY, // push a copy of ctx->getCategoryValue(names[operand]), by symbol if bound
+    TO_GRADE,      // convert the top of the stack to an unboxed grade (lists via toGrade)
+    MAKE_LIST,     // pop operand (value, weight) grade pairs and push them as a list
+    CALL,          // pop calls[operand].argc arguments, execute the operation, push the result
+    MEMO_LOAD,     // if the Context has memos[operand] computed, push a copy and jump to its end
+    MEMO_STORE,    // record the top of the stack as the value of memos[operand]
+    PIPELINE,      // pop pipelines[operand]'s parameters and list, push the list it produces
+    PIPELINE_MEAN, // like PIPELINE followed by TO_GRADE, without building the list
+    JUMP,          // continue at instruction operand
+    CALL_LAZY,     // execute lazyCalls[operand], running its argument chunks on demand; push the result
+};
+
+struct Instruction {
+    OpCode op;
+    uint32_t operand;
+};
+
+struct CallSite {
+    OperationCallSite* site; // owned by the CompiledProgram
+    uint32_t argc;
+};
+
+// A memoized subexpression (see subexpressions.h): its Context memo key, and the instruction
+// after its MEMO_STORE, where a memo hit continues.
+struct MemoSite {
+    uint64_t key;
+    uint32_t end;
+};
+
+// The code of one category: instructions [begin, end) and the stack depth they need.
+struct Chunk {
+    uint32_t begin;
+    uint32_t end;
+    uint32_t maxStack;
+};
+
+// A call of a lazy operation: its call site in calls, and one chunk per argument, each leaving
+// the argument's value. The chunks lie behind a JUMP in the code of the calling category.
+struct LazyCallSite {
+    uint32_t call;
+    std::vector<Chunk> arguments;
+};
+
+// A Program lowered to linear stack bytecode. It is a drop-in DataProvider for the
+// Program it was compiled from and shares no state with it, so the Program may be
+// deleted after compilation. Execution only reads the compiled program, so one
+// instance can serve many Contexts on different threads.
+class CompiledProgram : public DataProvider {
+private:
+    std::vector<Instruction> code;
+    std::vector<double> grades;
+    std::vector<unsigned long long> integers;
+    std::vector<ListValue*> lists;
+    std::vector<std::string> names;
+    std::vector<uint32_t> nameSymbols; // by name index; see Program::bindSymbols
+    std::vector<CallSite> calls;
+    std::vector<MemoSite> memos;
+    std::vector<ListPipeline> pipelines; // stage call sites are owned, like those of calls
+    std::vector<LazyCallSite> lazyCalls;
+    std::unordered_map<std::string, Chunk> chunks;
+    std::unique_ptr<DependencyGraph> graph; // names point at the keys of chunks
+    std::vector<const Chunk*> indexedChunks; // by graph index
+    const SymbolTable* symbols = nullptr;     // the table the program was bound to, if any
+    std::vector<const Chunk*> symbolChunks;   // by symbol; nullptr where not defined here
+    friend class BytecodeCompiler;
+    friend CompiledProgram* compileProgram(const Program& program);
+    class ChunkArguments;
+
+    // Runs chunk and returns the value it leaves, or an undefined grade if it leaves none.
+    Datum run(const Chunk& chunk, Context* ctx) const;
+    Value* execute(const Chunk& chunk, Context* ctx) const;
+public:
+    CompiledProgram() = default;
+    CompiledProgram(const CompiledProgram&) = delete;
+    CompiledProgram& operator=(const CompiledProgram&) = delete;
+    ~CompiledProgram();
+    Value* getCategoryValue(const std::string& categoryName, Context* ctx) override;
+    const DependencyGraph* dependencyGraph() const override;
+    Value* getCategoryValueAt(uint32_t index, Context* ctx) override;
+    Value* getSymbolValue(uint32_t symbol, Context* ctx) override;
+    bool hasCategory(const std::string& categoryName) const;
+    size_t codeSize() const;
+    void disassemble(std::ostream& os) const;
+};
+
+// Emits bytecode for expressions into a CompiledProgram, tracking the stack depth.
+class BytecodeCompiler {
+private:
+    CompiledProgram* out;
+    uint32_t depth = 0;
+    uint32_t maxDepth = 0;
+    std::unordered_map<std::string, uint32_t> nameIndex;
+public:
+    BytecodeCompiler(CompiledProgram* target) : out(target) {}
+    void emit(OpCode op, uint32_t operand, int stackEffect);
+    void emitGrade(double g);
+    void emitToGrade();
+    void emitInteger(unsigned long long v);
+    void emitConstant(const Datum& v);
+    // symbol is the reference's bound id, or SymbolTable::NO_SYMBOL.
+    void emitLoad(const std::string& categoryName, uint32_t symbol);
+    // Copies the call site, keeping any link-time binding of the expression it came from.
+    void emitCall(const OperationCallSite& site, uint32_t argc);
+    // Copies the pipeline with its stages' call sites; expects its parameters and list pushed.
+    void emitPipeline(const ListPipeline& pipeline);
+    // Compiles a call of a lazy operation: each argument to a chunk of its own, run only when
+    // the operation asks for the argument.
+    void emitLazyCall(const OperationCallSite& site, Expression* const* args, uint32_t argc);
+    // Brackets the code of a memoized subexpression; beginMemo returns the site for endMemo.
+    uint32_t beginMemo(uint64_t memoKey);
+    void endMemo(uint32_t site);
+    void compileCategory(const std::string& categoryName, const Expression* expr);
+};
+
+// Lowers every category of the program to bytecode, keeping its symbol binding if it has one.
+CompiledProgram* compileProgram(const Program& program);
@@ -1,6 +1,9 @@
 #pragma once
 #include <vector>
 #include <limits>
+#include <memory>
+#include <new>
+#include <cstddef>
 #include <utility>
 #include <stdexcept>
 
@@ -14,6 +17,7 @@ class Value {
 public:
     virtual ~Value() = default;
     virtual DataType getType() const = 0;
+    virtual Value* copy() const = 0;
 };
 
 
@@ -25,6 +29,7 @@ private:
 public:
     GradeValue(double g);
     DataType getType() const override;
+    GradeValue* copy() const override;
     double getVal() const;
     void setVal(double g);
     bool isUndefined() const;
@@ -39,15 +44,39 @@ private:
 public:
     IntegerValue(unsigned long long val);
     DataType getType() const override;
+    IntegerValue* copy() const override;
     unsigned long long getVal() const;
     void setVal(unsigned long long val);
 };
 
+// Allocator for arrays that SIMD kernels load from; aligned to a full AVX register.
+template<typename T>
+struct SimdAllocator {
+    using value_type = T;
+    static const size_t ALIGNMENT = 32;
+    SimdAllocator() = default;
+    template<typename U> SimdAllocator(const SimdAllocator<U>&) {}
+    T* allocate(size_t n) { return static_cast<T*>(::operator new(n * sizeof(T), std::align_val_t(ALIGNMENT))); }
+    void deallocate(T* p, size_t) { ::operator delete(p, std::align_val_t(ALIGNMENT)); }
+    template<typename U> bool operator==(const SimdAllocator<U>&) const { return true; }
+    template<typename U> bool operator!=(const SimdAllocator<U>&) const { return false; }
+};
+
+using SimdArray = std::vector<double, SimdAllocator<double>>;
+
 // List values contain a sequence of double values, each of which has a double weight associated with it.
+// Values and weights are kept in two separate aligned arrays (see list_kernels.h).
+// Copies share their entries copy-on-write: copy() is O(1), and a list clones the entries on its
+// first write while they are shared, so writes never show through another copy.
 class ListValue : public Value {
 private:
-    std::vector<std::pair<double, double>> listValues; // pair<value, weight>
-    friend class ListValueIterator;
+    struct Entries {
+        SimdArray values;
+        SimdArray weights;
+    };
+    std::shared_ptr<Entries> listValues;
+    // the entries, made exclusive to this list first if they are shared
+    Entries& mutableEntries();
 public:
     ListValue();
     DataType getType() const override;
@@ -55,19 +84,53 @@ public:
     double getWeightAt(size_t index) const;
     size_t size() const;
     void addValue(double value, double weight = 1);
+    void reserve(size_t n);
+    // Appends all entries of other.
+    void append(const ListValue& other);
     void clear();
     void setValueAt(size_t index, double value);
     void setWeightAt(size_t index, double weight);
     void removeAt(size_t index);
     void insertAt(size_t index, double value, double weight = 1);
-    ListValue* copy() const;
+    ListValue* copy() const override;
+    // Whether the entries are currently shared with another copy.
+    bool isShared() const;
+    // The size() values and weights; the pointers are invalidated by any change of size.
+    const double* values() const;
+    const double* weights() const;
+    // Writable values, made exclusive to this list first.
+    double* mutableValues();
+    // Keeps the entries for which keep(value) is true, in their order, in a single pass.
+    // keep is called exactly once per entry, first to last, so it may count what it keeps.
+    template<typename Keep>
+    void retainIf(Keep keep);
+    // Weighted mean of the defined values, NaN if nothing is defined.
+    double weightedMean() const;
+    // Weighted mean of the defined values; always returns a new GradeValue (NaN if nothing is defined).
     GradeValue* toGrade() const;
 };
 
+template<typename Keep>
+void ListValue::retainIf(Keep keep) {
+    Entries& entries = mutableEntries();
+    size_t n = entries.values.size();
+    size_t kept = 0;
+    for (size_t i = 0; i < n; ++i) {
+        double value = entries.values[i];
+        if (!keep(value)) continue;
+        entries.values[kept] = value;
+        entries.weights[kept] = entries.weights[i];
+        ++kept;
+    }
+    entries.values.resize(kept);
+    entries.weights.resize(kept);
+}
+
+// Walks a list by position; writes go through the list, so they clone shared entries first.
 class ListValueIterator {
 private:
     ListValue* listValue;
-    std::vector<std::pair<double, double>>::iterator currentIt;
+    size_t index;
 public:
     ListValueIterator(ListValue* lv);
 
@@ -85,3 +148,118 @@ public:
     void insertBefore(double value, double weight = 1);
     void insertAfter(double value, double weight = 1);
 };
+
+// An evaluation result passed by value. Grades and integers are stored inline, so only lists
+// allocate; a Datum owns the list it holds. Datums are move-only: copy() makes an explicit
+// copy, which is O(1) for lists since their entries are shared copy-on-write.
+class Datum {
+private:
+    DataType type;
+    union {
+        double grade;
+        unsigned long long integer;
+        ListValue* list;
+    };
+    void moveFrom(Datum& other);
+public:
+    // An undefined grade.
+    Datum() : type(DataType::TYPE_GRADE), grade(std::numeric_limits<double>::quiet_NaN()) {}
+    static Datum makeGrade(double g);
+    static Datum makeInteger(unsigned long long v);
+    // Takes ownership of lv.
+    static Datum makeList(ListValue* lv);
+    // Copies a borrowed value; nullptr gives an undefined grade.
+    static Datum fromValue(const Value* v);
+    // Takes over an owned value: a list is kept as is, scalar boxes are deleted.
+    static Datum take(Value* v);
+
+    Datum(Datum&& other) noexcept;
+    Datum& operator=(Datum&& other) noexcept;
+    Datum(const Datum&) = delete;
+    Datum& operator=(const Datum&) = delete;
+    ~Datum() { if (type == DataType::TYPE_LIST) delete list; }
+
+    DataType getType() const { return type; }
+    // The payload of the matching type; getList() stays owned by the Datum.
+    double getGrade() const { return grade; }
+    unsigned long long getInteger() const { return integer; }
+    ListValue* getList() const { return list; }
+    // Hands the list over to the caller and leaves an undefined grade behind.
+    ListValue* releaseList();
+    Datum copy() const;
+    // The value as a grade: integers convert, lists give their weighted mean.
+    double toGrade() const;
+    // Moves the contents into a new heap Value owned by the caller (for the category cache
+    // and other Value* interfaces); leaves an undefined grade behind.
+    Value* box();
+};
+
+// The hot paths of Datum stay inline: evaluation moves Datums around constantly.
+inline Datum Datum::makeGrade(double g) {
+    Datum d;
+    d.grade = g;
+    return d;
+}
+
+inline Datum Datum::makeInteger(unsigned long long v) {
+    Datum d;
+    d.type = DataType::TYPE_INTEGER;
+    d.integer = v;
+    return d;
+}
+
+inline Datum Datum::makeList(ListValue* lv) {
+    Datum d;
+    d.type = DataType::TYPE_LIST;
+    d.list = lv;
+    return d;
+}
+
+// Takes over the payload of other, leaving it an undefined grade.
+inline void Datum::moveFrom(Datum& other) {
+    type = other.type;
+    switch (type) {
+        case DataType::TYPE_GRADE:
+            grade = other.grade;
+            break;
+        case DataType::TYPE_INTEGER:
+            integer = other.integer;
+            break;
+        case DataType::TYPE_LIST:
+            list = other.list;
+            break;
+    }
+    other.type = DataType::TYPE_GRADE;
+    other.grade = std::numeric_limits<double>::quiet_NaN();
+}
+
+inline Datum::Datum(Datum&& other) noexcept {
+    moveFrom(other);
+}
+
+inline Datum& Datum::operator=(Datum&& other) noexcept {
+    if (this != &other) {
+        if (type == DataType::TYPE_LIST) delete list;
+        moveFrom(other);
+    }
+    return *this;
+}
+
+inline ListValue* Datum::releaseList() {
+    ListValue* out = list;
+    type = DataType::TYPE_GRADE;
+    grade = std::numeric_limits<double>::quiet_NaN();
+    return out;
+}
+
+inline double Datum::toGrade() const {
+    switch (type) {
+        case DataType::TYPE_GRADE:
+            return grade;
+        case DataType::TYPE_INTEGER:
+            return static_cast<double>(integer);
+        case DataType::TYPE_LIST:
+            return list->weightedMean();
+    }
+    return std::numeric_limits<double>::quiet_NaN();
+}
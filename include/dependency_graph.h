@@ -0,0 +1,63 @@
+#pragma once
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+class Expression;
+
+// Category dependency graph of one program in compressed adjacency form. Categories are
+// numbered 0..size()-1 in name order. References to names the program does not define
+// (inputs from other DataProviders, or constants such as pass) are not edges; they are
+// listed in externalNames(). Category names are views owned by whoever built the graph.
+class DependencyGraph {
+public:
+    // A view of consecutive category indices.
+    struct IndexRange {
+        const uint32_t* first;
+        const uint32_t* last;
+        const uint32_t* begin() const { return first; }
+        const uint32_t* end() const { return last; }
+        size_t size() const { return static_cast<size_t>(last - first); }
+        bool empty() const { return first == last; }
+    };
+private:
+    std::vector<std::string_view> names;
+    std::unordered_map<std::string_view, uint32_t> indices;
+    // the dependencies of i are edges[edgeOffsets[i], edgeOffsets[i+1]); likewise for dependents
+    std::vector<uint32_t> edgeOffsets;
+    std::vector<uint32_t> edges;
+    std::vector<uint32_t> reverseOffsets;
+    std::vector<uint32_t> reverseEdges;
+    std::vector<uint32_t> order;
+    std::vector<uint32_t> cyclePath;
+    std::vector<std::string> externals;
+    std::vector<uint32_t> externalOffsets;
+    std::vector<uint32_t> externalEdges; // indices into externals
+public:
+    // names are the categories; collectReferences appends the names one of them references.
+    DependencyGraph(std::vector<std::string_view> names,
+                    const std::function<void(std::string_view, std::vector<std::string_view>&)>& collectReferences);
+    // The graph of a program's categories; names point into the program's arena.
+    explicit DependencyGraph(const std::unordered_map<std::string_view, Expression*>& categories);
+
+    size_t size() const { return names.size(); }
+    std::string_view name(uint32_t index) const { return names[index]; }
+    std::optional<uint32_t> indexOf(std::string_view name) const;
+    // Categories directly referenced by index, without duplicates.
+    IndexRange dependencies(uint32_t index) const;
+    // Names index references that are not categories here, as indices into externalNames().
+    IndexRange externalDependencies(uint32_t index) const;
+    // Categories that directly reference index.
+    IndexRange dependents(uint32_t index) const;
+    // Every category after all of its dependencies; categories on or behind a cycle are left out.
+    const std::vector<uint32_t>& topologicalOrder() const { return order; }
+    bool hasCycle() const { return !cyclePath.empty(); }
+    // One cycle as a path a, b, ..., a, or empty if the graph is acyclic.
+    const std::vector<uint32_t>& cycle() const { return cyclePath; }
+    // Referenced names that are not categories of this program, in name order.
+    const std::vector<std::string>& externalNames() const { return externals; }
+};
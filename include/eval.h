@@ -3,31 +3,334 @@
 #include <string>
 #include <unordered_set>
 #include <unordered_map>
+#include <functional>
+#include <optional>
+#include <atomic>
+#include <mutex>
+#include <memory>
+#include <cstdint>
+#include <string_view>
+#include "arena.h"
 #include "data.h"
 
 
 class DataProvider;
 class OperationProvider;
+class BytecodeCompiler;
+class DependencyGraph;
+class WorkStealingPool;
+class EvalPlan;
+class SymbolTable;
+struct ListFuser;
+class LazyArguments;
+enum class ElementwiseOp : uint8_t; // see list_pipeline.h
 
+// Category values cached by a Context; safe for concurrent use. Each operation locks one of
+// several shards. Cached values are immutable and owned by the cache.
+class ValueCache {
+private:
+    static const size_t SHARD_COUNT = 16;
+    struct alignas(64) Shard {
+        std::mutex mutex;
+        std::unordered_map<std::string, Value*> values;
+    };
+    Shard shards[SHARD_COUNT];
+    Shard& shardFor(const std::string& name);
+public:
+    ValueCache() = default;
+    ValueCache(const ValueCache&) = delete;
+    ValueCache& operator=(const ValueCache&) = delete;
+    ~ValueCache();
+    // Returns the cached value, or nullptr.
+    Value* find(const std::string& name);
+    // Caches value unless name already has one (another thread got there first), in which case
+    // value is deleted. Returns the value that is cached.
+    Value* insert(const std::string& name, Value* value);
+    // Removes and returns the cached value, or nullptr; the caller takes ownership.
+    Value* erase(const std::string& name);
+};
+
+// Values of memoized subexpressions (see subexpressions.h) computed in a Context; safe for
+// concurrent use. Like ValueCache it is sharded, keeps the first value stored for a key, and
+// never changes a value once stored.
+class SubexpressionCache {
+private:
+    static const size_t SHARD_COUNT = 16;
+    struct alignas(64) Shard {
+        std::mutex mutex;
+        std::unordered_map<uint64_t, Datum> values;
+    };
+    Shard shards[SHARD_COUNT];
+public:
+    SubexpressionCache() = default;
+    SubexpressionCache(const SubexpressionCache&) = delete;
+    SubexpressionCache& operator=(const SubexpressionCache&) = delete;
+    // Returns the stored value, or nullptr; it stays valid for the cache's lifetime.
+    const Datum* find(uint64_t key);
+    // Stores value unless key already has one; returns the value that is stored.
+    const Datum& insert(uint64_t key, Datum value);
+};
+
+// Category values computed once and published read-only to any number of Contexts (see
+// Context::setSharedValues), such as the student-invariant categories of a batch. It is filled
+// before it is published and only read afterwards, so lookups take no locks. Owns its values.
+class SharedValues {
+private:
+    std::unordered_map<std::string, Value*> values;
+    const SymbolTable* symbols;
+    std::vector<Value*> symbolValues; // by symbol of symbols; nullptr where not shared
+public:
+    // With the symbol table of the Contexts that read them, values are also found by symbol.
+    SharedValues(const SymbolTable* symbols = nullptr);
+    SharedValues(const SharedValues&) = delete;
+    SharedValues& operator=(const SharedValues&) = delete;
+    ~SharedValues();
+    // Publishes a copy of value under categoryName; the first value added for a name is kept.
+    void add(const std::string& categoryName, const Value* value);
+    Value* find(const std::string& categoryName) const;
+    // find for the category with this id in symbolTable(), which must be set.
+    Value* findSymbol(uint32_t symbol) const;
+    const SymbolTable* symbolTable() const { return symbols; }
+    size_t size() const { return values.size(); }
+};
+
+// Ownership: Expression::evaluate and OperationProvider::executeOperation return Datums by value,
+// and operations consume their arguments. Category values are boxed once, when they are cached;
+// DataProviders return owned Values for the Context to cache. Values cached by a Context are owned
+// by that Context; getCategoryValue returns a borrowed pointer that stays valid for its lifetime.
+// Providers are not owned by the Context. getCategoryValue may be called from several threads
+// at once as long as the providers are thread-safe; the provider vectors must not change meanwhile.
 class Context {
 private:
-    std::unordered_map<std::string, Value*> valueCache;
+    ValueCache valueCache;
+    SubexpressionCache subexpressions;
+    // values of the categories with a symbol below slotCount, owned like those in valueCache
+    const SymbolTable* symbols = nullptr;
+    std::unique_ptr<std::atomic<Value*>[]> slotValues;
+    size_t slotCount = 0;
+
+    // reactive mode (see trackDependencies), guarded by trackingMutex
+    bool tracking = false;
+    std::mutex trackingMutex;
+    std::unordered_map<std::string, std::unordered_set<std::string>> readers; // category -> categories that read it
+    std::unordered_set<std::string> inputs;      // categories set through setCategoryValue
+    std::unordered_set<std::string> invalidated; // not recomputed since they were invalidated
+    std::vector<Value*> retired;                 // values of invalidated categories, owned
+    size_t recomputed = 0;
+    // what-if forks (see fork): values are inherited from parent unless shadowed, that is,
+    // overridden here or dependent on something that is
+    Context* parent = nullptr;
+    std::unordered_set<std::string> shadowed;
+    // values published by another Context (see setSharedValues), and how often they were read
+    const SharedValues* shared = nullptr;
+    std::atomic<size_t> sharedReads{0};
+
+    Value* storeSymbolValue(uint32_t symbol, Value* value);
+    Value* storeCategoryValue(const std::string& categoryName, Value* value);
+    Value* findCategoryValue(const std::string& categoryName);
+    Value* eraseCategoryValue(const std::string& categoryName);
+    void recordRead(const std::string& categoryName);
+    void recordComputed(const std::string& categoryName);
+    Value* inheritedValue(const std::string& categoryName);
+    Value* sharedValue(uint32_t symbol);
+    Value* sharedValue(const std::string& categoryName);
 public:
     std::vector<DataProvider*> dataProviders;
     std::vector<OperationProvider*> operationProviders;
     // This function should ensure that no circular dependencies occur and that all
     // dependencies are cached before finding categoryName.
     Context(); // updates the value cache with the constants pass, fail, and undef.
+    ~Context();
+    Context(const Context&) = delete;
+    Context& operator=(const Context&) = delete;
+    // Throws std::runtime_error if categoryName is reached again while it is being computed.
     Value* getCategoryValue(const std::string& categoryName);
-    Value* executeOperation(const std::string& operationName, const std::vector<Value*>& arguments);
+    // Caches the categories of table's symbols in a flat array indexed by symbol, so that
+    // references bound to the same table (see Program::bindSymbols) skip hashing names. Symbols
+    // interned after this call are cached by name. Call before evaluating anything.
+    void setSymbolTable(const SymbolTable* table);
+    const SymbolTable* symbolTable() const { return symbols; }
+    // getCategoryValue for the category with this id in symbolTable(), which must be set.
+    Value* getSymbolValue(uint32_t symbol);
+    // Computes the given categories and everything they depend on, running categories whose
+    // dependencies are done concurrently on pool. Dependencies come from the providers'
+    // dependency graphs; categories of providers without one run as single tasks. Returns the
+    // values in order; errors are reported exactly as by calling getCategoryValue in turn.
+    std::vector<Value*> evaluateParallel(const std::vector<std::string>& categoryNames, WorkStealingPool& pool);
+    // Runs a plan built for this Context's providers: they must end with plan.providers(), and
+    // the providers ahead of those (such as per-row inputs) take precedence as usual. Steps are
+    // computed in slot order straight from their defining provider. Returns the values of the
+    // plan's targets; errors are reported exactly as by calling getCategoryValue in turn. Meant
+    // for fresh Contexts: a category that is already cached is computed again, keeping the cached
+    // value. Throws std::invalid_argument if the providers do not match.
+    // Before the first step, the leaf inputs are prefetched (see prefetchCategoryValues): the
+    // plan's inputs, and its steps without dependencies that providers ahead of the plan's
+    // define, such as scores a course file gives defaults for. Only the providers ahead of the
+    // plan's are asked in bulk, and only in Contexts that are not forks: a store among the plan's
+    // own providers, such as a fallback placed after the programs, is read step by step.
+    std::vector<Value*> evaluatePlan(const EvalPlan& plan);
+    // Fetches categories, typically the leaf inputs of what is about to be evaluated, with one
+    // getCategoryValues request per provider instead of one lookup each as evaluation reaches
+    // them, and caches them. Names already cached are skipped; each provider is asked for the
+    // names the ones before it did not supply and, if it has a dependency graph, that it defines,
+    // so every value comes from the provider a lookup would take it from. If a provider throws,
+    // prefetching stops and the remaining names are looked up as usual, which reports the error.
+    // Reactive Contexts (see trackDependencies) fetch nothing, since a bulk request could not
+    // record what each name reads. Returns the number of values cached.
+    size_t prefetchCategoryValues(const std::vector<std::string>& categoryNames);
+    Datum executeOperation(const std::string& operationName, std::vector<Datum>& arguments);
+    // Dispatches like executeOperation, handing the arguments over unevaluated (see
+    // OperationProvider::executeLazyOperation).
+    Datum executeLazyOperation(const std::string& operationName, LazyArguments& arguments);
+
+    // Reactive mode: for every category it computes, the Context records which categories it
+    // read, so that setCategoryValue invalidates exactly what depends on a changed input.
+    // Memoized subexpressions are evaluated per category in this mode, since a shared value
+    // would hide which categories it read. Call before evaluating anything.
+    void trackDependencies();
+    bool tracksDependencies() const { return tracking; }
+    // Sets (or replaces) an input category, taking ownership of value; it takes precedence over
+    // every provider. The cached categories that read it, directly or transitively, are
+    // invalidated and recomputed by the next lookups. Their old values stay allocated until the
+    // Context is destroyed, so pointers returned earlier remain valid, though stale. Requires
+    // dependency tracking (throws std::runtime_error otherwise) and must not run concurrently
+    // with evaluation. Returns the number of invalidated categories.
+    size_t setCategoryValue(const std::string& categoryName, Value* value);
+    // Number of invalidated categories that have been computed again since.
+    size_t recomputedCount();
+    // Reads the categories of values, which must outlive the Context, instead of computing them:
+    // after its own cache, ahead of every provider. The caller vouches that each one is what this
+    // Context would compute, as for the categories that read no per-Context input. Call before
+    // evaluating anything; nullptr stops sharing.
+    void setSharedValues(const SharedValues* values);
+    // Number of lookups answered from the shared values, each a computation saved.
+    size_t sharedReadCount() const { return sharedReads.load(std::memory_order_relaxed); }
+
+    // A what-if child of this Context, owned by the caller. It has the same providers and reads
+    // every value this Context (or its own ancestors) has cached, without copying, until
+    // setCategoryValue on the child overrides an input: from then on, the categories recorded as
+    // depending on it are computed in the child instead, and counted as invalidated and
+    // recomputed there. Forks track dependencies and can be forked in turn. The parent must
+    // track dependencies (throws std::runtime_error otherwise) and must outlive the fork. It
+    // must stay as it is meanwhile: categories it computes or inputs it changes after a fork
+    // overrode something are not checked against that override.
+    Context* fork();
+
+    // The value of a memoized subexpression already computed in this Context, or nullptr.
+    const Datum* findSubexpression(uint64_t memoKey);
+    // Records a memoized subexpression's value (the first one stored wins) and returns it.
+    const Datum& storeSubexpression(uint64_t memoKey, Datum value);
+};
+
+
+// A native operation: consumes its arguments and returns the result.
+using OperationFn = std::function<Datum(std::vector<Datum>&)>;
+
+// The arguments of a lazy operation (see OperationProvider::isLazy), evaluated on demand.
+class LazyArguments {
+public:
+    virtual ~LazyArguments() = default;
+    virtual size_t size() const = 0;
+    // Evaluates argument i. Operations evaluate each argument at most once.
+    virtual Datum evaluate(size_t i) = 0;
+};
+
+// Arguments evaluated up front, for lazy operations called through executeOperation.
+class EvaluatedArguments : public LazyArguments {
+private:
+    std::vector<Datum>& values;
+public:
+    EvaluatedArguments(std::vector<Datum>& args) : values(args) {}
+    size_t size() const override { return values.size(); }
+    // Hands the argument over.
+    Datum evaluate(size_t i) override { return std::move(values[i]); }
 };
 
+// A lazy native operation: evaluates the arguments it needs and returns the result.
+using LazyOperationFn = std::function<Datum(LazyArguments&)>;
+
+// An overload chosen for a concrete tuple of argument types; fn is nullptr if none matched.
+struct ResolvedOperation {
+    const OperationFn* fn = nullptr;
+    DataType returnType = DataType::TYPE_GRADE;
+};
 
 class OperationProvider {
 public:
     virtual ~OperationProvider() = default;
     virtual bool hasOperation(const std::string& operationName) const = 0;
-    virtual Value* executeOperation(const std::string& operationName, std::vector<Value*>& arguments) const = 0;
+    virtual Datum executeOperation(const std::string& operationName, std::vector<Datum>& arguments) const = 0;
+    // Returns the overload executeOperation would run for these argument types, so callers can
+    // invoke it directly. Providers that cannot resolve ahead of time keep the default (unresolved).
+    virtual ResolvedOperation resolveOperation(const std::string& operationName, const std::vector<DataType>& argTypes) const;
+    // Whether the operation depends on nothing but its arguments, so that calls with constant
+    // arguments may be evaluated once at load time (see Program::foldConstants). Defaults to false.
+    virtual bool isPure(const std::string& operationName) const;
+    // The element-wise list operation (see list_pipeline.h) this operation computes exactly when
+    // called with that operation's arity, so that chains of such calls may be fused into one
+    // pass (see Program::fuseListPipelines). Defaults to none.
+    virtual std::optional<ElementwiseOp> elementwiseOperation(const std::string& operationName) const;
+    // Whether the operation takes its arguments unevaluated, through executeLazyOperation, so that
+    // arguments it does not use cost nothing. It must give the same results through
+    // executeOperation, with every argument evaluated. Defaults to false.
+    virtual bool isLazy(const std::string& operationName) const;
+    // Executes an operation on unevaluated arguments. The default evaluates all of them, in
+    // order, and calls executeOperation.
+    virtual Datum executeLazyOperation(const std::string& operationName, LazyArguments& arguments) const;
+};
+
+// Resolves an operation the way Context::executeOperation dispatches it: the first provider
+// that has the operation is asked for the overload.
+ResolvedOperation resolveOperation(const std::vector<OperationProvider*>& providers, const std::string& operationName, const std::vector<DataType>& argTypes);
+// Whether the provider that would execute the operation declares it pure; false if none has it.
+bool isPureOperation(const std::vector<OperationProvider*>& providers, const std::string& operationName);
+// Whether the provider that would execute the operation declares it lazy; false if none has it.
+bool isLazyOperation(const std::vector<OperationProvider*>& providers, const std::string& operationName);
+// The element-wise operation declared by the provider that would execute the operation, if any.
+std::optional<ElementwiseOp> elementwiseOperation(const std::vector<OperationProvider*>& providers, const std::string& operationName);
+
+// Dispatch state of one operation call. link() binds the call directly to its overload when all
+// argument types are known statically; otherwise invoke() resolves through a small inline cache
+// keyed by the runtime argument types. Bindings only apply in contexts whose operation providers
+// equal the linked ones; anything else goes through Context::executeOperation.
+class OperationCallSite {
+private:
+    struct CacheEntry {
+        uint64_t key;
+        ResolvedOperation op;
+    };
+    static const size_t CACHE_SIZE = 4;
+
+    std::vector<OperationProvider*> providers;
+    bool linked = false;
+    bool lazy = false;
+    ResolvedOperation bound;
+    // hits read the slots lock-free; misses publish immutable entries under the mutex
+    mutable std::atomic<const CacheEntry*> cache[CACHE_SIZE];
+    mutable std::atomic<size_t> nextSlot;
+    mutable std::mutex cacheMutex;
+    mutable std::vector<std::unique_ptr<CacheEntry>> entries;
+
+    const ResolvedOperation* lookup(const std::vector<Datum>& arguments) const;
+public:
+    std::string operationName;
+
+    OperationCallSite(const std::string& opName);
+    // Copies the name and link-time binding, but starts with an empty inline cache.
+    OperationCallSite(const OperationCallSite& other);
+    OperationCallSite& operator=(const OperationCallSite&) = delete;
+
+    // argTypes holds the static type of each argument, or nullopt where it is only known at runtime.
+    void link(const std::vector<OperationProvider*>& ops, const std::vector<std::optional<DataType>>& argTypes);
+    bool isStaticallyBound() const;
+    // The result type if the call is statically bound.
+    std::optional<DataType> staticReturnType() const;
+    // Whether link found the operation lazy; such calls are compiled with unevaluated arguments.
+    bool isLazy() const { return lazy; }
+    // Whether the operation is lazy in ctx: known from link for the linked providers, looked up
+    // otherwise.
+    bool isLazyIn(const Context* ctx) const;
+    Datum invoke(Context* ctx, std::vector<Datum>& arguments) const;
 };
 
 
@@ -36,50 +339,159 @@ class DataProvider {
 public:
     virtual ~DataProvider() = default;
     virtual Value* getCategoryValue(const std::string& categoryName, Context* ctx) = 0;
+    // Static dependencies of the categories this provider defines, if it knows them; the
+    // graph must list every category the provider can return.
+    virtual const DependencyGraph* dependencyGraph() const { return nullptr; }
+    // Computes the category with this index in dependencyGraph(), like getCategoryValue does.
+    // The default looks the category up by name; providers can index their definitions instead.
+    virtual Value* getCategoryValueAt(uint32_t index, Context* ctx);
+    // Computes the category with this id in ctx's symbol table, like getCategoryValue does. The
+    // default looks the category up by name; providers bound to the table index by id instead.
+    virtual Value* getSymbolValue(uint32_t symbol, Context* ctx);
+    // Bulk fetch (see Context::prefetchCategoryValues): one entry per name, each what
+    // getCategoryValue would return for it (owned by the caller), or nullptr for names this
+    // provider does not supply. The default asks getCategoryValue name by name; providers backed
+    // by a store override it to look all of them up in one request.
+    virtual std::vector<Value*> getCategoryValues(const std::vector<std::string>& categoryNames, Context* ctx);
 };
 
 class Expression;
+struct SubexpressionInterner;
 
+// State of one constant-folding pass (see Program::foldConstants).
+struct ConstantFolder {
+    Arena& arena;
+    Context context; // only the operation providers; constant inputs reference no categories
+    size_t folded = 0;
+    ConstantFolder(Arena& a, const std::vector<OperationProvider*>& ops);
+    // A constant node holding value, allocated in the arena; counts one folded expression.
+    Expression* makeConstant(Datum value);
+};
+
+// A parsed program. Its expressions, their child arrays and the names they use all live in the
+// program's arena and are released with it; category keys point into the arena as well, so
+// categories are added through setCategory.
 class Program : public DataProvider {
+private:
+    mutable std::unique_ptr<DependencyGraph> graph;
+    const SymbolTable* symbols = nullptr;
+    std::vector<Expression*> symbolDefinitions; // by symbol; nullptr where not defined here
 public:
-    std::unordered_map<std::string, Expression*> categories;
+    Arena arena;
+    std::unordered_map<std::string_view, Expression*> categories;
+    Program();
+    // A program whose arena starts with blocks of arenaBlockSize bytes (see Arena), for many
+    // small programs such as roster rows.
+    explicit Program(size_t arenaBlockSize);
     ~Program();
+    // Defines (or redefines) a category, copying its name into the arena. Undoes bindSymbols.
+    void setCategory(std::string_view name, Expression* expr);
+    // The category dependency graph. The parser builds it once at load; setCategory discards it
+    // and the next call rebuilds it, so it must not race with setCategory or another first call.
+    const DependencyGraph* dependencyGraph() const override;
+    // Link pass: binds every operation call to the given providers (see OperationCallSite).
+    void link(const std::vector<OperationProvider*>& ops);
+    // Folding pass, run before link: evaluates pure operations whose arguments are all constant
+    // and lists whose elements all are, replacing them with constants built once. Folded lists
+    // are shared copy-on-write by every evaluation. Calls that fail are left for evaluation to
+    // report. ops must be the providers the program is evaluated with. Returns the number of
+    // folded expressions.
+    size_t foldConstants(const std::vector<OperationProvider*>& ops);
+    // Symbol pass, run after folding and common-subexpression elimination and before
+    // compilation: interns every category name the program defines or references into table
+    // and binds each reference to its id. Contexts using the same table then look categories up
+    // by id (see Context::setSymbolTable); any other Context still goes by name.
+    void bindSymbols(SymbolTable& table);
+    // Fusion pass, run after common-subexpression elimination and before link: replaces chains
+    // of element-wise list operations (see list_pipeline.h) with single passes over the list,
+    // which also feed a surrounding grade conversion without building the list. Memoized calls
+    // inside a chain end it, so they stay shared. ops must be the providers the program is
+    // evaluated with. Returns the number of fused operation calls.
+    size_t fuseListPipelines(const std::vector<OperationProvider*>& ops);
+    const SymbolTable* symbolTable() const { return symbols; }
     Value* getCategoryValue(const std::string& categoryName, Context* ctx) override;
+    Value* getSymbolValue(uint32_t symbol, Context* ctx) override;
 };
 
 
+// Expressions are allocated in their Program's arena and are never deleted individually
+// (see Arena); nodes that own memory outside the arena are created with Arena::makeOwned.
 class Expression {
 public:
+    // Set by common-subexpression elimination (see subexpressions.h): the structural id of the
+    // node, and a nonzero key if its value is memoized per Context.
+    uint32_t subexpressionId = 0;
+    uint64_t memoKey = 0;
+
     virtual ~Expression() = default;
-    virtual Value* evaluate(Context* ctx) const = 0;
-    virtual std::unordered_set<std::string>* getDependencies() const = 0;
+    virtual Datum evaluate(Context* ctx) const = 0;
+    // evaluate(ctx).toGrade(), which some expressions compute without building their value.
+    virtual double evaluateGrade(Context* ctx) const { return evaluate(ctx).toGrade(); }
+    // Appends the names of the categories this expression references, possibly repeated.
+    virtual void collectDependencies(std::vector<std::string_view>& out) const = 0;
 
     // New: print a formatted AST representation to the given stream with indent level.
     virtual void printAST(std::ostream& os, int indent = 0) const = 0;
+
+    // Emit stack bytecode that leaves the value of this expression on the VM stack.
+    virtual void compile(BytecodeCompiler& compiler) const = 0;
+
+    // Binds operation calls to the given providers; returns the static result type if known.
+    virtual std::optional<DataType> link(const std::vector<OperationProvider*>& ops) = 0;
+
+    // Folds constant subexpressions in place; returns the expression to use instead of this
+    // one (this, or a new constant).
+    virtual Expression* foldConstants(ConstantFolder& folder) = 0;
+    // The value of a constant expression, nullptr for any other.
+    virtual const Datum* constantValue() const { return nullptr; }
+    // Hash-conses this tree; returns the program's canonical node for it (this or an earlier one).
+    virtual Expression* internSubexpressions(SubexpressionInterner& interner) = 0;
+    // Binds the category references in this tree to their ids in symbols.
+    virtual void bindSymbols(SymbolTable& table) = 0;
+    // Fuses the element-wise list pipelines in this tree; returns the expression to use instead
+    // of this one (this, or a new FusedListExpr).
+    virtual Expression* fuseListPipelines(ListFuser& fuser) = 0;
 };
 
 
+// A constant list owns heap memory, so such constants are created with Arena::makeOwned.
 class ConstantExpr : public Expression {
 private:
-    Value* value;
+    Datum value;
 
 public:
-    ConstantExpr(Value* val) : value(val) {}
-    Value* evaluate(Context* ctx) const override;
-    std::unordered_set<std::string>* getDependencies() const override;
+    ConstantExpr(Datum val) : value(std::move(val)) {}
+    const Datum& getValue() const { return value; }
+    Datum evaluate(Context* ctx) const override;
+    void collectDependencies(std::vector<std::string_view>& out) const override;
     void printAST(std::ostream& os, int indent = 0) const override;
+    void compile(BytecodeCompiler& compiler) const override;
+    std::optional<DataType> link(const std::vector<OperationProvider*>& ops) override;
+    Expression* foldConstants(ConstantFolder& folder) override;
+    Expression* internSubexpressions(SubexpressionInterner& interner) override;
+    void bindSymbols(SymbolTable& table) override;
+    Expression* fuseListPipelines(ListFuser& fuser) override;
+    const Datum* constantValue() const override { return &value; }
 };
 
-// Represents a reference to another category by name.
-// If the category is of the List type, a copy of the ListValue is returned.
+// Represents a reference to another category by name, or by symbol once bound.
+// Evaluates to a copy of the cached category value, since operations consume their arguments.
 class CategoryRefExpr : public Expression {
 private:
-    std::string categoryName;
+    std::string_view categoryName; // points into the program's arena
+    const SymbolTable* symbols = nullptr;
+    uint32_t symbol = 0;
 public:
-    CategoryRefExpr(const std::string& name) : categoryName(name) {}
-    Value* evaluate(Context* ctx) const override;
-    std::unordered_set<std::string>* getDependencies() const override;
+    CategoryRefExpr(std::string_view name) : categoryName(name) {}
+    Datum evaluate(Context* ctx) const override;
+    void collectDependencies(std::vector<std::string_view>& out) const override;
     void printAST(std::ostream& os, int indent = 0) const override;
+    void compile(BytecodeCompiler& compiler) const override;
+    std::optional<DataType> link(const std::vector<OperationProvider*>& ops) override;
+    Expression* foldConstants(ConstantFolder& folder) override;
+    Expression* internSubexpressions(SubexpressionInterner& interner) override;
+    void bindSymbols(SymbolTable& table) override;
+    Expression* fuseListPipelines(ListFuser& fuser) override;
 };
 
 class ListElement {
@@ -87,31 +499,46 @@ public:
     Expression* valueExpr;
     Expression* weightExpr; // can be nullptr
     ListElement(Expression* valExpr, Expression* wtExpr = nullptr) : valueExpr(valExpr), weightExpr(wtExpr) {}
-    ~ListElement();
 };
 
 class ListExpr : public Expression {
 private:
-    std::vector<ListElement*> elements;
+    ListElement* elements; // elementCount elements, stored contiguously in the arena
+    size_t elementCount;
+    Datum evaluateElements(Context* ctx) const;
 public:
-    ListExpr(const std::vector<ListElement*>& elems) : elements(elems) {}
-    ~ListExpr();
-    Value* evaluate(Context* ctx) const override;
-    std::unordered_set<std::string>* getDependencies() const override;
+    ListExpr(ListElement* elems, size_t count) : elements(elems), elementCount(count) {}
+    Datum evaluate(Context* ctx) const override;
+    void collectDependencies(std::vector<std::string_view>& out) const override;
     void printAST(std::ostream& os, int indent = 0) const override;
+    void compile(BytecodeCompiler& compiler) const override;
+    std::optional<DataType> link(const std::vector<OperationProvider*>& ops) override;
+    Expression* foldConstants(ConstantFolder& folder) override;
+    Expression* internSubexpressions(SubexpressionInterner& interner) override;
+    void bindSymbols(SymbolTable& table) override;
+    Expression* fuseListPipelines(ListFuser& fuser) override;
 };
 
+// Owns its call site's dispatch state, so it is created with Arena::makeOwned.
 class OperationExpr : public Expression {
 private:
-    std::string operationName;
-    std::vector<Expression*> arguments;
+    OperationCallSite callSite;
+    Expression** arguments; // argumentCount arguments, stored contiguously in the arena
+    size_t argumentCount;
+    Datum evaluateCall(Context* ctx) const;
 public:
-    OperationExpr(const std::string& opName, const std::vector<Expression*>& args)
-        : operationName(opName), arguments(args) {};
-    ~OperationExpr();
-    Value* evaluate(Context* ctx) const override;
-    std::unordered_set<std::string>* getDependencies() const override;
+    OperationExpr(std::string_view opName, Expression** args, size_t argc)
+        : callSite(std::string(opName)), arguments(args), argumentCount(argc) {};
+    const OperationCallSite& getCallSite() const { return callSite; }
+    Datum evaluate(Context* ctx) const override;
+    void collectDependencies(std::vector<std::string_view>& out) const override;
     void printAST(std::ostream& os, int indent = 0) const override;
+    void compile(BytecodeCompiler& compiler) const override;
+    std::optional<DataType> link(const std::vector<OperationProvider*>& ops) override;
+    Expression* foldConstants(ConstantFolder& folder) override;
+    Expression* internSubexpressions(SubexpressionInterner& interner) override;
+    void bindSymbols(SymbolTable& table) override;
+    Expression* fuseListPipelines(ListFuser& fuser) override;
 };
 
 bool canCast(DataType fromType, DataType toType);
@@ -0,0 +1,64 @@
+#pragma once
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include "eval.h"
+
+// A demand-driven evaluation order for a fixed set of target categories. Built once from the
+// providers' dependency graphs, it holds only the categories the targets reach, each in a slot
+// after all of its dependencies and bound to the provider that defines it, so Context::evaluatePlan
+// computes them front to back without resolving names or recursing. A plan is immutable and can
+// be run by any number of Contexts, also concurrently.
+class EvalPlan {
+public:
+    struct Step {
+        std::string name;
+        DataProvider* provider; // the first of the plan's providers that defines the category
+        uint32_t index;         // the category's index in provider's dependency graph
+        uint32_t symbol;        // the category's id in symbolTable(), or SymbolTable::NO_SYMBOL
+    };
+    static constexpr uint32_t NO_SLOT = UINT32_MAX;
+private:
+    std::vector<DataProvider*> planProviders;
+    const SymbolTable* symbols;
+    std::vector<Step> planSteps;
+    std::unordered_map<std::string_view, uint32_t> slots; // step name -> slot
+    std::vector<std::string> targetNames;
+    std::vector<uint32_t> targetSlots;
+    std::vector<std::string> inputNames;
+    std::vector<std::vector<uint32_t>> stepDependencies; // by slot: slots it reads
+    std::vector<std::vector<uint32_t>> stepInputs;       // by slot: indices into inputNames it reads
+    size_t cyclic = 0;
+public:
+    // providers are in Context order (nulls are skipped) and must all have a dependency graph;
+    // throws std::invalid_argument otherwise. Referenced names no provider defines are inputs.
+    // With the symbol table of the Contexts that run it, steps also carry their symbols.
+    EvalPlan(const std::vector<DataProvider*>& providers, const std::vector<std::string>& targets,
+             const SymbolTable* symbols = nullptr);
+    EvalPlan(const EvalPlan&) = delete;
+    EvalPlan& operator=(const EvalPlan&) = delete;
+
+    const std::vector<DataProvider*>& providers() const { return planProviders; }
+    const SymbolTable* symbolTable() const { return symbols; }
+    // The steps in evaluation order; a category's slot is its position.
+    const std::vector<Step>& steps() const { return planSteps; }
+    size_t size() const { return planSteps.size(); }
+    std::optional<uint32_t> slotOf(std::string_view name) const;
+    const std::vector<std::string>& targets() const { return targetNames; }
+    // The slot of targets()[i], or NO_SLOT for a target that is an input or lies on or behind a cycle.
+    uint32_t targetSlot(size_t i) const { return targetSlots[i]; }
+    // Names the reachable categories reference but no provider defines, in name order.
+    const std::vector<std::string>& inputs() const { return inputNames; }
+    // The slots the step in slot reads directly; all of them come before it.
+    const std::vector<uint32_t>& dependencies(uint32_t slot) const { return stepDependencies[slot]; }
+    // The inputs the step in slot reads directly, as indices into inputs().
+    const std::vector<uint32_t>& inputDependencies(uint32_t slot) const { return stepInputs[slot]; }
+    // By slot, whether the step is one of names or reads one of them, directly or through other
+    // steps. names may be categories of the plan or inputs; others are ignored.
+    std::vector<char> dependentsOf(const std::vector<std::string>& names) const;
+    // Reachable categories left out because they are on or behind a dependency cycle.
+    size_t cyclicCount() const { return cyclic; }
+};
@@ -0,0 +1,20 @@
+#pragma once
+#include <cstddef>
+#include <string>
+#include "eval.h"
+
+struct GoalSeekResult {
+    bool reached = false;  // whether some input in the range reaches the goal
+    double input = 0.0;    // the smallest input found that does, or the top of the range if none
+    double value = 0.0;    // the target's grade at input
+    size_t probes = 0;     // forks evaluated
+    size_t recomputed = 0; // categories recomputed over all probes
+};
+
+// Finds the smallest value of the input category in [low, high] for which the target category
+// evaluates to a grade of at least goal, to within tolerance, assuming the target does not
+// decrease as the input grows (undef counts as not reaching it). The target is evaluated in ctx
+// first, which must track dependencies (see Context::trackDependencies); each probe then runs
+// in a fork that overrides the input, so only what depends on it is computed again.
+GoalSeekResult goalSeek(Context& ctx, const std::string& input, const std::string& target, double goal,
+                        double low = 0.0, double high = 1.0, double tolerance = 1e-6);
@@ -0,0 +1,48 @@
+#pragma once
+#include <cstddef>
+
+// Element-wise kernels over the value array of a list. Undefined (NaN) values are left
+// untouched unless stated otherwise. Each kernel exists as an AVX2, an SSE2 and a scalar
+// version; the best one the CPU supports is picked on first use. All versions give
+// bit-identical results, including the lane order in which weightedSums accumulates.
+
+enum class SimdLevel {
+    SCALAR,
+    SSE2,
+    AVX2,
+};
+
+// The instruction set the kernels currently run on.
+SimdLevel activeSimdLevel();
+// Best level supported by this CPU.
+SimdLevel supportedSimdLevel();
+// Forces a level (e.g. for tests and benchmarks); it is capped at supportedSimdLevel().
+// Returns the level that took effect. Not safe while kernels run on other threads.
+SimdLevel setSimdLevel(SimdLevel level);
+const char* simdLevelName(SimdLevel level);
+
+// v < lo becomes lo; otherwise v > hi becomes hi.
+void clampValues(double* values, size_t n, double lo, double hi);
+// v < threshold becomes threshold.
+void raiseToValues(double* values, size_t n, double threshold);
+// v > threshold becomes threshold.
+void lowerToValues(double* values, size_t n, double threshold);
+// v becomes dstStart + ((v - srcStart) / srcRange) * dstRange.
+void mapValues(double* values, size_t n, double srcStart, double srcRange, double dstStart, double dstRange);
+// Every defined value becomes value.
+void fillDefinedValues(double* values, size_t n, double value);
+// Every undefined value becomes value.
+void resolveValues(double* values, size_t n, double value);
+// Sums value * weight and weight over the entries with a defined value.
+void weightedSums(const double* values, const double* weights, size_t n, double& weightedTotal, double& totalWeight);
+
+// The minimum, maximum and number of the defined values; the extremes are NaN if there are none.
+void definedExtremes(const double* values, size_t n, double& minValue, double& maxValue, size_t& count);
+
+// Partial sums weightedSums keeps; entry i goes to lane i % WEIGHTED_SUM_LANES.
+const size_t WEIGHTED_SUM_LANES = 4;
+// Adds the entries of one block to the lanes of a running weightedSums. Blocks fed in order,
+// all but the last a multiple of WEIGHTED_SUM_LANES long, and reduced with reduceWeightedSums
+// give exactly the sums weightedSums computes over the whole array at once.
+void accumulateWeightedSums(const double* values, const double* weights, size_t n, double* weightedLanes, double* totalLanes);
+void reduceWeightedSums(const double* weightedLanes, const double* totalLanes, double& weightedTotal, double& totalWeight);
@@ -0,0 +1,88 @@
+#pragma once
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+#include "eval.h"
+
+// Element-wise list operations an OperationProvider may declare for its operations (see
+// OperationProvider::elementwiseOperation), so that chains of them can be fused. The list is
+// always the last argument; the scalar arguments before it are converted to grades.
+enum class ElementwiseOp : uint8_t {
+    RESOLVE,  // resolve(default list)
+    CLAMP,    // clamp(min max list)
+    RAISE_TO, // maxOf(threshold list)
+    LOWER_TO, // minOf(threshold list)
+    MAP,      // map(srcStart srcEnd dstStart dstEnd list)
+};
+
+// Number of scalar arguments op takes before the list.
+size_t elementwiseParamCount(ElementwiseOp op);
+const char* elementwiseOpName(ElementwiseOp op);
+// Applies op with its scalar arguments to n values in place. The native operations and fused
+// pipelines both run through it, so they round identically.
+void applyElementwise(ElementwiseOp op, const double* params, double* values, size_t n);
+
+// A chain of element-wise operations fused into one pass over a list. Stages run innermost
+// first; the scalar arguments of all stages are passed together, in evaluation order
+// (outermost stage first), and each stage knows where its own start.
+struct ListPipeline {
+    struct Stage {
+        ElementwiseOp op;
+        uint32_t firstParam;
+        // the stage's original call, used when the source turns out not to be a list
+        const OperationCallSite* site;
+    };
+    std::vector<Stage> stages;
+    uint32_t paramCount = 0;
+    // the providers that declared the stages; Contexts with others run the original calls
+    std::vector<OperationProvider*> providers;
+};
+
+// Runs the pipeline over source, consuming it and the paramCount Datums at params. A list is
+// processed block by block, every stage over a block while it is in cache; anything else, or a
+// Context with different operation providers, goes through the stages' call sites one by one,
+// exactly like the unfused calls.
+Datum runListPipeline(const ListPipeline& pipeline, Datum source, Datum* params, Context* ctx);
+// runListPipeline followed by toGrade(), without building the resulting list: the weighted
+// mean is accumulated block by block, bit-identical to ListValue::weightedMean.
+double runListPipelineMean(const ListPipeline& pipeline, Datum source, Datum* params, Context* ctx);
+
+// State of one fusion pass (see Program::fuseListPipelines).
+struct ListFuser {
+    Arena& arena;
+    const std::vector<OperationProvider*>& operations;
+    size_t fused = 0; // operation calls turned into pipeline stages
+    // calls already replaced, so that a node shared by several parents is fused once
+    std::unordered_map<const Expression*, Expression*> replaced;
+    ListFuser(Arena& a, const std::vector<OperationProvider*>& ops) : arena(a), operations(ops) {}
+};
+
+// A fused chain of element-wise calls; replaces the outermost call of the chain. The original
+// calls stay in the arena, and the node keeps using them: for dependencies, linking, symbol
+// binding and as the fallback of the pipeline. Owns its pipeline, so it is created with
+// Arena::makeOwned.
+class FusedListExpr : public Expression {
+private:
+    OperationExpr* original; // outermost call of the chain
+    Expression** params;     // pipeline.paramCount arguments, in evaluation order
+    Expression* source;      // the list argument of the innermost call
+    ListPipeline pipeline;
+    // Evaluates the parameters into values, then the source, which it returns.
+    Datum evaluateArguments(Context* ctx, std::vector<Datum>& values) const;
+public:
+    FusedListExpr(OperationExpr* orig, Expression** prms, Expression* src, ListPipeline pipe)
+        : original(orig), params(prms), source(src), pipeline(std::move(pipe)) {}
+    const ListPipeline& getPipeline() const { return pipeline; }
+    Expression* const* getParams() const { return params; }
+    Expression* getSource() const { return source; }
+    Datum evaluate(Context* ctx) const override;
+    double evaluateGrade(Context* ctx) const override;
+    void collectDependencies(std::vector<std::string_view>& out) const override;
+    void printAST(std::ostream& os, int indent = 0) const override;
+    void compile(BytecodeCompiler& compiler) const override;
+    std::optional<DataType> link(const std::vector<OperationProvider*>& ops) override;
+    Expression* foldConstants(ConstantFolder& folder) override;
+    Expression* internSubexpressions(SubexpressionInterner& interner) override;
+    void bindSymbols(SymbolTable& table) override;
+    Expression* fuseListPipelines(ListFuser& fuser) override;
+};
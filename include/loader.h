@@ -0,0 +1,8 @@
+#pragma once
+#include <string>
+#include "eval.h"
+
+// Loads and parses a program file. Regular files are memory-mapped and parsed straight from
+// the mapping; pipes and other inputs that cannot be mapped are read into memory first.
+// Throws std::runtime_error if the file cannot be read or fails to parse.
+Program* loadProgramFile(const std::string& path);
@@ -5,10 +5,11 @@
 
 // create a new list by dropping the lowest n values from the given list,
 // ignoring undefined values (NaN) and taking weights into account.
-ListValue* drop(size_t n, ListValue* lv);
+// Of equal values the earliest are dropped first; the remaining entries keep their order.
+ListValue* drop(unsigned long long n, ListValue* lv);
 
 // top is like drop, but keeps the highest n values instead of dropping the lowest n.
-ListValue* top(size_t n, ListValue* lv);
+ListValue* top(unsigned long long n, ListValue* lv);
 
 // join creates a new listValue by concatenating the two given listValues.
 // Either argument is deleted after joining.
@@ -39,5 +40,27 @@ double require(double value, double threshold, double reslutAbove);
 // With one argument, the default result above is 1.0
 double require(double value, double threshold);
 
+// Variadic reductions over any mix of grades, integers and lists, registered as sum, avg, min,
+// max and count. Every argument contributes its defined values: a list its entries with their
+// weights, a scalar itself with weight 1. Undefined values are skipped, as by ListValue::toGrade.
+// sum is the weighted sum and avg the weighted mean, so avg of a single list is its toGrade;
+// both are undefined without any weight. min and max ignore weights and are undefined without
+// a defined value; count is the number of defined values.
+Datum reduceSum(std::vector<Datum>& args);
+Datum reduceAvg(std::vector<Datum>& args);
+Datum reduceMin(std::vector<Datum>& args);
+Datum reduceMax(std::vector<Datum>& args);
+Datum reduceCount(std::vector<Datum>& args);
+
+// Lazy operations (see OperationProvider::isLazy): each evaluates only the arguments its result
+// depends on. conditional is registered as if(condition then [else]): then if the condition is
+// nonzero, else if it is zero (undefined without one), and undefined if the condition is.
+// lazyRequire is registered as require, with the results and defaults of the eager overloads
+// above, evaluating only the result it returns. coalesce returns the first argument whose
+// grade is defined, as it is, or an undefined grade if there is none.
+Datum conditional(LazyArguments& args);
+Datum lazyRequire(LazyArguments& args);
+Datum coalesce(LazyArguments& args);
+
 
 BasicOperationProvider* createProvider();
@@ -2,6 +2,10 @@
 #include "tokenizer.h"
 #include "eval.h"
 
-// Parses a program from the given input.
-Program* parseProgram(const std::string& input);
+// Parses a program from the given input. Names are copied into the program's arena, so the
+// input may be released once parsing returns.
+Program* parseProgram(std::string_view input);
 Program* parseProgram(const std::vector<Token>& tokens);
+// Parses one expression spanning the whole input, allocating it in owner's arena. On a parse
+// error, nodes already created stay in the arena until owner is deleted.
+Expression* parseExpression(std::string_view input, Program* owner);
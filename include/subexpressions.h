@@ -0,0 +1,53 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "eval.h"
+
+// Structural ids of expression trees, shared by every program eliminated against the same
+// table. Two subtrees get the same id when they have the same shape: the same operation names,
+// constants, category references and list layout, with children of equal ids. Ids of different
+// tables never collide in a Context, since each table has its own serial.
+class SubexpressionTable {
+private:
+    uint32_t serial;
+    std::unordered_map<std::string, uint32_t> ids; // structural key -> id
+    std::vector<uint32_t> occurrences;             // by id - 1
+public:
+    SubexpressionTable();
+    SubexpressionTable(const SubexpressionTable&) = delete;
+    SubexpressionTable& operator=(const SubexpressionTable&) = delete;
+    // The id of the subtree with this structural key, created on first use; counts one occurrence.
+    uint32_t intern(const std::string& key);
+    uint32_t occurrencesOf(uint32_t id) const { return occurrences[id - 1]; }
+    // The Context memo key of an id; never zero.
+    uint64_t memoKey(uint32_t id) const { return (static_cast<uint64_t>(serial) << 32) | id; }
+    size_t size() const { return occurrences.size(); }
+};
+
+// State of one elimination pass over a program (see eliminateCommonSubexpressions).
+struct SubexpressionInterner {
+    SubexpressionTable& table;
+    const std::vector<OperationProvider*>& operations;
+    std::unordered_map<uint32_t, Expression*> canonical; // first node of each id in this program
+    std::vector<Expression*> memoizable;                  // canonical operation and list nodes
+    size_t shared = 0;                                    // subtrees replaced by an earlier copy
+    SubexpressionInterner(SubexpressionTable& t, const std::vector<OperationProvider*>& ops) : table(t), operations(ops) {}
+    // Returns the program's node for the structure key, registering node if it is the first.
+    Expression* intern(const std::string& key, Expression* node, bool memoize);
+};
+
+// Appends the id of an interned child to a structural key; 0 stands for "not shareable".
+void appendSubexpressionId(std::string& key, uint32_t id);
+
+// Hash-conses the expression trees of the given programs, run after Program::foldConstants and
+// before Program::link. Identical subtrees within a program become one shared node. Operation
+// and list nodes whose structure occurs more than once, in these programs or in any program
+// eliminated against the table before, are memoized: they are evaluated once per Context, by
+// the tree walker and by bytecode compiled afterwards. Programs eliminated together share all
+// of their repeats; a program eliminated later shares with earlier ones only from its own side,
+// so such a subtree is evaluated at most twice. Calls to operations that are not pure (see
+// OperationProvider::isPure) are never shared. Returns the number of replaced subtrees.
+size_t eliminateCommonSubexpressions(const std::vector<Program*>& programs, SubexpressionTable& table,
+                                     const std::vector<OperationProvider*>& ops);
@@ -0,0 +1,28 @@
+#pragma once
+#include <cstdint>
+#include <deque>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+// Dense ids of category names, shared by every program bound to the same table (see
+// Program::bindSymbols) and by the Contexts evaluating them (see Context::setSymbolTable).
+// Ids count up from 0 in first-use order. A table only grows; it must not change while a
+// Context using it evaluates.
+class SymbolTable {
+private:
+    std::deque<std::string> names; // by id; a deque, so the names never move
+    std::unordered_map<std::string_view, uint32_t> ids;
+public:
+    static constexpr uint32_t NO_SYMBOL = UINT32_MAX;
+
+    SymbolTable() = default;
+    SymbolTable(const SymbolTable&) = delete;
+    SymbolTable& operator=(const SymbolTable&) = delete;
+    // The id of name, created on first use.
+    uint32_t intern(std::string_view name);
+    std::optional<uint32_t> find(std::string_view name) const;
+    const std::string& name(uint32_t id) const { return names[id]; }
+    size_t size() const { return names.size(); }
+};
@@ -0,0 +1,48 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads with one task deque each. A worker pops its own newest task
+// first and, when it runs dry, steals the oldest task of another queue. Tasks submitted from
+// a worker go to that worker's deque; tasks from other threads are spread round-robin.
+// Tasks must not block waiting for other tasks of the same pool.
+class WorkStealingPool {
+public:
+    using Task = std::function<void()>;
+private:
+    struct Queue {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+    std::vector<std::unique_ptr<Queue>> queues;
+    std::vector<std::thread> workers;
+    std::atomic<size_t> queued;
+    std::atomic<size_t> nextQueue;
+    std::atomic<unsigned> waiters;
+    bool stopping = false;
+    std::mutex sleepMutex;
+    std::condition_variable workAvailable;
+    std::condition_variable taskFinished;
+
+    bool runOne(size_t home);
+    void workerLoop(size_t index);
+public:
+    // threads == 0 selects the hardware concurrency
+    explicit WorkStealingPool(unsigned threads = 0);
+    WorkStealingPool(const WorkStealingPool&) = delete;
+    WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+    // Finishes the queued tasks, then joins the workers.
+    ~WorkStealingPool();
+
+    unsigned size() const { return static_cast<unsigned>(workers.size()); }
+    void submit(Task task);
+    // Runs queued tasks on the calling thread as well until done() holds. done is
+    // re-checked whenever a task finishes.
+    void helpUntil(const std::function<bool()>& done);
+};
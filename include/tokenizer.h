@@ -1,5 +1,6 @@
 #pragma once
 #include <string>
+#include <string_view>
 #include <vector>
 #include <cstddef>
 
@@ -17,17 +18,32 @@ enum class TokenT {
     UNKNOWN
 };
 
+// Tokens borrow their text from the tokenized input, which must outlive them.
+// PERCENT text includes the trailing '%'.
 struct Token {
     TokenT type;
-    std::string text;
+    std::string_view text;
     size_t position;
     
-    Token(TokenT t, const std::string& txt, size_t pos)
+    Token(TokenT t, std::string_view txt, size_t pos)
         : type(t), text(txt), position(pos) {}
 };
 
-// Tokenize input into a stream of Token objects.
-std::vector<Token> tokenize(const std::string& input);
+// Incremental tokenizer: produces one token per call to next(), so large inputs can be
+// parsed without materializing the token stream. After END_OF_FILE it keeps returning END_OF_FILE.
+class Lexer {
+private:
+    std::string_view input;
+    size_t pos;
+
+    Token scanFraction(size_t tokenStart);
+public:
+    Lexer(std::string_view in) : input(in), pos(0) {}
+    Token next();
+};
+
+// Tokenize input into a stream of Token objects. The last token is always END_OF_FILE.
+std::vector<Token> tokenize(std::string_view input);
 
 // comments are c-style: // to end of line, /* to */
-size_t _consumeWhitespace(const std::string& input, size_t startPos);
+size_t _consumeWhitespace(std::string_view input, size_t startPos);
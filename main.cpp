@@ -1,5 +1,4 @@
 #include <iostream>
-#include <fstream>
 #include <sstream>
 #include <string>
 #include <vector>
@@ -9,6 +8,11 @@
 #include "eval.h"
 #include "parser.h"
 #include "operations.h"
+#include "bytecode.h"
+#include "loader.h"
+#include "thread_pool.h"
+#include "subexpressions.h"
+#include "symbol_table.h"
 
 static std::string fmtPercent(double v) {
     if (std::isnan(v)) return std::string("undef");
@@ -63,49 +67,66 @@ static std::string trim(const std::string& s) {
     return s.substr(a, b - a + 1);
 }
 
-// Helper to load a program file into the context; returns true on success.
-static bool loadProgramFromFile(Context& ctx, const std::string& path) {
-    std::ifstream in(path);
-    if (!in) {
-        std::cerr << "Failed to open file: " << path << "\n";
-        return false;
-    }
-    std::stringstream ss;
-    ss << in.rdbuf();
-    Program* prog = nullptr;
+// Helper to load and parse a program file; returns nullptr (after reporting why) on failure.
+static Program* loadProgramFromFile(const std::string& path) {
     try {
-        prog = parseProgram(ss.str());
-        if (!prog) {
-            std::cerr << "Failed to parse program file: " << path << "\n";
-            delete prog;
-            return false;
-        }
-        ctx.dataProviders.push_back(prog);
+        Program* prog = loadProgramFile(path);
         std::cout << "Loaded program: " << path << "\n";
-        return true;
+        return prog;
     } catch (const std::exception& ex) {
-        std::cerr << "Parse error in " << path << ": " << ex.what() << "\n";
+        std::cerr << "Failed to load " << path << ": " << ex.what() << "\n";
+        return nullptr;
+    }
+}
+
+// Folds constants, shares common subexpressions with everything installed before, fuses list
+// pipelines, binds category names and operation calls and adds the programs to the context as
+// bytecode; the ASTs are deleted.
+static void installPrograms(Context& ctx, SubexpressionTable& subexpressions, SymbolTable& symbols,
+                            const std::vector<Program*>& programs) {
+    for (Program* prog : programs) prog->foldConstants(ctx.operationProviders);
+    eliminateCommonSubexpressions(programs, subexpressions, ctx.operationProviders);
+    for (Program* prog : programs) {
+        prog->fuseListPipelines(ctx.operationProviders);
+        prog->bindSymbols(symbols);
+        prog->link(ctx.operationProviders);
+        ctx.dataProviders.push_back(compileProgram(*prog));
         delete prog;
-        return false;
     }
 }
 
 int main(int argc, char** argv) {
-    if (argc < 2) {
-        std::cerr << "Usage: " << (argc > 0 ? argv[0] : "repl") << " <program-file> [additional-program-file ...]\n";
+    // -j <threads>: evaluate independent categories concurrently
+    unsigned threads = 1;
+    int firstFile = 1;
+    if (argc > 2 && std::string(argv[1]) == "-j") {
+        threads = static_cast<unsigned>(std::stoul(argv[2]));
+        firstFile = 3;
+    }
+    if (argc <= firstFile) {
+        std::cerr << "Usage: " << (argc > 0 ? argv[0] : "repl") << " [-j <threads>] <program-file> [additional-program-file ...]\n";
         return 1;
     }
 
     Context ctx;
+    WorkStealingPool* pool = threads != 1 ? new WorkStealingPool(threads) : nullptr;
 
     // register built-in operations provider
     OperationProvider* ops = createProvider();
     if (ops) ctx.operationProviders.push_back(ops);
 
-    // Load all provided program files (argv[1] .. argv[argc-1])
-    for (int i = 1; i < argc; ++i) {
-        loadProgramFromFile(ctx, argv[i]);
+    // Load all provided program files (argv[firstFile] .. argv[argc-1]); they are optimized
+    // together, so subexpressions repeated across files are evaluated once
+    SubexpressionTable subexpressions;
+    SymbolTable symbols;
+    std::vector<Program*> programs;
+    for (int i = firstFile; i < argc; ++i) {
+        Program* prog = loadProgramFromFile(argv[i]);
+        if (prog) programs.push_back(prog);
     }
+    installPrograms(ctx, subexpressions, symbols, programs);
+    // names first seen in files included later are cached by name
+    ctx.setSymbolTable(&symbols);
 
     std::cout << "GradeLang REPL. Outputs formatted as percentages. Type 'quit' or 'q' to exit.\n";
     std::string line;
@@ -137,7 +158,8 @@ int main(int argc, char** argv) {
                 if (rest.empty()) {
                     std::cerr << "Usage: include <file-path>\n";
                 } else {
-                    loadProgramFromFile(ctx, rest);
+                    Program* prog = loadProgramFromFile(rest);
+                    if (prog) installPrograms(ctx, subexpressions, symbols, { prog });
                 }
                 continue;
             }
@@ -145,7 +167,7 @@ int main(int argc, char** argv) {
         if (key.rfind("get ", 0) == 0) key = trim(key.substr(4));
 
         try {
-            Value* v = ctx.getCategoryValue(key);
+            Value* v = pool ? ctx.evaluateParallel({ key }, *pool)[0] : ctx.getCategoryValue(key);
             printValueAsPercent(v);
         } catch (const std::exception& ex) {
             std::cerr << "Error: " << ex.what() << "\n";
@@ -153,6 +175,7 @@ int main(int argc, char** argv) {
     }
 
     // cleanup
+    delete pool;
     for (OperationProvider* p : ctx.operationProviders) delete p;
     ctx.operationProviders.clear();
     for (DataProvider* dp : ctx.dataProviders) delete dp;
@@ -1,39 +1,88 @@
 #include <iostream>
-#include <fstream>
-#include <sstream>
 #include <string>
-#include "parser.h"
+#include "loader.h"
+#include "dependency_graph.h"
 #include "eval.h"
+#include "bytecode.h"
+#include "operations.h"
+#include "subexpressions.h"
 
 int main(int argc, char** argv) {
-    if (argc != 2) {
-        std::cerr << "Usage: print_ast <source-file>\n";
+    std::string mode = argc == 3 ? argv[1] : "";
+    if ((argc != 2 && argc != 3) || (argc == 3 && mode != "--bytecode" && mode != "--deps" && mode != "--fold")) {
+        std::cerr << "Usage: print_ast [--bytecode | --deps | --fold] <source-file>\n";
         return 1;
     }
-    const char* path = argv[1];
-    std::ifstream in(path);
-    if (!in) {
-        std::cerr << "Failed to open file: " << path << "\n";
-        return 1;
-    }
-    std::stringstream ss;
-    ss << in.rdbuf();
+    const char* path = argv[argc - 1];
     Program* prog = nullptr;
     try {
-        prog = parseProgram(ss.str());
-        if (!prog) {
-            std::cerr << "Failed to parse program.\n";
-            return 1;
-        }
+        prog = loadProgramFile(path);
     } catch (const std::exception& ex) {
-        std::cerr << "Parse error: " << ex.what() << "\n";
-        delete prog;
+        std::cerr << "Failed to load " << path << ": " << ex.what() << "\n";
         return 1;
     }
 
+    if (mode == "--deps") {
+        // categories in evaluation order, each with what it references
+        const DependencyGraph& graph = *prog->dependencyGraph();
+        std::cout << "Dependencies for " << path << ":\n";
+        for (uint32_t i : graph.topologicalOrder()) {
+            std::cout << graph.name(i) << ":";
+            for (uint32_t dep : graph.dependencies(i)) std::cout << " " << graph.name(dep);
+            std::cout << "\n";
+        }
+        if (!graph.externalNames().empty()) {
+            std::cout << "External:";
+            for (const std::string& name : graph.externalNames()) std::cout << " " << name;
+            std::cout << "\n";
+        }
+        int status = 0;
+        if (graph.hasCycle()) {
+            std::cout << "Circular dependency:";
+            for (size_t k = 0; k < graph.cycle().size(); ++k) {
+                std::cout << (k ? " -> " : " ") << graph.name(graph.cycle()[k]);
+            }
+            std::cout << "\n";
+            status = 1;
+        }
+        delete prog;
+        return status;
+    }
+
+    if (mode == "--bytecode") {
+        // fold and link against the built-in operations so statically bound calls are marked
+        OperationProvider* ops = createProvider();
+        SubexpressionTable subexpressions;
+        prog->foldConstants({ ops });
+        eliminateCommonSubexpressions({ prog }, subexpressions, { ops });
+        prog->fuseListPipelines({ ops });
+        prog->link({ ops });
+        CompiledProgram* compiled = compileProgram(*prog);
+        std::cout << "Bytecode for " << path << ":\n";
+        compiled->disassemble(std::cout);
+        delete compiled;
+        delete prog;
+        delete ops;
+        return 0;
+    }
+
+    // --fold: the AST after constant folding, common-subexpression elimination and list pipeline
+    // fusion against the built-in operations; shared nodes are marked and printed at every use
+    OperationProvider* ops = nullptr;
+    if (mode == "--fold") {
+        ops = createProvider();
+        size_t folded = prog->foldConstants({ ops });
+        std::cout << "Folded " << folded << " constant expression" << (folded == 1 ? "" : "s") << "\n";
+        SubexpressionTable subexpressions;
+        size_t shared = eliminateCommonSubexpressions({ prog }, subexpressions, { ops });
+        std::cout << "Shared " << shared << " repeated subexpression" << (shared == 1 ? "" : "s") << "\n";
+        size_t fused = prog->fuseListPipelines({ ops });
+        std::cout << "Fused " << fused << " list operation" << (fused == 1 ? "" : "s") << "\n";
+    }
+
     std::cout << "AST for " << path << ":\n";
     for (const auto& kv : prog->categories) {
-        const std::string& name = kv.first;
+        std::string name(kv.first);
         Expression* expr = kv.second;
         std::cout << "Category: " << name << "\n";
         if (expr) expr->printAST(std::cout, 2);
@@ -41,5 +90,6 @@ int main(int argc, char** argv) {
     }
 
     delete prog;
+    delete ops;
     return 0;
 }
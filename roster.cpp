@@ -0,0 +1,173 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include "eval.h"
+#include "loader.h"
+#include "operations.h"
+#include "batch.h"
+#include "subexpressions.h"
+#include "symbol_table.h"
+#include "bytecode.h"
+
+static void printUsage(const char* argv0) {
+    std::cerr << "Usage: " << argv0 << " [options] <roster.csv|-> <program-file> [additional-program-file ...]\n"
+              << "Options:\n"
+              << "  -j <threads>          Number of worker threads (default: all cores)\n"
+              << "  -o <file>             Write results to file instead of stdout\n"
+              << "  --targets <a,b,...>   Categories to output; only what they depend on is evaluated\n"
+              << "                        (default: all program categories)\n"
+              << "  --stats               Report the categories computed once for all students on stderr\n";
+}
+
+// Loads a program file; returns nullptr (after reporting) on failure.
+static Program* loadProgramFromFile(const std::string& path) {
+    try {
+        return loadProgramFile(path);
+    } catch (const std::exception& ex) {
+        std::cerr << "Failed to load " << path << ": " << ex.what() << "\n";
+        return nullptr;
+    }
+}
+
+static std::vector<std::string> splitTargets(const std::string& list) {
+    std::vector<std::string> out;
+    std::stringstream ss(list);
+    std::string item;
+    while (std::getline(ss, item, ',')) {
+        if (!item.empty()) out.push_back(item);
+    }
+    return out;
+}
+
+int main(int argc, char** argv) {
+    unsigned threads = 0;
+    std::string outPath;
+    std::vector<std::string> targets;
+    std::vector<std::string> positional;
+    bool printStats = false;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if ((arg == "-j" || arg == "-o" || arg == "--targets") && i + 1 >= argc) {
+            printUsage(argv[0]);
+            return 1;
+        }
+        if (arg == "-j") {
+            threads = static_cast<unsigned>(std::stoul(argv[++i]));
+        } else if (arg == "-o") {
+            outPath = argv[++i];
+        } else if (arg == "--targets") {
+            targets = splitTargets(argv[++i]);
+        } else if (arg == "--stats") {
+            printStats = true;
+        } else if (arg == "-h" || arg == "--help") {
+            printUsage(argv[0]);
+            return 0;
+        } else {
+            positional.push_back(arg);
+        }
+    }
+    if (positional.size() < 2) {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    OperationProvider* ops = createProvider();
+    std::vector<DataProvider*> programs;
+    std::vector<std::string> defined;
+    bool ok = true;
+    std::vector<Program*> parsed;
+    SymbolTable symbols;
+    for (size_t i = 1; i < positional.size(); ++i) {
+        Program* prog = loadProgramFromFile(positional[i]);
+        if (!prog) {
+            ok = false;
+            break;
+        }
+        parsed.push_back(prog);
+        for (const auto& kv : prog->categories) defined.emplace_back(kv.first);
+    }
+    if (ok) {
+        // the programs are optimized together, so subexpressions shared between files are
+        // evaluated once per student
+        SubexpressionTable subexpressions;
+        for (Program* prog : parsed) prog->foldConstants({ ops });
+        eliminateCommonSubexpressions(parsed, subexpressions, { ops });
+        for (Program* prog : parsed) {
+            prog->fuseListPipelines({ ops });
+            prog->bindSymbols(symbols);
+            prog->link({ ops });
+            programs.push_back(compileProgram(*prog));
+        }
+    }
+    for (Program* prog : parsed) delete prog;
+
+    Roster* roster = nullptr;
+    if (ok) {
+        try {
+            if (positional[0] == "-") {
+                roster = parseRoster(std::cin);
+            } else {
+                std::ifstream in(positional[0]);
+                if (!in) throw std::runtime_error("Failed to open file: " + positional[0]);
+                roster = parseRoster(in);
+            }
+        } catch (const std::exception& ex) {
+            std::cerr << ex.what() << "\n";
+            ok = false;
+        }
+    }
+    if (roster) {
+        // rows are looked up by symbol too, so no category is resolved by name per student
+        for (RosterRow& row : roster->rows) row.inputs->bindSymbols(symbols);
+    }
+
+    if (ok) {
+        if (targets.empty()) {
+            std::sort(defined.begin(), defined.end());
+            defined.erase(std::unique(defined.begin(), defined.end()), defined.end());
+            targets = defined;
+        }
+
+        BatchEvaluator evaluator(programs, { ops }, &symbols);
+        BatchStats stats;
+        std::vector<BatchRow> results = evaluator.run(*roster, targets, threads, &stats);
+        if (printStats) {
+            std::cerr << "Invariant categories: " << stats.invariantCategories << " (computed once)\n"
+                      << "Per-student categories: " << stats.perStudentCategories << "\n"
+                      << "Shared reads: " << stats.sharedReads << ", evaluations saved: "
+                      << stats.savedEvaluations(roster->rows.size()) << "\n";
+        }
+
+        std::ofstream outFile;
+        if (!outPath.empty()) {
+            outFile.open(outPath);
+            if (!outFile) {
+                std::cerr << "Failed to open output file: " << outPath << "\n";
+                ok = false;
+            }
+        }
+        if (ok) {
+            std::ostream& out = outPath.empty() ? std::cout : outFile;
+            out << "id";
+            for (const auto& t : targets) out << "," << t;
+            out << "\n";
+            for (size_t r = 0; r < results.size(); ++r) {
+                out << roster->rows[r].studentId;
+                for (const auto& cell : results[r].cells) out << "," << cell;
+                out << "\n";
+                if (!results[r].error.empty()) {
+                    std::cerr << "Error for " << roster->rows[r].studentId << ": " << results[r].error << "\n";
+                }
+            }
+        }
+    }
+
+    // cleanup
+    delete roster;
+    for (DataProvider* dp : programs) delete dp;
+    delete ops;
+    return ok ? 0 : 1;
+}
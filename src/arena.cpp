@@ -0,0 +1,38 @@
+#include "arena.h"
+#include <algorithm>
+#include <cstdlib>
+
+// blocks grow geometrically up to this size; reserve() may allocate larger ones
+static const size_t MAX_BLOCK_SIZE = 1024 * 1024;
+
+Arena::~Arena() {
+    for (Finalizer* f = finalizers; f; f = f->next) {
+        f->destroy(f->object);
+    }
+    while (blocks) {
+        Block* next = blocks->next;
+        std::free(blocks);
+        blocks = next;
+    }
+}
+
+void Arena::reserve(size_t bytes) {
+    if (cursor && static_cast<size_t>(limit - cursor) >= bytes) return;
+    size_t saved = nextBlockSize;
+    nextBlockSize = std::max(nextBlockSize, bytes);
+    allocateSlow(0, 1);
+    nextBlockSize = saved;
+}
+
+void* Arena::allocateSlow(size_t size, size_t align) {
+    size_t capacity = std::max(nextBlockSize, size + align);
+    Block* block = static_cast<Block*>(std::malloc(sizeof(Block) + capacity));
+    if (!block) throw std::bad_alloc();
+    block->next = blocks;
+    block->capacity = capacity;
+    blocks = block;
+    cursor = reinterpret_cast<char*>(block + 1);
+    limit = cursor + capacity;
+    if (nextBlockSize < MAX_BLOCK_SIZE) nextBlockSize *= 2;
+    return allocate(size, align);
+}
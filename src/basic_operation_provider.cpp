@@ -1,32 +1,168 @@
 #include "basic_operation_provider.h"
 #include <stdexcept>
 
+// Overload sets up to this arity get a full dispatch table (3^arity entries); larger ones are
+// scanned in registration order.
+static const size_t MAX_RANKED_ARITY = 6;
+static const size_t NUM_DATA_TYPES = 3;
+
+static uint64_t overloadKey(uint32_t nameId, size_t arity) {
+    return (static_cast<uint64_t>(nameId) << 32) | static_cast<uint64_t>(arity);
+}
+
+static size_t tupleIndex(const std::vector<DataType>& types) {
+    size_t idx = 0;
+    for (DataType t : types) {
+        idx = idx * NUM_DATA_TYPES + static_cast<size_t>(t);
+    }
+    return idx;
+}
+
 // hasOperation implementation
 bool BasicOperationProvider::hasOperation(const std::string& operationName) const {
-    for (const auto& op : operations) {
-        if (op.first.name == operationName) {
-            return true;
+    return nameIds.count(operationName) != 0 || lazyOperations.count(operationName) != 0;
+}
+
+const std::pair<OperationSignature, OperationFn>* BasicOperationProvider::findOverload(const std::string& operationName, const std::vector<DataType>& argTypes) const {
+    auto nameIt = nameIds.find(operationName);
+    if (nameIt == nameIds.end()) return nullptr;
+    auto setIt = overloadSets.find(overloadKey(nameIt->second, argTypes.size()));
+    if (setIt != overloadSets.end()) {
+        const OverloadSet& set = setIt->second;
+        if (!set.dispatch.empty()) {
+            int32_t winner = set.dispatch[tupleIndex(argTypes)];
+            if (winner >= 0) return &operations[static_cast<size_t>(winner)];
+        } else {
+            for (size_t idx : set.overloads) {
+                if (operations[idx].first.matches(operationName, argTypes)) {
+                    return &operations[idx];
+                }
+            }
+        }
+    }
+    auto variadicIt = variadicOverloads.find(nameIt->second);
+    if (variadicIt == variadicOverloads.end()) return nullptr;
+    for (size_t idx : variadicIt->second) {
+        if (operations[idx].first.matches(operationName, argTypes)) {
+            return &operations[idx];
         }
     }
-    return false;
+    return nullptr;
 }
 
 // executeOperation implementation
-Value* BasicOperationProvider::executeOperation(const std::string& operationName, std::vector<Value*>& arguments) const {
+Datum BasicOperationProvider::executeOperation(const std::string& operationName, std::vector<Datum>& arguments) const {
+    if (lazyOperations.count(operationName)) {
+        EvaluatedArguments evaluated(arguments);
+        return executeLazyOperation(operationName, evaluated);
+    }
     std::vector<DataType> argTypes;
     argTypes.reserve(arguments.size());
-    for (Value* arg : arguments) {
-        argTypes.push_back(arg ? arg->getType() : DataType::TYPE_GRADE);
+    for (const Datum& arg : arguments) {
+        argTypes.push_back(arg.getType());
+    }
+    const auto* op = findOverload(operationName, argTypes);
+    if (!op) {
+        throw std::invalid_argument("Operation not found: " + operationName);
+    }
+    return op->second(arguments);
+}
+
+// resolveOperation implementation: the first registered overload that accepts the types wins,
+// matching executeOperation.
+ResolvedOperation BasicOperationProvider::resolveOperation(const std::string& operationName, const std::vector<DataType>& argTypes) const {
+    ResolvedOperation resolved;
+    const auto* op = findOverload(operationName, argTypes);
+    if (op) {
+        resolved.fn = &op->second;
+        resolved.returnType = op->first.returnType;
+    }
+    return resolved;
+}
+
+bool BasicOperationProvider::isPure(const std::string& operationName) const {
+    return pureOperations.count(operationName) != 0 && hasOperation(operationName);
+}
+
+void BasicOperationProvider::declarePure(const std::string& operationName) {
+    pureOperations.insert(operationName);
+}
+
+std::optional<ElementwiseOp> BasicOperationProvider::elementwiseOperation(const std::string& operationName) const {
+    auto it = elementwise.find(operationName);
+    if (it == elementwise.end()) return std::nullopt;
+    return it->second;
+}
+
+void BasicOperationProvider::declareElementwise(const std::string& operationName, ElementwiseOp op) {
+    elementwise[operationName] = op;
+}
+
+bool BasicOperationProvider::isLazy(const std::string& operationName) const {
+    return lazyOperations.count(operationName) != 0;
+}
+
+Datum BasicOperationProvider::executeLazyOperation(const std::string& operationName, LazyArguments& arguments) const {
+    auto it = lazyOperations.find(operationName);
+    if (it == lazyOperations.end()) return OperationProvider::executeLazyOperation(operationName, arguments);
+    const LazyOperation& op = it->second;
+    if (arguments.size() < op.minArgs || arguments.size() > op.maxArgs) {
+        throw std::invalid_argument("Operation not found: " + operationName);
     }
-    for (const auto& op : operations) {
-        if (op.first.matches(operationName, argTypes)) {
-            return op.second(arguments);
+    return op.fn(arguments);
+}
+
+void BasicOperationProvider::registerLazyOperation(const std::string& name, size_t minArgs, size_t maxArgs, LazyOperationFn func) {
+    if (hasOperation(name)) {
+        throw std::invalid_argument("Operation already registered: " + name);
+    }
+    lazyOperations.emplace(name, LazyOperation{minArgs, maxArgs, std::move(func)});
+}
+
+// Recomputes the dispatch table of one overload set.
+void BasicOperationProvider::rankOverloads(OverloadSet& set) const {
+    size_t arity = operations[set.overloads.front()].first.argumentTypes.size();
+    set.dispatch.clear();
+    if (arity > MAX_RANKED_ARITY) return;
+    size_t tuples = 1;
+    for (size_t i = 0; i < arity; ++i) tuples *= NUM_DATA_TYPES;
+    set.dispatch.assign(tuples, -1);
+    std::vector<DataType> types(arity);
+    for (size_t t = 0; t < tuples; ++t) {
+        size_t rest = t;
+        for (size_t i = arity; i-- > 0;) {
+            types[i] = static_cast<DataType>(rest % NUM_DATA_TYPES);
+            rest /= NUM_DATA_TYPES;
+        }
+        for (size_t idx : set.overloads) {
+            const OperationSignature& sig = operations[idx].first;
+            if (sig.matches(sig.name, types)) {
+                set.dispatch[t] = static_cast<int32_t>(idx);
+                break;
+            }
         }
     }
-    throw std::invalid_argument("Operation not found: " + operationName);
 }
 
 // registerOperation(OperationSignature, func) implementation
-void BasicOperationProvider::registerOperation(OperationSignature sig, std::function<Value*(std::vector<Value*>&)> func) {
+void BasicOperationProvider::registerOperation(OperationSignature sig, OperationFn func) {
+    if (sig.variadic && sig.argumentTypes.empty()) {
+        throw std::invalid_argument("Variadic operation needs an argument type: " + sig.name);
+    }
+    if (lazyOperations.count(sig.name)) {
+        throw std::invalid_argument("Operation already registered: " + sig.name);
+    }
+    auto nameIt = nameIds.find(sig.name);
+    if (nameIt == nameIds.end()) {
+        nameIt = nameIds.emplace(sig.name, static_cast<uint32_t>(nameIds.size())).first;
+    }
+    if (sig.variadic) {
+        operations.emplace_back(std::move(sig), std::move(func));
+        variadicOverloads[nameIt->second].push_back(operations.size() - 1);
+        return;
+    }
+    OverloadSet& set = overloadSets[overloadKey(nameIt->second, sig.argumentTypes.size())];
     operations.emplace_back(std::move(sig), std::move(func));
+    set.overloads.push_back(operations.size() - 1);
+    rankOverloads(set);
 }
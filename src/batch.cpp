@@ -0,0 +1,297 @@
+#include "batch.h"
+#include "dependency_graph.h"
+#include "eval_plan.h"
+#include "parser.h"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+
+// rows are handed to workers in chunks to keep contention on the row counter low
+static const size_t ROWS_PER_CHUNK = 16;
+// a row arena holds a few cell expressions; it grows if a row needs more
+static const size_t ROW_ARENA_BLOCK_SIZE = 256;
+
+Roster::~Roster() {
+    for (auto& row : rows) {
+        delete row.inputs;
+    }
+    rows.clear();
+}
+
+static std::string trimCell(const std::string& s) {
+    size_t a = s.find_first_not_of(" \t\r\n");
+    if (a == std::string::npos) return "";
+    size_t b = s.find_last_not_of(" \t\r\n");
+    return s.substr(a, b - a + 1);
+}
+
+static std::vector<std::string> splitCsvLine(const std::string& line) {
+    std::vector<std::string> fields;
+    size_t start = 0;
+    while (true) {
+        size_t comma = line.find(',', start);
+        if (comma == std::string::npos) {
+            fields.push_back(trimCell(line.substr(start)));
+            break;
+        }
+        fields.push_back(trimCell(line.substr(start, comma - start)));
+        start = comma + 1;
+    }
+    return fields;
+}
+
+Roster* parseRoster(std::istream& in) {
+    Roster* roster = new Roster();
+    try {
+        std::string line;
+        size_t lineNo = 0;
+        bool haveHeader = false;
+        while (std::getline(in, line)) {
+            ++lineNo;
+            if (trimCell(line).empty()) continue;
+            std::vector<std::string> fields = splitCsvLine(line);
+            if (!haveHeader) {
+                if (fields.size() < 2) {
+                    throw std::runtime_error("Roster line " + std::to_string(lineNo) + ": header needs an id column and at least one category");
+                }
+                roster->columns.assign(fields.begin() + 1, fields.end());
+                haveHeader = true;
+                continue;
+            }
+            if (fields.size() != roster->columns.size() + 1) {
+                throw std::runtime_error("Roster line " + std::to_string(lineNo) + ": expected " +
+                    std::to_string(roster->columns.size() + 1) + " fields, found " + std::to_string(fields.size()));
+            }
+            RosterRow row{fields[0], new Program(ROW_ARENA_BLOCK_SIZE)};
+            roster->rows.push_back(row);
+            for (size_t c = 0; c < roster->columns.size(); ++c) {
+                const std::string& cell = fields[c + 1];
+                if (cell.empty()) continue;
+                const std::string& column = roster->columns[c];
+                // the cell is parsed straight into the row program's arena
+                Expression* expr = nullptr;
+                try {
+                    expr = parseExpression(cell, row.inputs);
+                } catch (const std::exception& ex) {
+                    throw std::runtime_error("Roster line " + std::to_string(lineNo) + ", column " + column + ": " + ex.what());
+                }
+                row.inputs->setCategory(column, expr);
+            }
+            // built up front so concurrent readers never build it lazily
+            row.inputs->dependencyGraph();
+        }
+        if (!haveHeader) {
+            throw std::runtime_error("Roster is empty");
+        }
+    } catch (...) {
+        delete roster;
+        throw;
+    }
+    return roster;
+}
+
+static void formatNumber(std::ostream& os, double d) {
+    if (std::isnan(d)) os << "undef";
+    else os << d;
+}
+
+std::string formatBatchValue(const Value* v) {
+    if (!v) return "undef";
+    std::ostringstream os;
+    switch (v->getType()) {
+        case DataType::TYPE_GRADE:
+            formatNumber(os, static_cast<const GradeValue*>(v)->getVal());
+            break;
+        case DataType::TYPE_INTEGER:
+            os << static_cast<const IntegerValue*>(v)->getVal();
+            break;
+        case DataType::TYPE_LIST: {
+            const ListValue* lv = static_cast<const ListValue*>(v);
+            os << "{";
+            for (size_t i = 0; i < lv->size(); ++i) {
+                if (i) os << " ";
+                formatNumber(os, lv->getValueAt(i));
+                if (lv->getWeightAt(i) != 1.0) {
+                    os << ":";
+                    formatNumber(os, lv->getWeightAt(i));
+                }
+            }
+            os << "}";
+            break;
+        }
+    }
+    return os.str();
+}
+
+// What the roster store returned for one student, answered from memory in the row Context. The
+// graph lists every name requested, so the row's plan treats all of them as overridable.
+class StoredInputs : public DataProvider {
+private:
+    const DependencyGraph* graph;
+    std::vector<Value*> values; // by graph index, owned; nullptr where the store has none
+public:
+    StoredInputs(const DependencyGraph* graph, std::vector<Value*> values) : graph(graph), values(std::move(values)) {}
+    StoredInputs(const StoredInputs&) = delete;
+    StoredInputs& operator=(const StoredInputs&) = delete;
+    ~StoredInputs() override {
+        for (Value* value : values) delete value;
+    }
+    Value* getCategoryValue(const std::string& categoryName, Context* ctx) override {
+        auto index = graph->indexOf(categoryName);
+        return index ? getCategoryValueAt(*index, ctx) : nullptr;
+    }
+    Value* getCategoryValueAt(uint32_t index, Context* /*ctx*/) override {
+        return index < values.size() && values[index] ? values[index]->copy() : nullptr;
+    }
+    const DependencyGraph* dependencyGraph() const override { return graph; }
+};
+
+BatchEvaluator::BatchEvaluator(const std::vector<DataProvider*>& programs, const std::vector<OperationProvider*>& operations,
+                               const SymbolTable* symbols, RosterStore* store)
+    : programs(programs), operations(operations), symbols(symbols), store(store) {}
+
+std::vector<BatchRow> BatchEvaluator::run(const Roster& roster, const std::vector<std::string>& targets, unsigned threads,
+                                          BatchStats* stats) const {
+    std::vector<BatchRow> results(roster.rows.size());
+    if (threads == 0) {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    size_t chunks = (roster.rows.size() + ROWS_PER_CHUNK - 1) / ROWS_PER_CHUNK;
+    threads = static_cast<unsigned>(std::min<size_t>(threads, std::max<size_t>(chunks, 1)));
+
+    // one plan for every row, so each row computes only what the targets reach; it needs the
+    // dependency graphs of all programs, otherwise targets are looked up one by one
+    std::unique_ptr<EvalPlan> plan;
+    if (std::all_of(programs.begin(), programs.end(), [](DataProvider* dp) { return !dp || dp->dependencyGraph(); })) {
+        plan.reset(new EvalPlan(programs, targets, symbols));
+    } else if (store) {
+        throw std::invalid_argument("A roster store needs the dependency graphs of all programs");
+    }
+
+    // the leaves the store is asked for: a student's values may replace any of them
+    std::vector<std::string> storeNames;
+    std::unique_ptr<DependencyGraph> storeGraph;
+    if (store) {
+        storeNames = plan->inputs();
+        for (uint32_t slot = 0; slot < plan->size(); ++slot) {
+            if (plan->dependencies(slot).empty()) storeNames.push_back(plan->steps()[slot].name);
+        }
+        std::vector<std::string_view> names(storeNames.begin(), storeNames.end());
+        storeGraph.reset(new DependencyGraph(std::move(names), [](std::string_view, std::vector<std::string_view>&) {}));
+    }
+
+    // the categories no roster column reaches are computed once, in a Context without row inputs;
+    // one that fails is left to the rows, which report the error
+    BatchStats counts;
+    SharedValues invariant(symbols);
+    if (plan && !roster.rows.empty()) {
+        std::vector<std::string> perStudentInputs = roster.columns;
+        perStudentInputs.insert(perStudentInputs.end(), storeNames.begin(), storeNames.end());
+        std::vector<char> perStudent = plan->dependentsOf(perStudentInputs);
+        Context course;
+        course.setSymbolTable(symbols);
+        course.dataProviders = programs;
+        course.operationProviders = operations;
+        for (uint32_t slot = 0; slot < plan->size(); ++slot) {
+            if (perStudent[slot]) {
+                ++counts.perStudentCategories;
+                continue;
+            }
+            const std::string& name = plan->steps()[slot].name;
+            try {
+                invariant.add(name, course.getCategoryValue(name));
+            } catch (const std::exception&) {
+                ++counts.perStudentCategories;
+                continue;
+            }
+            ++counts.invariantCategories;
+        }
+    }
+    std::atomic<size_t> sharedReads(0);
+    std::atomic<size_t> storeRequests(0);
+
+    std::atomic<size_t> nextRow(0);
+    auto worker = [&]() {
+        while (true) {
+            size_t begin = nextRow.fetch_add(ROWS_PER_CHUNK);
+            if (begin >= roster.rows.size()) break;
+            size_t end = std::min(begin + ROWS_PER_CHUNK, roster.rows.size());
+            // one store request for the rows of the chunk
+            std::vector<std::vector<Value*>> stored;
+            if (store && !storeNames.empty()) {
+                std::vector<std::string> studentIds;
+                for (size_t r = begin; r < end; ++r) studentIds.push_back(roster.rows[r].studentId);
+                try {
+                    storeRequests.fetch_add(1, std::memory_order_relaxed);
+                    stored = store->getStudentValues(studentIds, storeNames);
+                } catch (const std::exception& ex) {
+                    for (size_t r = begin; r < end; ++r) {
+                        results[r].cells.assign(targets.size(), "error");
+                        results[r].error = std::string("input store: ") + ex.what();
+                    }
+                    continue;
+                }
+                // anything beyond the requested rows and names is not used
+                for (size_t i = end - begin; i < stored.size(); ++i) {
+                    for (Value* value : stored[i]) delete value;
+                }
+                stored.resize(end - begin);
+                for (std::vector<Value*>& values : stored) {
+                    for (size_t i = storeNames.size(); i < values.size(); ++i) delete values[i];
+                    values.resize(storeNames.size(), nullptr);
+                }
+            }
+            for (size_t r = begin; r < end; ++r) {
+                const RosterRow& row = roster.rows[r];
+                BatchRow& out = results[r];
+                std::unique_ptr<StoredInputs> inputs;
+                if (!stored.empty()) inputs.reset(new StoredInputs(storeGraph.get(), std::move(stored[r - begin])));
+                Context ctx;
+                ctx.setSymbolTable(symbols);
+                if (invariant.size()) ctx.setSharedValues(&invariant);
+                ctx.dataProviders.push_back(row.inputs);
+                if (inputs) ctx.dataProviders.push_back(inputs.get());
+                ctx.dataProviders.insert(ctx.dataProviders.end(), programs.begin(), programs.end());
+                ctx.operationProviders = operations;
+                out.cells.reserve(targets.size());
+                if (plan) {
+                    try {
+                        for (Value* val : ctx.evaluatePlan(*plan)) out.cells.push_back(formatBatchValue(val));
+                        sharedReads.fetch_add(ctx.sharedReadCount(), std::memory_order_relaxed);
+                        continue;
+                    } catch (const std::exception&) {
+                        // some target failed; the values computed so far are cached, so the
+                        // lookups below only redo the failing ones and report their errors
+                        out.cells.clear();
+                    }
+                }
+                for (const std::string& target : targets) {
+                    try {
+                        out.cells.push_back(formatBatchValue(ctx.getCategoryValue(target)));
+                    } catch (const std::exception& ex) {
+                        out.cells.push_back("error");
+                        if (out.error.empty()) out.error = target + ": " + ex.what();
+                    }
+                }
+                sharedReads.fetch_add(ctx.sharedReadCount(), std::memory_order_relaxed);
+            }
+        }
+    };
+
+    std::vector<std::thread> pool;
+    for (unsigned t = 1; t < threads; ++t) {
+        pool.emplace_back(worker);
+    }
+    worker();
+    for (auto& th : pool) th.join();
+    if (stats) {
+        counts.sharedReads = sharedReads.load();
+        counts.storeRequests = storeRequests.load();
+        *stats = counts;
+    }
+    return results;
+}
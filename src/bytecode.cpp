@@ -0,0 +1,390 @@
+#include "bytecode.h"
+#include "dependency_graph.h"
+#include "symbol_table.h"
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+
+// BytecodeCompiler implementation
+void BytecodeCompiler::emit(OpCode op, uint32_t operand, int stackEffect) {
+    out->code.push_back({op, operand});
+    depth = static_cast<uint32_t>(static_cast<int>(depth) + stackEffect);
+    if (depth > maxDepth) maxDepth = depth;
+}
+
+void BytecodeCompiler::emitGrade(double g) {
+    out->grades.push_back(g);
+    emit(OpCode::PUSH_GRADE, static_cast<uint32_t>(out->grades.size() - 1), 1);
+}
+
+void BytecodeCompiler::emitToGrade() {
+    // a pushed grade constant is already unboxed; an integer constant converts at compile time
+    if (!out->code.empty() && out->code.back().op == OpCode::PUSH_GRADE) return;
+    if (!out->code.empty() && out->code.back().op == OpCode::PUSH_INTEGER) {
+        Instruction& push = out->code.back();
+        out->grades.push_back(static_cast<double>(out->integers[push.operand]));
+        push = {OpCode::PUSH_GRADE, static_cast<uint32_t>(out->grades.size() - 1)};
+        return;
+    }
+    // a fused pipeline reduces to its mean without building the list
+    if (!out->code.empty() && out->code.back().op == OpCode::PIPELINE) {
+        out->code.back().op = OpCode::PIPELINE_MEAN;
+        return;
+    }
+    emit(OpCode::TO_GRADE, 0, 0);
+}
+
+void BytecodeCompiler::emitInteger(unsigned long long v) {
+    out->integers.push_back(v);
+    emit(OpCode::PUSH_INTEGER, static_cast<uint32_t>(out->integers.size() - 1), 1);
+}
+
+void BytecodeCompiler::emitConstant(const Datum& v) {
+    switch (v.getType()) {
+        case DataType::TYPE_GRADE:
+            emitGrade(v.getGrade());
+            break;
+        case DataType::TYPE_INTEGER:
+            emitInteger(v.getInteger());
+            break;
+        case DataType::TYPE_LIST:
+            out->lists.push_back(v.getList()->copy());
+            emit(OpCode::PUSH_LIST, static_cast<uint32_t>(out->lists.size() - 1), 1);
+            break;
+    }
+}
+
+void BytecodeCompiler::emitLoad(const std::string& categoryName, uint32_t symbol) {
+    auto it = nameIndex.find(categoryName);
+    uint32_t idx;
+    if (it == nameIndex.end()) {
+        idx = static_cast<uint32_t>(out->names.size());
+        out->names.push_back(categoryName);
+        out->nameSymbols.push_back(symbol);
+        nameIndex[categoryName] = idx;
+    } else {
+        idx = it->second;
+    }
+    emit(OpCode::LOAD_CATEGORY, idx, 1);
+}
+
+void BytecodeCompiler::emitCall(const OperationCallSite& site, uint32_t argc) {
+    out->calls.push_back({new OperationCallSite(site), argc});
+    emit(OpCode::CALL, static_cast<uint32_t>(out->calls.size() - 1), 1 - static_cast<int>(argc));
+}
+
+void BytecodeCompiler::emitPipeline(const ListPipeline& pipeline) {
+    ListPipeline copy = pipeline;
+    for (ListPipeline::Stage& stage : copy.stages) {
+        OperationCallSite* site = new OperationCallSite(*stage.site);
+        out->calls.push_back({site, static_cast<uint32_t>(elementwiseParamCount(stage.op) + 1)});
+        stage.site = site;
+    }
+    out->pipelines.push_back(std::move(copy));
+    emit(OpCode::PIPELINE, static_cast<uint32_t>(out->pipelines.size() - 1), -static_cast<int>(pipeline.paramCount));
+}
+
+void BytecodeCompiler::emitLazyCall(const OperationCallSite& site, Expression* const* args, uint32_t argc) {
+    out->calls.push_back({new OperationCallSite(site), argc});
+    LazyCallSite lazy{static_cast<uint32_t>(out->calls.size() - 1), {}};
+    // the argument chunks are only entered through CALL_LAZY, which runs them on stacks of their own
+    size_t jump = out->code.size();
+    emit(OpCode::JUMP, 0, 0);
+    uint32_t outerDepth = depth;
+    uint32_t outerMaxDepth = maxDepth;
+    for (uint32_t i = 0; i < argc; ++i) {
+        depth = 0;
+        maxDepth = 0;
+        uint32_t begin = static_cast<uint32_t>(out->code.size());
+        args[i]->compile(*this);
+        lazy.arguments.push_back({begin, static_cast<uint32_t>(out->code.size()), maxDepth});
+    }
+    depth = outerDepth;
+    maxDepth = outerMaxDepth;
+    out->code[jump].operand = static_cast<uint32_t>(out->code.size());
+    out->lazyCalls.push_back(std::move(lazy));
+    emit(OpCode::CALL_LAZY, static_cast<uint32_t>(out->lazyCalls.size() - 1), 1);
+}
+
+uint32_t BytecodeCompiler::beginMemo(uint64_t memoKey) {
+    out->memos.push_back({memoKey, 0});
+    uint32_t site = static_cast<uint32_t>(out->memos.size() - 1);
+    // on a hit the pushed copy stands in for the value the code below would push
+    emit(OpCode::MEMO_LOAD, site, 0);
+    return site;
+}
+
+void BytecodeCompiler::endMemo(uint32_t site) {
+    emit(OpCode::MEMO_STORE, site, 0);
+    out->memos[site].end = static_cast<uint32_t>(out->code.size());
+}
+
+void BytecodeCompiler::compileCategory(const std::string& categoryName, const Expression* expr) {
+    depth = 0;
+    maxDepth = 0;
+    uint32_t begin = static_cast<uint32_t>(out->code.size());
+    if (expr) {
+        expr->compile(*this);
+    } else {
+        emitGrade(std::numeric_limits<double>::quiet_NaN());
+    }
+    out->chunks[categoryName] = {begin, static_cast<uint32_t>(out->code.size()), maxDepth};
+}
+
+CompiledProgram* compileProgram(const Program& program) {
+    CompiledProgram* compiled = new CompiledProgram();
+    BytecodeCompiler compiler(compiled);
+    for (const auto& kv : program.categories) {
+        compiler.compileCategory(std::string(kv.first), kv.second);
+    }
+    // the same graph as the program's, with names owned by the compiled program
+    std::vector<std::string_view> names;
+    names.reserve(compiled->chunks.size());
+    for (const auto& kv : compiled->chunks) names.push_back(kv.first);
+    compiled->graph.reset(new DependencyGraph(std::move(names), [&](std::string_view name, std::vector<std::string_view>& out) {
+        const Expression* expr = program.categories.find(name)->second;
+        if (expr) expr->collectDependencies(out);
+    }));
+    compiled->indexedChunks.reserve(compiled->graph->size());
+    for (uint32_t i = 0; i < compiled->graph->size(); ++i) {
+        compiled->indexedChunks.push_back(&compiled->chunks.find(std::string(compiled->graph->name(i)))->second);
+    }
+    compiled->symbols = program.symbolTable();
+    if (compiled->symbols) {
+        compiled->symbolChunks.assign(compiled->symbols->size(), nullptr);
+        for (const auto& kv : compiled->chunks) {
+            compiled->symbolChunks[*compiled->symbols->find(kv.first)] = &kv.second;
+        }
+    }
+    return compiled;
+}
+
+// CompiledProgram implementation
+const DependencyGraph* CompiledProgram::dependencyGraph() const {
+    return graph.get();
+}
+
+CompiledProgram::~CompiledProgram() {
+    for (ListValue* lv : lists) delete lv;
+    for (CallSite& call : calls) delete call.site;
+}
+
+bool CompiledProgram::hasCategory(const std::string& categoryName) const {
+    return chunks.count(categoryName) != 0;
+}
+
+size_t CompiledProgram::codeSize() const {
+    return code.size();
+}
+
+Value* CompiledProgram::getCategoryValue(const std::string& categoryName, Context* ctx) {
+    auto it = chunks.find(categoryName);
+    if (it == chunks.end()) return nullptr;
+    return execute(it->second, ctx);
+}
+
+Value* CompiledProgram::getCategoryValueAt(uint32_t index, Context* ctx) {
+    return execute(*indexedChunks[index], ctx);
+}
+
+Value* CompiledProgram::getSymbolValue(uint32_t symbol, Context* ctx) {
+    if (ctx->symbolTable() != symbols) return DataProvider::getSymbolValue(symbol, ctx);
+    if (symbol >= symbolChunks.size() || !symbolChunks[symbol]) return nullptr;
+    return execute(*symbolChunks[symbol], ctx);
+}
+
+// The arguments of a lazy call: each evaluation runs the argument's chunk.
+class CompiledProgram::ChunkArguments : public LazyArguments {
+private:
+    const CompiledProgram& program;
+    const LazyCallSite& call;
+    Context* ctx;
+public:
+    ChunkArguments(const CompiledProgram& p, const LazyCallSite& c, Context* context) : program(p), call(c), ctx(context) {}
+    size_t size() const override { return call.arguments.size(); }
+    Datum evaluate(size_t i) override { return program.run(call.arguments[i], ctx); }
+};
+
+Value* CompiledProgram::execute(const Chunk& chunk, Context* ctx) const {
+    return run(chunk, ctx).box();
+}
+
+// The stack holds Datums, so grades and integers stay unboxed; only lists allocate, and they
+// are released with their slot, also when an operation throws.
+Datum CompiledProgram::run(const Chunk& chunk, Context* ctx) const {
+    std::vector<Datum> stack;
+    stack.reserve(chunk.maxStack);
+    std::vector<Datum> args;
+    // loads go by symbol in Contexts that use the table the program was bound to
+    bool bound = symbols && ctx->symbolTable() == symbols;
+    // reactive Contexts need every category to read its dependencies itself (see trackDependencies)
+    bool memoize = !ctx->tracksDependencies();
+    for (uint32_t pc = chunk.begin; pc < chunk.end; ++pc) {
+        const Instruction& ins = code[pc];
+        switch (ins.op) {
+            case OpCode::PUSH_GRADE:
+                stack.push_back(Datum::makeGrade(grades[ins.operand]));
+                break;
+            case OpCode::PUSH_INTEGER:
+                stack.push_back(Datum::makeInteger(integers[ins.operand]));
+                break;
+            case OpCode::PUSH_LIST:
+                stack.push_back(Datum::makeList(lists[ins.operand]->copy()));
+                break;
+            case OpCode::LOAD_CATEGORY:
+                stack.push_back(Datum::fromValue(bound ? ctx->getSymbolValue(nameSymbols[ins.operand])
+                                                       : ctx->getCategoryValue(names[ins.operand])));
+                break;
+            case OpCode::TO_GRADE: {
+                Datum& s = stack.back();
+                if (s.getType() != DataType::TYPE_GRADE) {
+                    s = Datum::makeGrade(s.toGrade());
+                }
+                break;
+            }
+            case OpCode::MAKE_LIST: {
+                size_t base = stack.size() - 2 * static_cast<size_t>(ins.operand);
+                ListValue* lv = new ListValue();
+                lv->reserve(ins.operand);
+                for (size_t i = base; i < stack.size(); i += 2) {
+                    lv->addValue(stack[i].getGrade(), stack[i + 1].getGrade());
+                }
+                stack.resize(base);
+                stack.push_back(Datum::makeList(lv));
+                break;
+            }
+            case OpCode::MEMO_LOAD: {
+                const MemoSite& memo = memos[ins.operand];
+                if (!memoize) break;
+                if (const Datum* hit = ctx->findSubexpression(memo.key)) {
+                    stack.push_back(hit->copy());
+                    pc = memo.end - 1;
+                }
+                break;
+            }
+            case OpCode::MEMO_STORE:
+                if (memoize) {
+                    stack.back() = ctx->storeSubexpression(memos[ins.operand].key, std::move(stack.back())).copy();
+                }
+                break;
+            case OpCode::CALL: {
+                const CallSite& call = calls[ins.operand];
+                size_t base = stack.size() - call.argc;
+                args.clear();
+                for (size_t i = base; i < stack.size(); ++i) {
+                    args.push_back(std::move(stack[i]));
+                }
+                stack.resize(base);
+                stack.push_back(call.site->invoke(ctx, args));
+                break;
+            }
+            case OpCode::PIPELINE:
+            case OpCode::PIPELINE_MEAN: {
+                const ListPipeline& pipeline = pipelines[ins.operand];
+                size_t base = stack.size() - pipeline.paramCount - 1;
+                Datum list = std::move(stack.back());
+                Datum result = ins.op == OpCode::PIPELINE
+                    ? runListPipeline(pipeline, std::move(list), &stack[base], ctx)
+                    : Datum::makeGrade(runListPipelineMean(pipeline, std::move(list), &stack[base], ctx));
+                stack.resize(base);
+                stack.push_back(std::move(result));
+                break;
+            }
+            case OpCode::JUMP:
+                pc = ins.operand - 1;
+                break;
+            case OpCode::CALL_LAZY: {
+                const LazyCallSite& lazy = lazyCalls[ins.operand];
+                const OperationCallSite* site = calls[lazy.call].site;
+                if (site->isLazyIn(ctx)) {
+                    ChunkArguments lazyArgs(*this, lazy, ctx);
+                    stack.push_back(ctx->executeLazyOperation(site->operationName, lazyArgs));
+                } else {
+                    // the Context's providers execute the operation eagerly
+                    args.clear();
+                    for (const Chunk& arg : lazy.arguments) args.push_back(run(arg, ctx));
+                    stack.push_back(site->invoke(ctx, args));
+                }
+                break;
+            }
+        }
+    }
+    if (stack.empty()) return Datum::makeGrade(std::numeric_limits<double>::quiet_NaN());
+    return std::move(stack.back());
+}
+
+static const char* opCodeName(OpCode op) {
+    switch (op) {
+        case OpCode::PUSH_GRADE: return "PUSH_GRADE";
+        case OpCode::PUSH_INTEGER: return "PUSH_INTEGER";
+        case OpCode::PUSH_LIST: return "PUSH_LIST";
+        case OpCode::LOAD_CATEGORY: return "LOAD_CATEGORY";
+        case OpCode::TO_GRADE: return "TO_GRADE";
+        case OpCode::MAKE_LIST: return "MAKE_LIST";
+        case OpCode::CALL: return "CALL";
+        case OpCode::MEMO_LOAD: return "MEMO_LOAD";
+        case OpCode::MEMO_STORE: return "MEMO_STORE";
+        case OpCode::PIPELINE: return "PIPELINE";
+        case OpCode::PIPELINE_MEAN: return "PIPELINE_MEAN";
+        case OpCode::JUMP: return "JUMP";
+        case OpCode::CALL_LAZY: return "CALL_LAZY";
+    }
+    return "?";
+}
+
+void CompiledProgram::disassemble(std::ostream& os) const {
+    for (const auto& kv : chunks) {
+        const Chunk& chunk = kv.second;
+        os << "Category: " << kv.first << " (stack " << chunk.maxStack << ")\n";
+        for (uint32_t pc = chunk.begin; pc < chunk.end; ++pc) {
+            const Instruction& ins = code[pc];
+            os << "  " << pc << ": " << opCodeName(ins.op);
+            switch (ins.op) {
+                case OpCode::PUSH_GRADE:
+                    if (std::isnan(grades[ins.operand])) os << " undef";
+                    else os << " " << grades[ins.operand];
+                    break;
+                case OpCode::PUSH_INTEGER:
+                    os << " " << integers[ins.operand];
+                    break;
+                case OpCode::PUSH_LIST:
+                    os << " #" << ins.operand;
+                    break;
+                case OpCode::LOAD_CATEGORY:
+                    os << " " << names[ins.operand];
+                    break;
+                case OpCode::MAKE_LIST:
+                    os << " " << ins.operand;
+                    break;
+                case OpCode::CALL:
+                    os << " " << calls[ins.operand].site->operationName << "/" << calls[ins.operand].argc;
+                    if (calls[ins.operand].site->isStaticallyBound()) os << " (bound)";
+                    break;
+                case OpCode::MEMO_LOAD:
+                    os << " #" << ins.operand << " -> " << memos[ins.operand].end;
+                    break;
+                case OpCode::MEMO_STORE:
+                    os << " #" << ins.operand;
+                    break;
+                case OpCode::PIPELINE:
+                case OpCode::PIPELINE_MEAN:
+                    for (const ListPipeline::Stage& stage : pipelines[ins.operand].stages) {
+                        os << " " << elementwiseOpName(stage.op);
+                    }
+                    break;
+                case OpCode::JUMP:
+                    os << " -> " << ins.operand;
+                    break;
+                case OpCode::CALL_LAZY: {
+                    const LazyCallSite& lazy = lazyCalls[ins.operand];
+                    os << " " << calls[lazy.call].site->operationName << "/" << lazy.arguments.size() << " args";
+                    for (const Chunk& arg : lazy.arguments) os << " [" << arg.begin << "," << arg.end << ")";
+                    break;
+                }
+                case OpCode::TO_GRADE:
+                    break;
+            }
+            os << "\n";
+        }
+    }
+}
@@ -1,11 +1,12 @@
 #include "data.h"
+#include "list_kernels.h"
 #include <cmath>
-#include <iterator>
 
 // GradeValue implementations
 GradeValue::GradeValue(double g) : grade(g) {}
 
 DataType GradeValue::getType() const { return DataType::TYPE_GRADE; }
+GradeValue* GradeValue::copy() const { return new GradeValue(grade); }
 double GradeValue::getVal() const { return grade; }
 void GradeValue::setVal(double g) { grade = g; }
 bool GradeValue::isUndefined() const { return std::isnan(grade); }
@@ -16,55 +17,144 @@ GradeValue undefinedGrade(std::numeric_limits<double>::quiet_NaN());
 // IntegerValue implementations
 IntegerValue::IntegerValue(unsigned long long val) : intValue(val) {}
 DataType IntegerValue::getType() const { return DataType::TYPE_INTEGER; }
+IntegerValue* IntegerValue::copy() const { return new IntegerValue(intValue); }
 unsigned long long IntegerValue::getVal() const { return intValue; }
 void IntegerValue::setVal(unsigned long long val) { intValue = val; }
 
 // ListValue implementations
-ListValue::ListValue() : listValues() {}
+ListValue::ListValue() : listValues(std::make_shared<Entries>()) {}
 DataType ListValue::getType() const { return DataType::TYPE_LIST; }
-double ListValue::getValueAt(size_t index) const { return listValues[index].first; }
-double ListValue::getWeightAt(size_t index) const { return listValues[index].second; }
-size_t ListValue::size() const { return listValues.size(); }
-void ListValue::addValue(double value, double weight) { listValues.emplace_back(value, weight); }
-void ListValue::clear() { listValues.clear(); }
-void ListValue::setValueAt(size_t index, double value) { listValues[index].first = value; }
-void ListValue::setWeightAt(size_t index, double weight) { listValues[index].second = weight; }
-void ListValue::removeAt(size_t index) { listValues.erase(listValues.begin() + index); }
-void ListValue::insertAt(size_t index, double value, double weight) { listValues.insert(listValues.begin() + index, std::make_pair(value, weight)); }
+
+ListValue::Entries& ListValue::mutableEntries() {
+    // only owners can copy, so a count of one cannot grow behind our back
+    if (listValues.use_count() > 1) {
+        listValues = std::make_shared<Entries>(*listValues);
+    }
+    return *listValues;
+}
+
+double ListValue::getValueAt(size_t index) const { return listValues->values[index]; }
+double ListValue::getWeightAt(size_t index) const { return listValues->weights[index]; }
+size_t ListValue::size() const { return listValues->values.size(); }
+void ListValue::addValue(double value, double weight) {
+    Entries& entries = mutableEntries();
+    entries.values.push_back(value);
+    entries.weights.push_back(weight);
+}
+void ListValue::reserve(size_t n) {
+    Entries& entries = mutableEntries();
+    entries.values.reserve(n);
+    entries.weights.reserve(n);
+}
+void ListValue::append(const ListValue& other) {
+    // copy other's arrays first: other may share (or be) this list's entries
+    std::shared_ptr<Entries> source = other.listValues;
+    Entries& entries = mutableEntries();
+    entries.values.insert(entries.values.end(), source->values.begin(), source->values.end());
+    entries.weights.insert(entries.weights.end(), source->weights.begin(), source->weights.end());
+}
+void ListValue::clear() {
+    if (listValues.use_count() > 1) {
+        listValues = std::make_shared<Entries>();
+    } else {
+        listValues->values.clear();
+        listValues->weights.clear();
+    }
+}
+void ListValue::setValueAt(size_t index, double value) { mutableEntries().values[index] = value; }
+void ListValue::setWeightAt(size_t index, double weight) { mutableEntries().weights[index] = weight; }
+void ListValue::removeAt(size_t index) {
+    Entries& entries = mutableEntries();
+    entries.values.erase(entries.values.begin() + index);
+    entries.weights.erase(entries.weights.begin() + index);
+}
+void ListValue::insertAt(size_t index, double value, double weight) {
+    Entries& entries = mutableEntries();
+    entries.values.insert(entries.values.begin() + index, value);
+    entries.weights.insert(entries.weights.begin() + index, weight);
+}
 
 ListValue* ListValue::copy() const {
-    ListValue* newList = new ListValue();
-    newList->listValues = listValues;
-    return newList;
+    return new ListValue(*this);
 }
 
-GradeValue* ListValue::toGrade() const {
+bool ListValue::isShared() const { return listValues.use_count() > 1; }
+
+const double* ListValue::values() const { return listValues->values.data(); }
+const double* ListValue::weights() const { return listValues->weights.data(); }
+double* ListValue::mutableValues() { return mutableEntries().values.data(); }
+
+double ListValue::weightedMean() const {
     double totalWeightedValue = 0.0;
     double totalWeight = 0.0;
+    weightedSums(values(), weights(), size(), totalWeightedValue, totalWeight);
+    if (totalWeight == 0.0) {
+        return std::numeric_limits<double>::quiet_NaN();
+    }
+    return totalWeightedValue / totalWeight;
+}
+
+GradeValue* ListValue::toGrade() const {
+    return new GradeValue(weightedMean());
+}
 
-    for (const auto& pair : listValues) {
-        if (!std::isnan(pair.first)) {
-            totalWeightedValue += pair.first * pair.second;
-            totalWeight += pair.second;
-        }
+// Datum implementations
+Datum Datum::fromValue(const Value* v) {
+    if (!v) return Datum();
+    switch (v->getType()) {
+        case DataType::TYPE_GRADE:
+            return makeGrade(static_cast<const GradeValue*>(v)->getVal());
+        case DataType::TYPE_INTEGER:
+            return makeInteger(static_cast<const IntegerValue*>(v)->getVal());
+        case DataType::TYPE_LIST:
+            return makeList(static_cast<const ListValue*>(v)->copy());
     }
-    if (totalWeight == 0.0) {
-        return &undefinedGrade;
-    } else {
-        return new GradeValue(totalWeightedValue / totalWeight);
+    return Datum();
+}
+
+Datum Datum::take(Value* v) {
+    if (v && v->getType() == DataType::TYPE_LIST) {
+        return makeList(static_cast<ListValue*>(v));
+    }
+    Datum d = fromValue(v);
+    delete v;
+    return d;
+}
+
+Datum Datum::copy() const {
+    switch (type) {
+        case DataType::TYPE_GRADE:
+            return makeGrade(grade);
+        case DataType::TYPE_INTEGER:
+            return makeInteger(integer);
+        case DataType::TYPE_LIST:
+            return makeList(list->copy());
+    }
+    return Datum();
+}
+
+Value* Datum::box() {
+    switch (type) {
+        case DataType::TYPE_GRADE:
+            return new GradeValue(grade);
+        case DataType::TYPE_INTEGER:
+            return new IntegerValue(integer);
+        case DataType::TYPE_LIST:
+            return releaseList();
     }
+    return nullptr;
 }
 
 // ListValueIterator implementations
-ListValueIterator::ListValueIterator(ListValue* lv) : listValue(lv), currentIt(lv->listValues.begin()) {}
+ListValueIterator::ListValueIterator(ListValue* lv) : listValue(lv), index(0) {}
 
 bool ListValueIterator::hasNext() const {
-    return currentIt != listValue->listValues.end();
+    return index < listValue->size();
 }
 
 void ListValueIterator::advance() {
     if (hasNext()) {
-        ++currentIt;
+        ++index;
     } else {
         throw std::out_of_range("Iterator has reached the end of the list.");
     }
@@ -72,7 +162,7 @@ void ListValueIterator::advance() {
 
 double ListValueIterator::getValue() const {
     if (hasNext()) {
-        return currentIt->first;
+        return listValue->getValueAt(index);
     } else {
         throw std::out_of_range("Iterator has reached the end of the list.");
     }
@@ -80,7 +170,7 @@ double ListValueIterator::getValue() const {
 
 double ListValueIterator::getWeight() const {
     if (hasNext()) {
-        return currentIt->second;
+        return listValue->getWeightAt(index);
     } else {
         throw std::out_of_range("Iterator has reached the end of the list.");
     }
@@ -88,7 +178,7 @@ double ListValueIterator::getWeight() const {
 
 void ListValueIterator::setValue(double value) {
     if (hasNext()) {
-        currentIt->first = value;
+        listValue->setValueAt(index, value);
     } else {
         throw std::out_of_range("Iterator has reached the end of the list.");
     }
@@ -96,7 +186,7 @@ void ListValueIterator::setValue(double value) {
 
 void ListValueIterator::setWeight(double weight) {
     if (hasNext()) {
-        currentIt->second = weight;
+        listValue->setWeightAt(index, weight);
     } else {
         throw std::out_of_range("Iterator has reached the end of the list.");
     }
@@ -104,21 +194,21 @@ void ListValueIterator::setWeight(double weight) {
 
 void ListValueIterator::discard() {
     if (hasNext()) {
-        currentIt = listValue->listValues.erase(currentIt);
+        listValue->removeAt(index);
     } else {
         throw std::out_of_range("Iterator has reached the end of the list.");
     }
 }
 
 void ListValueIterator::insertBefore(double value, double weight) {
-    currentIt = listValue->listValues.insert(currentIt, std::make_pair(value, weight));
+    // the iterator moves to the inserted entry
+    listValue->insertAt(index, value, weight);
 }
 
 void ListValueIterator::insertAfter(double value, double weight) {
     if (hasNext()) {
-        auto nextIt = std::next(currentIt);
-        listValue->listValues.insert(nextIt, std::make_pair(value, weight));
+        listValue->insertAt(index + 1, value, weight);
     } else {
-        listValue->listValues.emplace_back(value, weight);
+        listValue->addValue(value, weight);
     }
 }
@@ -0,0 +1,129 @@
+#include "dependency_graph.h"
+#include "eval.h"
+#include <algorithm>
+
+static std::vector<std::string_view> categoryNames(const std::unordered_map<std::string_view, Expression*>& categories) {
+    std::vector<std::string_view> names;
+    names.reserve(categories.size());
+    for (const auto& kv : categories) names.push_back(kv.first);
+    return names;
+}
+
+DependencyGraph::DependencyGraph(const std::unordered_map<std::string_view, Expression*>& categories)
+    : DependencyGraph(categoryNames(categories), [&](std::string_view name, std::vector<std::string_view>& out) {
+          const Expression* expr = categories.find(name)->second;
+          if (expr) expr->collectDependencies(out);
+      }) {}
+
+DependencyGraph::DependencyGraph(std::vector<std::string_view> categoryNames,
+                                 const std::function<void(std::string_view, std::vector<std::string_view>&)>& collectReferences)
+    : names(std::move(categoryNames)) {
+    std::sort(names.begin(), names.end());
+    uint32_t n = static_cast<uint32_t>(names.size());
+    indices.reserve(n);
+    for (uint32_t i = 0; i < n; ++i) indices.emplace(names[i], i);
+
+    // forward edges, one sorted run per category
+    edgeOffsets.reserve(n + 1);
+    edgeOffsets.push_back(0);
+    std::vector<std::string_view> refs;
+    std::vector<std::string_view> unknown;
+    std::vector<uint32_t> unknownOwners; // the category of each entry of unknown
+    for (uint32_t i = 0; i < n; ++i) {
+        refs.clear();
+        collectReferences(names[i], refs);
+        size_t start = edges.size();
+        for (std::string_view ref : refs) {
+            auto it = indices.find(ref);
+            if (it != indices.end()) edges.push_back(it->second);
+            else {
+                unknown.push_back(ref);
+                unknownOwners.push_back(i);
+            }
+        }
+        std::sort(edges.begin() + start, edges.end());
+        edges.erase(std::unique(edges.begin() + start, edges.end()), edges.end());
+        edgeOffsets.push_back(static_cast<uint32_t>(edges.size()));
+    }
+    // copied, since references may point into storage that does not outlive the graph
+    std::vector<std::string_view> sortedUnknown(unknown);
+    std::sort(sortedUnknown.begin(), sortedUnknown.end());
+    sortedUnknown.erase(std::unique(sortedUnknown.begin(), sortedUnknown.end()), sortedUnknown.end());
+    externals.assign(sortedUnknown.begin(), sortedUnknown.end());
+    // external references per category; unknown is grouped by category already
+    externalOffsets.assign(n + 1, 0);
+    for (size_t k = 0; k < unknown.size();) {
+        uint32_t owner = unknownOwners[k];
+        size_t start = externalEdges.size();
+        for (; k < unknown.size() && unknownOwners[k] == owner; ++k) {
+            auto it = std::lower_bound(sortedUnknown.begin(), sortedUnknown.end(), unknown[k]);
+            externalEdges.push_back(static_cast<uint32_t>(it - sortedUnknown.begin()));
+        }
+        std::sort(externalEdges.begin() + start, externalEdges.end());
+        externalEdges.erase(std::unique(externalEdges.begin() + start, externalEdges.end()), externalEdges.end());
+        externalOffsets[owner + 1] = static_cast<uint32_t>(externalEdges.size() - start);
+    }
+    for (uint32_t i = 0; i < n; ++i) externalOffsets[i + 1] += externalOffsets[i];
+
+    // reverse edges by counting sort; dependents come out in index order
+    reverseOffsets.assign(n + 1, 0);
+    for (uint32_t dep : edges) ++reverseOffsets[dep + 1];
+    for (uint32_t i = 0; i < n; ++i) reverseOffsets[i + 1] += reverseOffsets[i];
+    reverseEdges.resize(edges.size());
+    std::vector<uint32_t> fill(reverseOffsets.begin(), reverseOffsets.end() - 1);
+    for (uint32_t i = 0; i < n; ++i) {
+        for (uint32_t dep : dependencies(i)) reverseEdges[fill[dep]++] = i;
+    }
+
+    // Kahn's algorithm; order doubles as the work queue
+    std::vector<uint32_t> pending(n);
+    order.reserve(n);
+    for (uint32_t i = 0; i < n; ++i) {
+        pending[i] = edgeOffsets[i + 1] - edgeOffsets[i];
+        if (pending[i] == 0) order.push_back(i);
+    }
+    for (size_t head = 0; head < order.size(); ++head) {
+        for (uint32_t user : dependents(order[head])) {
+            if (--pending[user] == 0) order.push_back(user);
+        }
+    }
+    if (order.size() == n) return;
+
+    // every category left over still waits on a left-over dependency, so following
+    // those from any of them must close a cycle
+    uint32_t start = 0;
+    while (pending[start] == 0) ++start;
+    std::vector<int64_t> pathPos(n, -1);
+    std::vector<uint32_t> path;
+    uint32_t cur = start;
+    while (pathPos[cur] < 0) {
+        pathPos[cur] = static_cast<int64_t>(path.size());
+        path.push_back(cur);
+        for (uint32_t dep : dependencies(cur)) {
+            if (pending[dep] != 0) {
+                cur = dep;
+                break;
+            }
+        }
+    }
+    cyclePath.assign(path.begin() + pathPos[cur], path.end());
+    cyclePath.push_back(cur);
+}
+
+std::optional<uint32_t> DependencyGraph::indexOf(std::string_view name) const {
+    auto it = indices.find(name);
+    if (it == indices.end()) return std::nullopt;
+    return it->second;
+}
+
+DependencyGraph::IndexRange DependencyGraph::dependencies(uint32_t index) const {
+    return { edges.data() + edgeOffsets[index], edges.data() + edgeOffsets[index + 1] };
+}
+
+DependencyGraph::IndexRange DependencyGraph::externalDependencies(uint32_t index) const {
+    return { externalEdges.data() + externalOffsets[index], externalEdges.data() + externalOffsets[index + 1] };
+}
+
+DependencyGraph::IndexRange DependencyGraph::dependents(uint32_t index) const {
+    return { reverseEdges.data() + reverseOffsets[index], reverseEdges.data() + reverseOffsets[index + 1] };
+}
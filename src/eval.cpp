@@ -1,4 +1,13 @@
 #include "eval.h"
+#include "bytecode.h"
+#include "dependency_graph.h"
+#include "eval_plan.h"
+#include "list_pipeline.h"
+#include "symbol_table.h"
+#include "thread_pool.h"
+#include "subexpressions.h"
+#include <algorithm>
+#include <deque>
 #include <cmath>
 #include <limits>
 #include <stdexcept>
@@ -6,178 +15,964 @@
 #include <iostream>
 #include <iomanip>
 
-// Helper: convert a Value* to double for list elements/weights.
-static double valueToDouble(Value* v) {
-    if (!v) {
-        return std::numeric_limits<double>::quiet_NaN();
-    }
-    switch (v->getType()) {
-        case DataType::TYPE_GRADE:
-            return static_cast<GradeValue*>(v)->getVal();
-        case DataType::TYPE_INTEGER:
-            return static_cast<double>(static_cast<IntegerValue*>(v)->getVal());
-        case DataType::TYPE_LIST:
-            GradeValue* val = static_cast<ListValue*>(v)->toGrade();
-            double out = val->getVal();
-            delete val;
-            return out;
+// ValueCache implementation
+ValueCache::~ValueCache() {
+    for (Shard& shard : shards) {
+        for (auto& kv : shard.values) {
+            delete kv.second;
+        }
     }
-    return std::numeric_limits<double>::quiet_NaN();
 }
 
+ValueCache::Shard& ValueCache::shardFor(const std::string& name) {
+    return shards[std::hash<std::string>()(name) % SHARD_COUNT];
+}
+
+Value* ValueCache::find(const std::string& name) {
+    Shard& shard = shardFor(name);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto it = shard.values.find(name);
+    return it == shard.values.end() ? nullptr : it->second;
+}
+
+Value* ValueCache::insert(const std::string& name, Value* value) {
+    Shard& shard = shardFor(name);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto res = shard.values.emplace(name, value);
+    if (!res.second) delete value;
+    return res.first->second;
+}
+
+Value* ValueCache::erase(const std::string& name) {
+    Shard& shard = shardFor(name);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto it = shard.values.find(name);
+    if (it == shard.values.end()) return nullptr;
+    Value* value = it->second;
+    shard.values.erase(it);
+    return value;
+}
+
+// SubexpressionCache implementation
+const Datum* SubexpressionCache::find(uint64_t key) {
+    Shard& shard = shards[key % SHARD_COUNT];
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto it = shard.values.find(key);
+    return it == shard.values.end() ? nullptr : &it->second;
+}
+
+const Datum& SubexpressionCache::insert(uint64_t key, Datum value) {
+    Shard& shard = shards[key % SHARD_COUNT];
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    return shard.values.emplace(key, std::move(value)).first->second;
+}
+
+// SharedValues implementation
+SharedValues::SharedValues(const SymbolTable* table) : symbols(table) {
+    if (symbols) symbolValues.assign(symbols->size(), nullptr);
+}
+
+SharedValues::~SharedValues() {
+    for (auto& kv : values) delete kv.second;
+}
+
+void SharedValues::add(const std::string& categoryName, const Value* value) {
+    if (values.count(categoryName)) return;
+    Value* copy = value->copy();
+    values.emplace(categoryName, copy);
+    auto symbol = symbols ? symbols->find(categoryName) : std::nullopt;
+    if (symbol && *symbol < symbolValues.size()) symbolValues[*symbol] = copy;
+}
+
+Value* SharedValues::find(const std::string& categoryName) const {
+    auto it = values.find(categoryName);
+    return it == values.end() ? nullptr : it->second;
+}
+
+Value* SharedValues::findSymbol(uint32_t symbol) const {
+    if (symbol < symbolValues.size()) return symbolValues[symbol];
+    return find(symbols->name(symbol));
+}
+
+// categories every Context starts with
+static const std::pair<const char*, double> constantCategories[] = {
+    {"pass", 1.0},
+    {"fail", 0.0},
+    {"undef", std::numeric_limits<double>::quiet_NaN()},
+};
+
 Context::Context() {
     // Initialize the value cache with constants
-    valueCache["pass"] = new GradeValue(1.0);
-    valueCache["fail"] = new GradeValue(0.0);
-    valueCache["undef"] = &undefinedGrade;
+    for (const auto& constant : constantCategories) {
+        valueCache.insert(constant.first, new GradeValue(constant.second));
+    }
+}
+
+Context::~Context() {
+    for (size_t i = 0; i < slotCount; ++i) {
+        delete slotValues[i].load(std::memory_order_relaxed);
+    }
+    for (Value* value : retired) delete value;
+}
+
+void Context::setSymbolTable(const SymbolTable* table) {
+    for (size_t i = 0; i < slotCount; ++i) {
+        delete slotValues[i].load(std::memory_order_relaxed);
+    }
+    symbols = table;
+    slotCount = table ? table->size() : 0;
+    slotValues.reset(new std::atomic<Value*>[slotCount]);
+    for (size_t i = 0; i < slotCount; ++i) slotValues[i].store(nullptr, std::memory_order_relaxed);
+    // the constants move to their slots, so that they still take precedence over every provider
+    for (const auto& constant : constantCategories) {
+        auto symbol = symbols ? symbols->find(constant.first) : std::nullopt;
+        if (symbol && *symbol < slotCount) storeSymbolValue(*symbol, new GradeValue(constant.second));
+    }
 }
 
+// Publishes the first value computed for a slot; a later one (from a racing thread) is deleted.
+Value* Context::storeSymbolValue(uint32_t symbol, Value* value) {
+    Value* expected = nullptr;
+    if (slotValues[symbol].compare_exchange_strong(expected, value, std::memory_order_acq_rel)) {
+        return value;
+    }
+    delete value;
+    return expected;
+}
+
+// The cache a category lives in: its slot if it has one, the value cache otherwise.
+Value* Context::storeCategoryValue(const std::string& categoryName, Value* value) {
+    auto symbol = symbols ? symbols->find(categoryName) : std::nullopt;
+    if (symbol && *symbol < slotCount) return storeSymbolValue(*symbol, value);
+    return valueCache.insert(categoryName, value);
+}
+
+Value* Context::eraseCategoryValue(const std::string& categoryName) {
+    auto symbol = symbols ? symbols->find(categoryName) : std::nullopt;
+    if (symbol && *symbol < slotCount) return slotValues[*symbol].exchange(nullptr, std::memory_order_acq_rel);
+    return valueCache.erase(categoryName);
+}
+
+Value* Context::findCategoryValue(const std::string& categoryName) {
+    auto symbol = symbols ? symbols->find(categoryName) : std::nullopt;
+    if (symbol && *symbol < slotCount) return slotValues[*symbol].load(std::memory_order_acquire);
+    return valueCache.find(categoryName);
+}
+
+// Categories being computed on this thread, innermost last; reaching one of them again in the
+// same Context is a circular dependency. The stack is per thread so that concurrent evaluations
+// in one Context do not mistake each other's categories for cycles.
+struct EvaluationFrame {
+    const Context* ctx;
+    std::string_view name;
+};
+static thread_local std::vector<EvaluationFrame> evaluationStack;
+static thread_local std::unordered_multiset<std::string_view> evaluationNames;
+
+// Marks a category as being computed on this thread for its lifetime; throws std::runtime_error
+// if it is already being computed in the same Context.
+struct EvaluationScope {
+    EvaluationScope(const Context* ctx, const std::string& categoryName) {
+        if (evaluationNames.count(categoryName)) {
+            auto first = std::find_if(evaluationStack.begin(), evaluationStack.end(), [&](const EvaluationFrame& f) {
+                return f.ctx == ctx && f.name == categoryName;
+            });
+            if (first != evaluationStack.end()) {
+                std::string path;
+                for (auto cur = first; cur != evaluationStack.end(); ++cur) {
+                    if (cur->ctx == ctx) path.append(cur->name.data(), cur->name.size()).append(" -> ");
+                }
+                throw std::runtime_error("Circular dependency: " + path + categoryName);
+            }
+        }
+        evaluationStack.push_back({ctx, categoryName});
+        evaluationNames.insert(categoryName);
+    }
+    // pops the frame again on return or when a provider throws
+    ~EvaluationScope() {
+        evaluationNames.erase(evaluationNames.find(evaluationStack.back().name));
+        evaluationStack.pop_back();
+    }
+    EvaluationScope(const EvaluationScope&) = delete;
+    EvaluationScope& operator=(const EvaluationScope&) = delete;
+};
+
 // Context implementation
 Value* Context::getCategoryValue(const std::string& categoryName) {
-    auto it = valueCache.find(categoryName);
-    if (it != valueCache.end()) {
-        return it->second;
+    if (symbols) {
+        auto symbol = symbols->find(categoryName);
+        if (symbol && *symbol < slotCount) return getSymbolValue(*symbol);
+    }
+    if (tracking) recordRead(categoryName);
+    Value* cached = valueCache.find(categoryName);
+    if (cached) {
+        return cached;
+    }
+    if (shared) {
+        if (Value* published = sharedValue(categoryName)) return published;
+    }
+    if (parent) {
+        if (Value* shared = inheritedValue(categoryName)) return shared;
     }
+    EvaluationScope scope(this, categoryName);
     for (DataProvider* dp : dataProviders) {
         if (!dp) continue;
         Value* val = dp->getCategoryValue(categoryName, this);
         if (val) {
-            valueCache[categoryName] = val;
-            return val;
+            if (tracking) recordComputed(categoryName);
+            return valueCache.insert(categoryName, val);
         }
     }
     return &undefinedGrade;
 }
 
+Value* Context::getSymbolValue(uint32_t symbol) {
+    if (symbol >= slotCount) return getCategoryValue(symbols->name(symbol));
+    if (tracking) recordRead(symbols->name(symbol));
+    Value* cached = slotValues[symbol].load(std::memory_order_acquire);
+    if (cached) {
+        return cached;
+    }
+    if (shared) {
+        if (Value* published = sharedValue(symbol)) return published;
+    }
+    if (parent) {
+        if (Value* shared = inheritedValue(symbols->name(symbol))) return shared;
+    }
+    EvaluationScope scope(this, symbols->name(symbol));
+    for (DataProvider* dp : dataProviders) {
+        if (!dp) continue;
+        Value* val = dp->getSymbolValue(symbol, this);
+        if (val) {
+            if (tracking) recordComputed(symbols->name(symbol));
+            return storeSymbolValue(symbol, val);
+        }
+    }
+    return &undefinedGrade;
+}
+
+void Context::setSharedValues(const SharedValues* values) {
+    shared = values;
+}
+
+Value* Context::sharedValue(uint32_t symbol) {
+    Value* value = shared->symbolTable() == symbols ? shared->findSymbol(symbol) : shared->find(symbols->name(symbol));
+    if (value) sharedReads.fetch_add(1, std::memory_order_relaxed);
+    return value;
+}
+
+Value* Context::sharedValue(const std::string& categoryName) {
+    Value* value = shared->find(categoryName);
+    if (value) sharedReads.fetch_add(1, std::memory_order_relaxed);
+    return value;
+}
+
+// Called for every lookup in reactive mode: the category computed innermost on this thread, if
+// it belongs to this Context, reads categoryName.
+void Context::recordRead(const std::string& categoryName) {
+    if (evaluationStack.empty() || evaluationStack.back().ctx != this) return;
+    std::lock_guard<std::mutex> lock(trackingMutex);
+    readers[categoryName].emplace(evaluationStack.back().name);
+}
+
+void Context::recordComputed(const std::string& categoryName) {
+    std::lock_guard<std::mutex> lock(trackingMutex);
+    if (invalidated.erase(categoryName)) ++recomputed;
+}
+
+void Context::trackDependencies() {
+    tracking = true;
+}
+
+size_t Context::setCategoryValue(const std::string& categoryName, Value* value) {
+    if (!tracking) {
+        delete value;
+        throw std::runtime_error("setCategoryValue needs dependency tracking");
+    }
+    std::lock_guard<std::mutex> lock(trackingMutex);
+    // a fork also follows the reads recorded by its ancestors, whose values it inherits
+    auto readersOf = [this](const std::string& name) {
+        std::vector<std::string> out;
+        for (Context* c = this; c; c = c->parent) {
+            std::unique_lock<std::mutex> ancestorLock(c->trackingMutex, std::defer_lock);
+            if (c != this) ancestorLock.lock();
+            auto it = c->readers.find(name);
+            if (it != c->readers.end()) out.insert(out.end(), it->second.begin(), it->second.end());
+        }
+        return out;
+    };
+    auto isInput = [this](const std::string& name) {
+        for (Context* c = this; c; c = c->parent) {
+            std::unique_lock<std::mutex> ancestorLock(c->trackingMutex, std::defer_lock);
+            if (c != this) ancestorLock.lock();
+            if (c->inputs.count(name)) return true;
+        }
+        return false;
+    };
+    size_t count = 0;
+    std::unordered_set<std::string> seen{ categoryName };
+    std::vector<std::string> work{ categoryName };
+    while (!work.empty()) {
+        std::string name = std::move(work.back());
+        work.pop_back();
+        for (const std::string& reader : readersOf(name)) {
+            // inputs keep their values, so nothing behind them changes through them
+            if (!seen.insert(reader).second || isInput(reader)) continue;
+            Value* old = eraseCategoryValue(reader);
+            bool visible = old || inheritedValue(reader);
+            if (old) retired.push_back(old);
+            if (parent) shadowed.insert(reader);
+            if (visible) {
+                invalidated.insert(reader);
+                ++count;
+            }
+            work.push_back(reader);
+        }
+    }
+    Value* old = eraseCategoryValue(categoryName);
+    if (old) retired.push_back(old);
+    if (parent) shadowed.insert(categoryName);
+    inputs.insert(categoryName);
+    storeCategoryValue(categoryName, value);
+    return count;
+}
+
+Context* Context::fork() {
+    if (!tracking) throw std::runtime_error("Only Contexts that track dependencies can be forked");
+    Context* child = new Context();
+    child->parent = this;
+    child->dataProviders = dataProviders;
+    child->operationProviders = operationProviders;
+    child->setSymbolTable(symbols);
+    child->tracking = true;
+    return child;
+}
+
+// The value an ancestor has cached for a category, unless this fork or one in between
+// overrode something it depends on.
+Value* Context::inheritedValue(const std::string& categoryName) {
+    for (Context* c = this; c->parent; c = c->parent) {
+        if (c->shadowed.count(categoryName)) return nullptr;
+        if (Value* value = c->parent->findCategoryValue(categoryName)) return value;
+    }
+    return nullptr;
+}
+
+size_t Context::recomputedCount() {
+    std::lock_guard<std::mutex> lock(trackingMutex);
+    return recomputed;
+}
+
+std::vector<Value*> Context::evaluateParallel(const std::vector<std::string>& categoryNames, WorkStealingPool& pool) {
+    // Plan: every category reachable from the requested ones that is not cached yet, linked to
+    // its dependencies as listed by the graph of the first provider defining it.
+    struct Task {
+        std::string name;
+        std::vector<uint32_t> dependents;
+        std::atomic<uint32_t> pending;
+        Task(const std::string& n) : name(n), pending(0) {}
+    };
+    std::deque<Task> tasks;
+    std::unordered_map<std::string, uint32_t> ids;
+    std::vector<std::pair<uint32_t, std::string>> edges; // (task, name of a dependency)
+    std::vector<std::string> work(categoryNames.rbegin(), categoryNames.rend());
+    while (!work.empty()) {
+        std::string name = std::move(work.back());
+        work.pop_back();
+        if (ids.count(name) || findCategoryValue(name)) continue;
+        const DependencyGraph* graph = nullptr;
+        std::optional<uint32_t> index;
+        bool opaque = false;
+        for (DataProvider* dp : dataProviders) {
+            if (!dp) continue;
+            graph = dp->dependencyGraph();
+            if (!graph) {
+                opaque = true;
+                break;
+            }
+            index = graph->indexOf(name);
+            if (index) break;
+        }
+        if (!opaque && !index) continue; // nobody defines it: undefined, nothing to compute
+        uint32_t id = static_cast<uint32_t>(tasks.size());
+        tasks.emplace_back(name);
+        ids.emplace(name, id);
+        if (opaque) continue; // dependencies unknown; resolved by the task itself
+        for (uint32_t dep : graph->dependencies(*index)) {
+            edges.emplace_back(id, std::string(graph->name(dep)));
+            work.emplace_back(graph->name(dep));
+        }
+    }
+    for (const auto& edge : edges) {
+        auto it = ids.find(edge.second);
+        if (it == ids.end()) continue;
+        tasks[it->second].dependents.push_back(edge.first);
+        tasks[edge.first].pending.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // categories on or behind a cycle never become ready; they are left to the ordered pass
+    std::vector<uint32_t> ready;
+    std::vector<uint32_t> pending(tasks.size());
+    for (uint32_t id = 0; id < tasks.size(); ++id) {
+        pending[id] = tasks[id].pending.load(std::memory_order_relaxed);
+        if (pending[id] == 0) ready.push_back(id);
+    }
+    size_t initiallyReady = ready.size();
+    for (size_t head = 0; head < ready.size(); ++head) {
+        for (uint32_t user : tasks[ready[head]].dependents) {
+            if (--pending[user] == 0) ready.push_back(user);
+        }
+    }
+    size_t schedulable = ready.size();
+
+    if (schedulable > 0) {
+        std::atomic<size_t> remaining(schedulable);
+        std::function<void(uint32_t)> run = [&](uint32_t id) {
+            try {
+                getCategoryValue(tasks[id].name);
+            } catch (...) {
+                // not cached; the ordered pass below evaluates it again and reports the error
+            }
+            for (uint32_t user : tasks[id].dependents) {
+                if (tasks[user].pending.fetch_sub(1) == 1) {
+                    pool.submit([&run, user]() { run(user); });
+                }
+            }
+            remaining.fetch_sub(1);
+        };
+        for (size_t k = 0; k < initiallyReady; ++k) {
+            uint32_t id = ready[k];
+            pool.submit([&run, id]() { run(id); });
+        }
+        pool.helpUntil([&]() { return remaining.load() == 0; });
+    }
+
+    std::vector<Value*> out;
+    out.reserve(categoryNames.size());
+    for (const std::string& name : categoryNames) {
+        out.push_back(getCategoryValue(name));
+    }
+    return out;
+}
+
+size_t Context::prefetchCategoryValues(const std::vector<std::string>& categoryNames) {
+    // a bulk request computes its names outside any EvaluationScope, so nothing would record
+    // what they read
+    if (tracking) return 0;
+    std::vector<std::string> missing;
+    for (const std::string& name : categoryNames) {
+        if (!findCategoryValue(name)) missing.push_back(name);
+    }
+    size_t fetched = 0;
+    for (DataProvider* dp : dataProviders) {
+        if (missing.empty()) break;
+        if (!dp) continue;
+        // a provider with a graph returns nothing else, so it is only asked for what it defines
+        std::vector<std::string> asked;
+        std::vector<std::string> rest;
+        if (const DependencyGraph* graph = dp->dependencyGraph()) {
+            for (std::string& name : missing) (graph->indexOf(name) ? asked : rest).push_back(std::move(name));
+        } else {
+            asked.swap(missing);
+        }
+        if (asked.empty()) {
+            missing.swap(rest);
+            continue;
+        }
+        std::vector<Value*> values;
+        try {
+            values = dp->getCategoryValues(asked, this);
+        } catch (const std::exception&) {
+            break;
+        }
+        for (size_t i = 0; i < asked.size(); ++i) {
+            Value* value = i < values.size() ? values[i] : nullptr;
+            if (value) {
+                storeCategoryValue(asked[i], value);
+                ++fetched;
+            } else {
+                rest.push_back(std::move(asked[i]));
+            }
+        }
+        missing.swap(rest);
+    }
+    return fetched;
+}
+
+std::vector<Value*> Context::evaluatePlan(const EvalPlan& plan) {
+    const std::vector<DataProvider*>& planned = plan.providers();
+    if (dataProviders.size() < planned.size() ||
+        !std::equal(planned.begin(), planned.end(), dataProviders.end() - planned.size())) {
+        throw std::invalid_argument("The evaluation plan was built for other data providers");
+    }
+    // categories defined ahead of the plan's providers go through getCategoryValue; without a
+    // graph, such a provider might define any of them
+    size_t leading = dataProviders.size() - planned.size();
+    std::vector<char> overridden(plan.size(), 0);
+    bool opaque = false;
+    for (size_t p = 0; p < leading && !opaque; ++p) {
+        if (!dataProviders[p]) continue;
+        const DependencyGraph* graph = dataProviders[p]->dependencyGraph();
+        if (!graph) {
+            opaque = true;
+            break;
+        }
+        for (uint32_t i = 0; i < graph->size(); ++i) {
+            auto slot = plan.slotOf(graph->name(i));
+            if (slot) overridden[*slot] = 1;
+        }
+    }
+    // the leaf inputs, one bulk request per provider: the names no provider defines, and the
+    // leaf steps that the providers ahead of the plan's define (or, without a graph, may define)
+    if (leading && !parent) {
+        std::vector<std::string> leaves = plan.inputs();
+        for (uint32_t slot = 0; slot < plan.size(); ++slot) {
+            if ((opaque || overridden[slot]) && plan.dependencies(slot).empty()) leaves.push_back(plan.steps()[slot].name);
+        }
+        if (!leaves.empty()) prefetchCategoryValues(leaves);
+    }
+
+    // steps carry their symbols when the plan was built with this Context's table
+    bool slotted = symbols && plan.symbolTable() == symbols;
+    std::vector<Value*> values(plan.size(), nullptr);
+    for (uint32_t slot = 0; slot < plan.size(); ++slot) {
+        const EvalPlan::Step& step = plan.steps()[slot];
+        try {
+            if (opaque || overridden[slot] || parent) {
+                // forks mostly inherit; getCategoryValue knows which values they can
+                values[slot] = getCategoryValue(step.name);
+                continue;
+            }
+            if (shared) {
+                Value* published = slotted && step.symbol != SymbolTable::NO_SYMBOL ? sharedValue(step.symbol)
+                                                                                    : sharedValue(step.name);
+                if (published) {
+                    values[slot] = published;
+                    continue;
+                }
+            }
+            Value* val;
+            {
+                EvaluationScope scope(this, step.name);
+                val = step.provider->getCategoryValueAt(step.index, this);
+            }
+            if (val && tracking) recordComputed(step.name);
+            // a provider may decline a category it lists, leaving it to the ones after it
+            if (!val) {
+                values[slot] = getCategoryValue(step.name);
+            } else if (slotted && step.symbol < slotCount) {
+                values[slot] = storeSymbolValue(step.symbol, val);
+            } else {
+                values[slot] = storeCategoryValue(step.name, val);
+            }
+        } catch (...) {
+            // not cached; the target pass below evaluates it again and reports the error
+        }
+    }
+
+    std::vector<Value*> out;
+    out.reserve(plan.targets().size());
+    for (size_t i = 0; i < plan.targets().size(); ++i) {
+        uint32_t slot = plan.targetSlot(i);
+        Value* val = slot == EvalPlan::NO_SLOT ? nullptr : values[slot];
+        out.push_back(val ? val : getCategoryValue(plan.targets()[i]));
+    }
+    return out;
+}
+
 // Add missing executeOperation implementation.
 // It forwards to the first provider that reports it has the operation.
-// We copy the argument list because provider interface takes a non-const vector<Value*>&.
-Value* Context::executeOperation(const std::string& operationName, const std::vector<Value*>& arguments) {
+Datum Context::executeOperation(const std::string& operationName, std::vector<Datum>& arguments) {
     for (OperationProvider* op : operationProviders) {
         if (!op) continue;
         if (op->hasOperation(operationName)) {
-            std::vector<Value*> argsCopy = arguments;
-            return op->executeOperation(operationName, argsCopy);
+            return op->executeOperation(operationName, arguments);
         }
     }
     throw std::invalid_argument("Operation not found: " + operationName);
 }
 
+Datum Context::executeLazyOperation(const std::string& operationName, LazyArguments& arguments) {
+    for (OperationProvider* op : operationProviders) {
+        if (!op) continue;
+        if (op->hasOperation(operationName)) {
+            return op->executeLazyOperation(operationName, arguments);
+        }
+    }
+    throw std::invalid_argument("Operation not found: " + operationName);
+}
+
+const Datum* Context::findSubexpression(uint64_t memoKey) {
+    return subexpressions.find(memoKey);
+}
+
+const Datum& Context::storeSubexpression(uint64_t memoKey, Datum value) {
+    return subexpressions.insert(memoKey, std::move(value));
+}
+
+ResolvedOperation OperationProvider::resolveOperation(const std::string& /*operationName*/, const std::vector<DataType>& /*argTypes*/) const {
+    return ResolvedOperation();
+}
+
+bool OperationProvider::isPure(const std::string& /*operationName*/) const {
+    return false;
+}
+
+bool isPureOperation(const std::vector<OperationProvider*>& providers, const std::string& operationName) {
+    for (OperationProvider* op : providers) {
+        if (!op) continue;
+        if (op->hasOperation(operationName)) return op->isPure(operationName);
+    }
+    return false;
+}
+
+bool OperationProvider::isLazy(const std::string& /*operationName*/) const {
+    return false;
+}
+
+Datum OperationProvider::executeLazyOperation(const std::string& operationName, LazyArguments& arguments) const {
+    std::vector<Datum> values;
+    values.reserve(arguments.size());
+    for (size_t i = 0; i < arguments.size(); ++i) {
+        values.push_back(arguments.evaluate(i));
+    }
+    return executeOperation(operationName, values);
+}
+
+bool isLazyOperation(const std::vector<OperationProvider*>& providers, const std::string& operationName) {
+    for (OperationProvider* op : providers) {
+        if (!op) continue;
+        if (op->hasOperation(operationName)) return op->isLazy(operationName);
+    }
+    return false;
+}
+
+std::optional<ElementwiseOp> OperationProvider::elementwiseOperation(const std::string& /*operationName*/) const {
+    return std::nullopt;
+}
+
+std::optional<ElementwiseOp> elementwiseOperation(const std::vector<OperationProvider*>& providers, const std::string& operationName) {
+    for (OperationProvider* op : providers) {
+        if (!op) continue;
+        if (op->hasOperation(operationName)) return op->elementwiseOperation(operationName);
+    }
+    return std::nullopt;
+}
+
+ResolvedOperation resolveOperation(const std::vector<OperationProvider*>& providers, const std::string& operationName, const std::vector<DataType>& argTypes) {
+    for (OperationProvider* op : providers) {
+        if (!op) continue;
+        if (op->hasOperation(operationName)) {
+            return op->resolveOperation(operationName, argTypes);
+        }
+    }
+    return ResolvedOperation();
+}
+
+// OperationCallSite implementation
+OperationCallSite::OperationCallSite(const std::string& opName) : nextSlot(0), operationName(opName) {
+    for (auto& slot : cache) slot.store(nullptr, std::memory_order_relaxed);
+}
+
+OperationCallSite::OperationCallSite(const OperationCallSite& other)
+    : providers(other.providers), linked(other.linked), lazy(other.lazy), bound(other.bound), nextSlot(0),
+      operationName(other.operationName) {
+    for (auto& slot : cache) slot.store(nullptr, std::memory_order_relaxed);
+}
+
+void OperationCallSite::link(const std::vector<OperationProvider*>& ops, const std::vector<std::optional<DataType>>& argTypes) {
+    std::lock_guard<std::mutex> lock(cacheMutex);
+    providers = ops;
+    linked = true;
+    bound = ResolvedOperation();
+    for (auto& slot : cache) slot.store(nullptr, std::memory_order_relaxed);
+    entries.clear();
+    // lazy operations take no evaluated arguments to resolve an overload for
+    lazy = isLazyOperation(providers, operationName);
+    if (lazy) return;
+
+    std::vector<DataType> types;
+    for (const auto& t : argTypes) {
+        if (!t) return; // resolved per call through the inline cache
+        types.push_back(*t);
+    }
+    bound = resolveOperation(providers, operationName, types);
+}
+
+bool OperationCallSite::isStaticallyBound() const {
+    return bound.fn != nullptr;
+}
+
+std::optional<DataType> OperationCallSite::staticReturnType() const {
+    if (!bound.fn) return std::nullopt;
+    return bound.returnType;
+}
+
+// Each argument type takes two bits of the cache key; longer calls are not cached.
+static const size_t MAX_CACHED_ARGS = 31;
+
+bool OperationCallSite::isLazyIn(const Context* ctx) const {
+    if (linked && providers == ctx->operationProviders) return lazy;
+    return isLazyOperation(ctx->operationProviders, operationName);
+}
+
+const ResolvedOperation* OperationCallSite::lookup(const std::vector<Datum>& arguments) const {
+    if (arguments.size() > MAX_CACHED_ARGS) return nullptr;
+    uint64_t key = arguments.size();
+    for (const Datum& arg : arguments) {
+        key = (key << 2) | static_cast<uint64_t>(arg.getType());
+    }
+    for (const auto& slot : cache) {
+        const CacheEntry* entry = slot.load(std::memory_order_acquire);
+        if (entry && entry->key == key) return &entry->op;
+    }
+
+    std::lock_guard<std::mutex> lock(cacheMutex);
+    const CacheEntry* found = nullptr;
+    for (const auto& entry : entries) {
+        if (entry->key == key) {
+            found = entry.get();
+            break;
+        }
+    }
+    if (!found) {
+        std::vector<DataType> types;
+        types.reserve(arguments.size());
+        for (const Datum& arg : arguments) {
+            types.push_back(arg.getType());
+        }
+        entries.emplace_back(new CacheEntry{key, resolveOperation(providers, operationName, types)});
+        found = entries.back().get();
+    }
+    cache[nextSlot.fetch_add(1, std::memory_order_relaxed) % CACHE_SIZE].store(found, std::memory_order_release);
+    return &found->op;
+}
+
+Datum OperationCallSite::invoke(Context* ctx, std::vector<Datum>& arguments) const {
+    if (linked && providers == ctx->operationProviders) {
+        const ResolvedOperation* op = bound.fn ? &bound : lookup(arguments);
+        if (op && op->fn) {
+            return (*op->fn)(arguments);
+        }
+    }
+    // unlinked, foreign providers or no matching overload: dispatch by name
+    return ctx->executeOperation(operationName, arguments);
+}
+
 // Program implementation
-Program::~Program() {
-    for (auto &p : categories) {
-        delete p.second;
+Program::Program() = default;
+Program::Program(size_t arenaBlockSize) : arena(arenaBlockSize) {}
+Program::~Program() = default;
+
+void Program::setCategory(std::string_view name, Expression* expr) {
+    graph.reset();
+    symbols = nullptr;
+    symbolDefinitions.clear();
+    auto it = categories.find(name);
+    if (it != categories.end()) {
+        it->second = expr;
+    } else {
+        categories.emplace(arena.copyString(name), expr);
+    }
+}
+
+const DependencyGraph* Program::dependencyGraph() const {
+    if (!graph) graph.reset(new DependencyGraph(categories));
+    return graph.get();
+}
+
+void Program::link(const std::vector<OperationProvider*>& ops) {
+    for (auto& kv : categories) {
+        if (kv.second) kv.second->link(ops);
+    }
+}
+
+size_t Program::foldConstants(const std::vector<OperationProvider*>& ops) {
+    ConstantFolder folder(arena, ops);
+    for (auto& kv : categories) {
+        if (kv.second) kv.second = kv.second->foldConstants(folder);
+    }
+    return folder.folded;
+}
+
+void Program::bindSymbols(SymbolTable& table) {
+    for (auto& kv : categories) {
+        table.intern(kv.first);
+        if (kv.second) kv.second->bindSymbols(table);
+    }
+    symbols = &table;
+    symbolDefinitions.assign(table.size(), nullptr);
+    for (const auto& kv : categories) {
+        symbolDefinitions[*table.find(kv.first)] = kv.second;
+    }
+}
+
+size_t Program::fuseListPipelines(const std::vector<OperationProvider*>& ops) {
+    ListFuser fuser(arena, ops);
+    for (auto& kv : categories) {
+        if (kv.second) kv.second = kv.second->fuseListPipelines(fuser);
+    }
+    // bound categories keep pointing at the nodes they were bound to
+    if (symbols) {
+        for (const auto& kv : categories) symbolDefinitions[*symbols->find(kv.first)] = kv.second;
+    }
+    return fuser.fused;
+}
+
+Value* DataProvider::getCategoryValueAt(uint32_t index, Context* ctx) {
+    return getCategoryValue(std::string(dependencyGraph()->name(index)), ctx);
+}
+
+Value* DataProvider::getSymbolValue(uint32_t symbol, Context* ctx) {
+    return getCategoryValue(ctx->symbolTable()->name(symbol), ctx);
+}
+
+std::vector<Value*> DataProvider::getCategoryValues(const std::vector<std::string>& categoryNames, Context* ctx) {
+    std::vector<Value*> values;
+    values.reserve(categoryNames.size());
+    try {
+        for (const std::string& name : categoryNames) values.push_back(getCategoryValue(name, ctx));
+    } catch (...) {
+        for (Value* value : values) delete value;
+        throw;
     }
-    categories.clear();
+    return values;
+}
+
+Value* Program::getSymbolValue(uint32_t symbol, Context* ctx) {
+    if (ctx->symbolTable() != symbols) return DataProvider::getSymbolValue(symbol, ctx);
+    // every name the program defines was interned before symbolDefinitions was sized
+    if (symbol >= symbolDefinitions.size()) return nullptr;
+    Expression* expr = symbolDefinitions[symbol];
+    if (!expr) return nullptr;
+    return expr->evaluate(ctx).box();
 }
 
 Value* Program::getCategoryValue(const std::string& categoryName, Context* ctx) {
-    auto it = categories.find(categoryName);
+    auto it = categories.find(std::string_view(categoryName));
     if (it == categories.end()) return nullptr;
     Expression* expr = it->second;
-    Value* result = nullptr;
-    if (expr) {
-        result = expr->evaluate(ctx);
-    }
-
-    return result;
+    if (!expr) return nullptr;
+    // the only allocation of a scalar category: the boxed value the Context caches
+    return expr->evaluate(ctx).box();
 }
 
 // ConstantExpr
-Value* ConstantExpr::evaluate(Context* /*ctx*/) const {
-    return value;
+Datum ConstantExpr::evaluate(Context* /*ctx*/) const {
+    return value.copy();
 }
 
-std::unordered_set<std::string>* ConstantExpr::getDependencies() const {
-    return new std::unordered_set<std::string>();
+void ConstantExpr::collectDependencies(std::vector<std::string_view>& /*out*/) const {
 }
 
 // CategoryRefExpr
-Value* CategoryRefExpr::evaluate(Context* ctx) const {
-    if (!ctx) return nullptr;
-    Value* v = ctx->getCategoryValue(categoryName);
-    if (!v) return nullptr;
-    if (v->getType() == DataType::TYPE_LIST) {
-        return static_cast<ListValue*>(v)->copy();
-    }
-    return v;
+Datum CategoryRefExpr::evaluate(Context* ctx) const {
+    if (!ctx) return Datum();
+    if (symbols && ctx->symbolTable() == symbols) return Datum::fromValue(ctx->getSymbolValue(symbol));
+    return Datum::fromValue(ctx->getCategoryValue(std::string(categoryName)));
 }
 
-std::unordered_set<std::string>* CategoryRefExpr::getDependencies() const {
-    auto *deps = new std::unordered_set<std::string>();
-    deps->insert(categoryName);
-    return deps;
+void CategoryRefExpr::collectDependencies(std::vector<std::string_view>& out) const {
+    out.push_back(categoryName);
 }
 
-// ListElement destructor
-ListElement::~ListElement() {
-    delete valueExpr;
-    delete weightExpr;
+// Evaluates a memoized node once per Context; every use gets its own (copy-on-write) copy.
+template<typename F>
+static Datum memoized(Context* ctx, uint64_t memoKey, F compute) {
+    if (!memoKey || !ctx || ctx->tracksDependencies()) return compute();
+    if (const Datum* hit = ctx->findSubexpression(memoKey)) return hit->copy();
+    return ctx->storeSubexpression(memoKey, compute()).copy();
 }
 
 // ListExpr
-ListExpr::~ListExpr() {
-    for (auto *el : elements) delete el;
-    elements.clear();
+Datum ListExpr::evaluate(Context* ctx) const {
+    return memoized(ctx, memoKey, [&]() { return evaluateElements(ctx); });
 }
 
-Value* ListExpr::evaluate(Context* ctx) const {
+Datum ListExpr::evaluateElements(Context* ctx) const {
     ListValue* out = new ListValue();
-    for (auto *el : elements) {
-        Value* valV = el->valueExpr ? el->valueExpr->evaluate(ctx) : &undefinedGrade;
-        double val = valueToDouble(valV);
-        delete valV;
-
-        double weight = 1.0;
-        if (el->weightExpr) {
-            Value* wtV = el->weightExpr->evaluate(ctx);
-            weight = valueToDouble(wtV);
-            delete wtV;
-        }
+    Datum result = Datum::makeList(out);
+    out->reserve(elementCount);
+    for (size_t i = 0; i < elementCount; ++i) {
+        const ListElement* el = &elements[i];
+        double val = el->valueExpr ? el->valueExpr->evaluateGrade(ctx) : std::numeric_limits<double>::quiet_NaN();
+        double weight = el->weightExpr ? el->weightExpr->evaluateGrade(ctx) : 1.0;
         out->addValue(val, weight);
     }
-    return out;
+    return result;
 }
 
-std::unordered_set<std::string>* ListExpr::getDependencies() const {
-    auto *deps = new std::unordered_set<std::string>();
-    for (auto *el : elements) {
-        if (el->valueExpr) {
-            auto *d = el->valueExpr->getDependencies();
-            if (d) { deps->insert(d->begin(), d->end()); delete d; }
-        }
-        if (el->weightExpr) {
-            auto *d = el->weightExpr->getDependencies();
-            if (d) { deps->insert(d->begin(), d->end()); delete d; }
-        }
+void ListExpr::collectDependencies(std::vector<std::string_view>& out) const {
+    for (size_t i = 0; i < elementCount; ++i) {
+        const ListElement* el = &elements[i];
+        if (el->valueExpr) el->valueExpr->collectDependencies(out);
+        if (el->weightExpr) el->weightExpr->collectDependencies(out);
     }
-    return deps;
 }
 
 // OperationExpr
-OperationExpr::~OperationExpr() {
-    for (auto *arg : arguments) delete arg;
-    arguments.clear();
+Datum OperationExpr::evaluate(Context* ctx) const {
+    return memoized(ctx, memoKey, [&]() { return evaluateCall(ctx); });
 }
 
-Value* OperationExpr::evaluate(Context* ctx) const {
-    return ctx->executeOperation(operationName, 
-        [this, ctx]() {
-            std::vector<Value*> args;
-            for (auto *argExpr : arguments) {
-                args.push_back(argExpr->evaluate(ctx));
-            }
-            return args;
-        }());
+// The arguments of a lazy call, evaluated when the operation asks for them.
+class ExpressionArguments : public LazyArguments {
+private:
+    Expression* const* arguments;
+    size_t count;
+    Context* ctx;
+public:
+    ExpressionArguments(Expression* const* args, size_t n, Context* c) : arguments(args), count(n), ctx(c) {}
+    size_t size() const override { return count; }
+    Datum evaluate(size_t i) override { return arguments[i]->evaluate(ctx); }
+};
+
+Datum OperationExpr::evaluateCall(Context* ctx) const {
+    if (callSite.isLazyIn(ctx)) {
+        ExpressionArguments args(arguments, argumentCount, ctx);
+        return ctx->executeLazyOperation(callSite.operationName, args);
+    }
+    std::vector<Datum> args;
+    args.reserve(argumentCount);
+    for (size_t i = 0; i < argumentCount; ++i) {
+        args.push_back(arguments[i]->evaluate(ctx));
+    }
+    return callSite.invoke(ctx, args);
 }
 
-std::unordered_set<std::string>* OperationExpr::getDependencies() const {
-    auto *deps = new std::unordered_set<std::string>();
-    for (auto *arg : arguments) {
-        auto *d = arg->getDependencies();
-        if (d) { deps->insert(d->begin(), d->end()); delete d; }
+void OperationExpr::collectDependencies(std::vector<std::string_view>& out) const {
+    for (size_t i = 0; i < argumentCount; ++i) {
+        arguments[i]->collectDependencies(out);
     }
-    return deps;
+}
+
+// FusedListExpr
+Datum FusedListExpr::evaluateArguments(Context* ctx, std::vector<Datum>& values) const {
+    values.reserve(pipeline.paramCount);
+    for (uint32_t i = 0; i < pipeline.paramCount; ++i) {
+        values.push_back(params[i]->evaluate(ctx));
+    }
+    return source->evaluate(ctx);
+}
+
+Datum FusedListExpr::evaluate(Context* ctx) const {
+    return memoized(ctx, memoKey, [&]() {
+        std::vector<Datum> values;
+        Datum list = evaluateArguments(ctx, values);
+        return runListPipeline(pipeline, std::move(list), values.data(), ctx);
+    });
+}
+
+double FusedListExpr::evaluateGrade(Context* ctx) const {
+    // a memoized list is shared by its uses, so it is built once and reduced
+    if (memoKey && ctx && !ctx->tracksDependencies()) return evaluate(ctx).toGrade();
+    std::vector<Datum> values;
+    Datum list = evaluateArguments(ctx, values);
+    return runListPipelineMean(pipeline, std::move(list), values.data(), ctx);
+}
+
+void FusedListExpr::collectDependencies(std::vector<std::string_view>& out) const {
+    original->collectDependencies(out);
 }
 
 
@@ -226,25 +1021,21 @@ static void printIndent(std::ostream& os, int indent) {
     for (int i = 0; i < indent; ++i) os.put(' ');
 }
 
-// Helper to print a Value inline for AST printing (non-owning, don't delete)
-static void printValueInline(std::ostream& os, Value* v) {
-    if (!v) {
-        os << "<null>";
-        return;
-    }
-    switch (v->getType()) {
+// Helper to print a constant inline for AST printing
+static void printValueInline(std::ostream& os, const Datum& v) {
+    switch (v.getType()) {
         case DataType::TYPE_GRADE: {
-            double g = static_cast<GradeValue*>(v)->getVal();
+            double g = v.getGrade();
             if (std::isnan(g)) os << "undef";
             else os << g;
             break;
         }
         case DataType::TYPE_INTEGER: {
-            os << static_cast<IntegerValue*>(v)->getVal();
+            os << v.getInteger();
             break;
         }
         case DataType::TYPE_LIST: {
-            ListValue* lv = static_cast<ListValue*>(v);
+            const ListValue* lv = v.getList();
             os << "{";
             for (size_t i = 0; i < lv->size(); ++i) {
                 if (i) os << ", ";
@@ -266,9 +1057,7 @@ static void printValueInline(std::ostream& os, Value* v) {
 void ConstantExpr::printAST(std::ostream& os, int indent) const {
     printIndent(os, indent);
     os << "Constant: ";
-    // we can safely use evaluate with nullptr because ConstantExpr doesn't use ctx
-    Value* v = value;
-    printValueInline(os, v);
+    printValueInline(os, value);
     os << "\n";
 }
 
@@ -281,8 +1070,9 @@ void CategoryRefExpr::printAST(std::ostream& os, int indent) const {
 // ListExpr::printAST
 void ListExpr::printAST(std::ostream& os, int indent) const {
     printIndent(os, indent);
-    os << "List:\n";
-    for (auto *el : elements) {
+    os << "List:" << (memoKey ? " (shared)" : "") << "\n";
+    for (size_t i = 0; i < elementCount; ++i) {
+        const ListElement* el = &elements[i];
         printIndent(os, indent + 2);
         os << "- Element:\n";
         if (el->valueExpr) {
@@ -302,8 +1092,8 @@ void ListExpr::printAST(std::ostream& os, int indent) const {
 // OperationExpr::printAST
 void OperationExpr::printAST(std::ostream& os, int indent) const {
     printIndent(os, indent);
-    os << "Operation: " << operationName << "\n";
-    for (size_t i = 0; i < arguments.size(); ++i) {
+    os << "Operation: " << callSite.operationName << (memoKey ? " (shared)" : "") << "\n";
+    for (size_t i = 0; i < argumentCount; ++i) {
         printIndent(os, indent + 2);
         os << "Arg " << i << ":\n";
         if (arguments[i]) arguments[i]->printAST(os, indent + 4);
@@ -312,4 +1102,344 @@ void OperationExpr::printAST(std::ostream& os, int indent) const {
             os << "<null>\n";
         }
     }
-}
\ No newline at end of file
+}
+
+// FusedListExpr::printAST
+void FusedListExpr::printAST(std::ostream& os, int indent) const {
+    printIndent(os, indent);
+    os << "FusedList:";
+    for (const ListPipeline::Stage& stage : pipeline.stages) os << " " << elementwiseOpName(stage.op);
+    os << (memoKey ? " (shared)" : "") << "\n";
+    for (uint32_t i = 0; i < pipeline.paramCount; ++i) {
+        printIndent(os, indent + 2);
+        os << "Param " << i << ":\n";
+        params[i]->printAST(os, indent + 4);
+    }
+    printIndent(os, indent + 2);
+    os << "Source:\n";
+    source->printAST(os, indent + 4);
+}
+
+// Bytecode lowering. List elements are reduced to grades exactly as ListExpr::evaluate does.
+void ConstantExpr::compile(BytecodeCompiler& compiler) const {
+    compiler.emitConstant(value);
+}
+
+void CategoryRefExpr::compile(BytecodeCompiler& compiler) const {
+    compiler.emitLoad(std::string(categoryName), symbols ? symbol : SymbolTable::NO_SYMBOL);
+}
+
+void ListExpr::compile(BytecodeCompiler& compiler) const {
+    uint32_t memo = memoKey ? compiler.beginMemo(memoKey) : 0;
+    for (size_t i = 0; i < elementCount; ++i) {
+        const ListElement* el = &elements[i];
+        if (el->valueExpr) {
+            el->valueExpr->compile(compiler);
+            compiler.emitToGrade();
+        } else {
+            compiler.emitGrade(std::numeric_limits<double>::quiet_NaN());
+        }
+        if (el->weightExpr) {
+            el->weightExpr->compile(compiler);
+            compiler.emitToGrade();
+        } else {
+            compiler.emitGrade(1.0);
+        }
+    }
+    compiler.emit(OpCode::MAKE_LIST, static_cast<uint32_t>(elementCount), 1 - 2 * static_cast<int>(elementCount));
+    if (memoKey) compiler.endMemo(memo);
+}
+
+void OperationExpr::compile(BytecodeCompiler& compiler) const {
+    uint32_t memo = memoKey ? compiler.beginMemo(memoKey) : 0;
+    if (callSite.isLazy()) {
+        compiler.emitLazyCall(callSite, arguments, static_cast<uint32_t>(argumentCount));
+    } else {
+        for (size_t i = 0; i < argumentCount; ++i) {
+            arguments[i]->compile(compiler);
+        }
+        compiler.emitCall(callSite, static_cast<uint32_t>(argumentCount));
+    }
+    if (memoKey) compiler.endMemo(memo);
+}
+
+void FusedListExpr::compile(BytecodeCompiler& compiler) const {
+    uint32_t memo = memoKey ? compiler.beginMemo(memoKey) : 0;
+    for (uint32_t i = 0; i < pipeline.paramCount; ++i) {
+        params[i]->compile(compiler);
+    }
+    source->compile(compiler);
+    compiler.emitPipeline(pipeline);
+    if (memoKey) compiler.endMemo(memo);
+}
+
+// Link pass. Category references stay dynamically typed: an earlier DataProvider may
+// supply a value of a different type than the expression that defines the category.
+std::optional<DataType> ConstantExpr::link(const std::vector<OperationProvider*>& /*ops*/) {
+    return value.getType();
+}
+
+std::optional<DataType> CategoryRefExpr::link(const std::vector<OperationProvider*>& /*ops*/) {
+    return std::nullopt;
+}
+
+std::optional<DataType> ListExpr::link(const std::vector<OperationProvider*>& ops) {
+    for (size_t i = 0; i < elementCount; ++i) {
+        const ListElement* el = &elements[i];
+        if (el->valueExpr) el->valueExpr->link(ops);
+        if (el->weightExpr) el->weightExpr->link(ops);
+    }
+    return DataType::TYPE_LIST;
+}
+
+std::optional<DataType> OperationExpr::link(const std::vector<OperationProvider*>& ops) {
+    std::vector<std::optional<DataType>> argTypes;
+    argTypes.reserve(argumentCount);
+    for (size_t i = 0; i < argumentCount; ++i) {
+        argTypes.push_back(arguments[i]->link(ops));
+    }
+    callSite.link(ops, argTypes);
+    return callSite.staticReturnType();
+}
+
+// the original calls bind the stages' fallback call sites, and the parameters and source with them
+std::optional<DataType> FusedListExpr::link(const std::vector<OperationProvider*>& ops) {
+    original->link(ops);
+    return std::nullopt;
+}
+
+// Constant folding. Folded nodes stay in the arena, unreferenced, until the program is released.
+ConstantFolder::ConstantFolder(Arena& a, const std::vector<OperationProvider*>& ops) : arena(a) {
+    context.operationProviders = ops;
+}
+
+Expression* ConstantFolder::makeConstant(Datum value) {
+    ++folded;
+    if (value.getType() == DataType::TYPE_LIST) {
+        return arena.makeOwned<ConstantExpr>(std::move(value));
+    }
+    return arena.make<ConstantExpr>(std::move(value));
+}
+
+Expression* ConstantExpr::foldConstants(ConstantFolder& /*folder*/) {
+    return this;
+}
+
+Expression* CategoryRefExpr::foldConstants(ConstantFolder& /*folder*/) {
+    return this;
+}
+
+Expression* ListExpr::foldConstants(ConstantFolder& folder) {
+    bool constant = true;
+    for (size_t i = 0; i < elementCount; ++i) {
+        ListElement& el = elements[i];
+        if (el.valueExpr) {
+            el.valueExpr = el.valueExpr->foldConstants(folder);
+            constant = constant && el.valueExpr->constantValue();
+        }
+        if (el.weightExpr) {
+            el.weightExpr = el.weightExpr->foldConstants(folder);
+            constant = constant && el.weightExpr->constantValue();
+        }
+    }
+    if (!constant) return this;
+    // every element is constant, so evaluating needs no context
+    return folder.makeConstant(evaluate(nullptr));
+}
+
+Expression* OperationExpr::foldConstants(ConstantFolder& folder) {
+    bool constant = true;
+    for (size_t i = 0; i < argumentCount; ++i) {
+        arguments[i] = arguments[i]->foldConstants(folder);
+        constant = constant && arguments[i]->constantValue();
+    }
+    if (!constant || !isPureOperation(folder.context.operationProviders, callSite.operationName)) return this;
+    std::vector<Datum> args;
+    args.reserve(argumentCount);
+    for (size_t i = 0; i < argumentCount; ++i) {
+        args.push_back(arguments[i]->constantValue()->copy());
+    }
+    try {
+        return folder.makeConstant(folder.context.executeOperation(callSite.operationName, args));
+    } catch (const std::exception&) {
+        // e.g. no overload for these types; evaluation raises the same error
+        return this;
+    }
+}
+
+// fusion runs after folding
+Expression* FusedListExpr::foldConstants(ConstantFolder& /*folder*/) {
+    return this;
+}
+
+// Common-subexpression elimination. A structural key starts with a tag for the node kind,
+// followed by its payload and the ids of its children; a child without an id is not shareable,
+// and neither is anything containing it. Replaced nodes stay in the arena, unreferenced.
+static const uint32_t NO_CHILD = 0xFFFFFFFFu;
+
+static void appendBytes(std::string& key, const void* data, size_t size) {
+    key.append(static_cast<const char*>(data), size);
+}
+
+Expression* ConstantExpr::internSubexpressions(SubexpressionInterner& interner) {
+    std::string key("C");
+    DataType type = value.getType();
+    appendBytes(key, &type, sizeof(type));
+    switch (type) {
+        case DataType::TYPE_GRADE: {
+            double g = value.getGrade();
+            appendBytes(key, &g, sizeof(g));
+            break;
+        }
+        case DataType::TYPE_INTEGER: {
+            unsigned long long v = value.getInteger();
+            appendBytes(key, &v, sizeof(v));
+            break;
+        }
+        case DataType::TYPE_LIST: {
+            const ListValue* lv = value.getList();
+            size_t n = lv->size();
+            appendBytes(key, &n, sizeof(n));
+            appendBytes(key, lv->values(), n * sizeof(double));
+            appendBytes(key, lv->weights(), n * sizeof(double));
+            break;
+        }
+    }
+    return interner.intern(key, this, false);
+}
+
+Expression* CategoryRefExpr::internSubexpressions(SubexpressionInterner& interner) {
+    std::string key("R");
+    key.append(categoryName.data(), categoryName.size());
+    return interner.intern(key, this, false);
+}
+
+Expression* ListExpr::internSubexpressions(SubexpressionInterner& interner) {
+    std::string key("L");
+    appendBytes(key, &elementCount, sizeof(elementCount));
+    bool shareable = true;
+    for (size_t i = 0; i < elementCount; ++i) {
+        ListElement& el = elements[i];
+        for (Expression** child : { &el.valueExpr, &el.weightExpr }) {
+            if (!*child) {
+                appendSubexpressionId(key, NO_CHILD);
+                continue;
+            }
+            *child = (*child)->internSubexpressions(interner);
+            shareable = shareable && (*child)->subexpressionId != 0;
+            appendSubexpressionId(key, (*child)->subexpressionId);
+        }
+    }
+    if (!shareable) return this;
+    return interner.intern(key, this, true);
+}
+
+Expression* OperationExpr::internSubexpressions(SubexpressionInterner& interner) {
+    std::string key("O");
+    key.append(callSite.operationName).push_back('\0');
+    appendBytes(key, &argumentCount, sizeof(argumentCount));
+    bool shareable = isPureOperation(interner.operations, callSite.operationName);
+    for (size_t i = 0; i < argumentCount; ++i) {
+        arguments[i] = arguments[i]->internSubexpressions(interner);
+        shareable = shareable && arguments[i]->subexpressionId != 0;
+        appendSubexpressionId(key, arguments[i]->subexpressionId);
+    }
+    if (!shareable) return this;
+    return interner.intern(key, this, true);
+}
+
+// fusion runs after elimination
+Expression* FusedListExpr::internSubexpressions(SubexpressionInterner& /*interner*/) {
+    return this;
+}
+
+// Symbol binding. Shared nodes are reached once per use; binding is idempotent.
+void ConstantExpr::bindSymbols(SymbolTable& /*symbols*/) {
+}
+
+void CategoryRefExpr::bindSymbols(SymbolTable& table) {
+    symbols = &table;
+    symbol = table.intern(categoryName);
+}
+
+void ListExpr::bindSymbols(SymbolTable& table) {
+    for (size_t i = 0; i < elementCount; ++i) {
+        ListElement& el = elements[i];
+        if (el.valueExpr) el.valueExpr->bindSymbols(table);
+        if (el.weightExpr) el.weightExpr->bindSymbols(table);
+    }
+}
+
+void OperationExpr::bindSymbols(SymbolTable& table) {
+    for (size_t i = 0; i < argumentCount; ++i) {
+        arguments[i]->bindSymbols(table);
+    }
+}
+
+void FusedListExpr::bindSymbols(SymbolTable& table) {
+    original->bindSymbols(table);
+}
+
+// Pipeline fusion. A call is fused when its provider declares it element-wise with this arity;
+// its list argument, once fused itself, is extended by one stage unless it is memoized, in
+// which case it stays the shared source of a new pipeline. Replaced calls stay in the arena
+// and are still used by the pipelines (see FusedListExpr).
+Expression* ConstantExpr::fuseListPipelines(ListFuser& /*fuser*/) {
+    return this;
+}
+
+Expression* CategoryRefExpr::fuseListPipelines(ListFuser& /*fuser*/) {
+    return this;
+}
+
+Expression* ListExpr::fuseListPipelines(ListFuser& fuser) {
+    for (size_t i = 0; i < elementCount; ++i) {
+        ListElement& el = elements[i];
+        if (el.valueExpr) el.valueExpr = el.valueExpr->fuseListPipelines(fuser);
+        if (el.weightExpr) el.weightExpr = el.weightExpr->fuseListPipelines(fuser);
+    }
+    return this;
+}
+
+Expression* OperationExpr::fuseListPipelines(ListFuser& fuser) {
+    auto done = fuser.replaced.find(this);
+    if (done != fuser.replaced.end()) return done->second;
+    fuser.replaced.emplace(this, this);
+    for (size_t i = 0; i < argumentCount; ++i) {
+        arguments[i] = arguments[i]->fuseListPipelines(fuser);
+    }
+    std::optional<ElementwiseOp> op = elementwiseOperation(fuser.operations, callSite.operationName);
+    if (!op || argumentCount != elementwiseParamCount(*op) + 1) return this;
+
+    // this call's parameters come first in evaluation order, then those of the inner stages
+    size_t own = argumentCount - 1;
+    Expression* list = arguments[own];
+    const FusedListExpr* inner = dynamic_cast<const FusedListExpr*>(list);
+    if (inner && inner->memoKey) inner = nullptr;
+    ListPipeline pipeline;
+    pipeline.providers = fuser.operations;
+    std::vector<Expression*> params(arguments, arguments + own);
+    if (inner) {
+        const ListPipeline& stages = inner->getPipeline();
+        for (const ListPipeline::Stage& stage : stages.stages) {
+            pipeline.stages.push_back({ stage.op, stage.firstParam + static_cast<uint32_t>(own), stage.site });
+        }
+        params.insert(params.end(), inner->getParams(), inner->getParams() + stages.paramCount);
+        list = inner->getSource();
+    }
+    pipeline.stages.push_back({ *op, 0, &callSite });
+    pipeline.paramCount = static_cast<uint32_t>(params.size());
+    ++fuser.fused;
+
+    FusedListExpr* fused = fuser.arena.makeOwned<FusedListExpr>(this, fuser.arena.copyArray(params.data(), params.size()),
+                                                                list, std::move(pipeline));
+    // a memoized call stays memoized under the same key
+    fused->subexpressionId = subexpressionId;
+    fused->memoKey = memoKey;
+    fuser.replaced[this] = fused;
+    return fused;
+}
+
+Expression* FusedListExpr::fuseListPipelines(ListFuser& /*fuser*/) {
+    return this;
+}
@@ -0,0 +1,138 @@
+#include "eval_plan.h"
+#include "dependency_graph.h"
+#include "symbol_table.h"
+#include <algorithm>
+#include <stdexcept>
+#include <unordered_set>
+
+EvalPlan::EvalPlan(const std::vector<DataProvider*>& providers, const std::vector<std::string>& targets,
+                   const SymbolTable* symbolTable)
+    : planProviders(providers), symbols(symbolTable), targetNames(targets) {
+    std::vector<const DependencyGraph*> graphs;
+    for (DataProvider* dp : providers) {
+        if (!dp) continue;
+        const DependencyGraph* graph = dp->dependencyGraph();
+        if (!graph) throw std::invalid_argument("EvalPlan needs the dependency graph of every provider");
+        graphs.push_back(graph);
+    }
+
+    // discovery: every category reachable from the targets, bound to its first definition
+    struct Node {
+        Step step;
+        std::vector<uint32_t> dependents;
+        uint32_t pending = 0;
+    };
+    std::vector<Node> nodes;
+    std::unordered_map<std::string, uint32_t> ids;
+    std::unordered_set<std::string> seenInputs;
+    std::vector<std::pair<uint32_t, std::string>> edges; // (node, name of a dependency)
+    std::vector<std::string> work(targets.rbegin(), targets.rend());
+    while (!work.empty()) {
+        std::string name = std::move(work.back());
+        work.pop_back();
+        if (ids.count(name) || seenInputs.count(name)) continue;
+        size_t g = 0;
+        std::optional<uint32_t> index;
+        for (; g < graphs.size(); ++g) {
+            index = graphs[g]->indexOf(name);
+            if (index) break;
+        }
+        if (!index) {
+            seenInputs.insert(name);
+            continue;
+        }
+        size_t p = 0;
+        for (size_t seen = 0; p < providers.size(); ++p) {
+            if (providers[p] && seen++ == g) break;
+        }
+        uint32_t id = static_cast<uint32_t>(nodes.size());
+        auto symbol = symbols ? symbols->find(name) : std::nullopt;
+        nodes.push_back({ { name, providers[p], *index, symbol ? *symbol : SymbolTable::NO_SYMBOL }, {}, 0 });
+        ids.emplace(name, id);
+        for (uint32_t dep : graphs[g]->dependencies(*index)) {
+            edges.emplace_back(id, std::string(graphs[g]->name(dep)));
+            work.emplace_back(graphs[g]->name(dep));
+        }
+        // names external to this provider may be defined by another one, or be inputs
+        for (uint32_t ext : graphs[g]->externalDependencies(*index)) {
+            const std::string& dep = graphs[g]->externalNames()[ext];
+            edges.emplace_back(id, dep);
+            work.push_back(dep);
+        }
+    }
+    for (const auto& edge : edges) {
+        auto it = ids.find(edge.second);
+        if (it == ids.end()) continue;
+        nodes[it->second].dependents.push_back(edge.first);
+        ++nodes[edge.first].pending;
+    }
+
+    // Kahn's algorithm in discovery order; nodes on or behind a cycle never become ready
+    std::vector<uint32_t> ready;
+    for (uint32_t id = 0; id < nodes.size(); ++id) {
+        if (nodes[id].pending == 0) ready.push_back(id);
+    }
+    for (size_t head = 0; head < ready.size(); ++head) {
+        for (uint32_t user : nodes[ready[head]].dependents) {
+            if (--nodes[user].pending == 0) ready.push_back(user);
+        }
+    }
+    cyclic = nodes.size() - ready.size();
+    std::vector<uint32_t> slotOfNode(nodes.size(), NO_SLOT);
+    for (uint32_t slot = 0; slot < ready.size(); ++slot) slotOfNode[ready[slot]] = slot;
+    planSteps.reserve(ready.size());
+    for (uint32_t id : ready) planSteps.push_back(std::move(nodes[id].step));
+    // the keys view the step names, which no longer move
+    for (uint32_t slot = 0; slot < planSteps.size(); ++slot) {
+        slots.emplace(planSteps[slot].name, slot);
+    }
+    targetSlots.reserve(targets.size());
+    for (const std::string& target : targets) {
+        auto slot = slotOf(target);
+        targetSlots.push_back(slot ? *slot : NO_SLOT);
+    }
+    inputNames.assign(seenInputs.begin(), seenInputs.end());
+    std::sort(inputNames.begin(), inputNames.end());
+
+    // the edges of the steps that made it into the plan, by slot
+    stepDependencies.resize(planSteps.size());
+    stepInputs.resize(planSteps.size());
+    for (const auto& edge : edges) {
+        uint32_t slot = slotOfNode[edge.first];
+        if (slot == NO_SLOT) continue;
+        auto it = ids.find(edge.second);
+        if (it != ids.end()) {
+            stepDependencies[slot].push_back(slotOfNode[it->second]);
+        } else {
+            auto input = std::lower_bound(inputNames.begin(), inputNames.end(), edge.second);
+            stepInputs[slot].push_back(static_cast<uint32_t>(input - inputNames.begin()));
+        }
+    }
+}
+
+std::vector<char> EvalPlan::dependentsOf(const std::vector<std::string>& names) const {
+    std::vector<char> dependent(planSteps.size(), 0);
+    std::vector<char> inputHit(inputNames.size(), 0);
+    for (const std::string& name : names) {
+        if (auto slot = slotOf(name)) dependent[*slot] = 1;
+        auto input = std::lower_bound(inputNames.begin(), inputNames.end(), name);
+        if (input != inputNames.end() && *input == name) inputHit[input - inputNames.begin()] = 1;
+    }
+    // dependencies come first, so one pass in slot order sees them decided
+    for (uint32_t slot = 0; slot < planSteps.size(); ++slot) {
+        if (dependent[slot]) continue;
+        for (uint32_t dep : stepDependencies[slot]) {
+            if (dependent[dep]) dependent[slot] = 1;
+        }
+        for (uint32_t input : stepInputs[slot]) {
+            if (inputHit[input]) dependent[slot] = 1;
+        }
+    }
+    return dependent;
+}
+
+std::optional<uint32_t> EvalPlan::slotOf(std::string_view name) const {
+    auto it = slots.find(name);
+    if (it == slots.end()) return std::nullopt;
+    return it->second;
+}
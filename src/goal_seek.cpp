@@ -0,0 +1,50 @@
+#include "goal_seek.h"
+
+// The target's grade with the input set to x, evaluated in a throwaway fork of ctx.
+static double probe(Context& ctx, const std::string& input, const std::string& target, double x, GoalSeekResult& result) {
+    Context* fork = ctx.fork();
+    double value;
+    try {
+        fork->setCategoryValue(input, new GradeValue(x));
+        value = Datum::fromValue(fork->getCategoryValue(target)).toGrade();
+    } catch (...) {
+        delete fork;
+        throw;
+    }
+    ++result.probes;
+    result.recomputed += fork->recomputedCount();
+    delete fork;
+    return value;
+}
+
+GoalSeekResult goalSeek(Context& ctx, const std::string& input, const std::string& target, double goal,
+                        double low, double high, double tolerance) {
+    GoalSeekResult result;
+    // everything the target needs is cached once here and inherited by every probe
+    ctx.getCategoryValue(target);
+    // NaN compares false, so an undefined target never reaches the goal
+    double atHigh = probe(ctx, input, target, high, result);
+    result.input = high;
+    result.value = atHigh;
+    if (!(atHigh >= goal)) return result;
+    result.reached = true;
+    double atLow = probe(ctx, input, target, low, result);
+    if (atLow >= goal) {
+        result.input = low;
+        result.value = atLow;
+        return result;
+    }
+    // invariant: low misses the goal, high reaches it
+    while (high - low > tolerance) {
+        double mid = low + (high - low) / 2;
+        double atMid = probe(ctx, input, target, mid, result);
+        if (atMid >= goal) {
+            high = mid;
+            result.input = mid;
+            result.value = atMid;
+        } else {
+            low = mid;
+        }
+    }
+    return result;
+}
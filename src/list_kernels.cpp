@@ -0,0 +1,432 @@
+#include "list_kernels.h"
+#include <atomic>
+#include <limits>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define LIST_KERNELS_X86 1
+#include <immintrin.h>
+#endif
+
+// weightedSums keeps WEIGHTED_SUM_LANES partial sums, one per AVX2 lane; the other versions
+// accumulate in the same lanes so that every version rounds identically
+static const size_t SUM_LANES = WEIGHTED_SUM_LANES;
+static_assert(SUM_LANES == 4, "the vector kernels accumulate four lanes");
+
+static double reduceLanes(const double* lanes) {
+    return (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+}
+
+// Scalar versions; also used for the tails of the vector versions.
+static void clampScalar(double* v, size_t begin, size_t n, double lo, double hi) {
+    for (size_t i = begin; i < n; ++i) {
+        double x = v[i];
+        v[i] = x < lo ? lo : (x > hi ? hi : x);
+    }
+}
+
+static void raiseToScalar(double* v, size_t begin, size_t n, double threshold) {
+    for (size_t i = begin; i < n; ++i) {
+        v[i] = v[i] < threshold ? threshold : v[i];
+    }
+}
+
+static void lowerToScalar(double* v, size_t begin, size_t n, double threshold) {
+    for (size_t i = begin; i < n; ++i) {
+        v[i] = v[i] > threshold ? threshold : v[i];
+    }
+}
+
+static void mapScalar(double* v, size_t begin, size_t n, double srcStart, double srcRange, double dstStart, double dstRange) {
+    // undefined values stay NaN through the arithmetic
+    for (size_t i = begin; i < n; ++i) {
+        v[i] = dstStart + ((v[i] - srcStart) / srcRange) * dstRange;
+    }
+}
+
+static void fillDefinedScalar(double* v, size_t begin, size_t n, double value) {
+    for (size_t i = begin; i < n; ++i) {
+        v[i] = v[i] == v[i] ? value : v[i];
+    }
+}
+
+static void resolveScalar(double* v, size_t begin, size_t n, double value) {
+    for (size_t i = begin; i < n; ++i) {
+        v[i] = v[i] != v[i] ? value : v[i];
+    }
+}
+
+static void weightedSumsScalar(const double* v, const double* w, size_t begin, size_t n, double* weighted, double* total) {
+    for (size_t i = begin; i < n; ++i) {
+        if (v[i] == v[i]) {
+            weighted[i % SUM_LANES] += v[i] * w[i];
+            total[i % SUM_LANES] += w[i];
+        }
+    }
+}
+
+static void extremesScalar(const double* v, size_t begin, size_t n, double* lo, double* hi, double* count) {
+    for (size_t i = begin; i < n; ++i) {
+        double x = v[i];
+        if (x == x) {
+            size_t lane = i % SUM_LANES;
+            lo[lane] = x < lo[lane] ? x : lo[lane];
+            hi[lane] = x > hi[lane] ? x : hi[lane];
+            count[lane] += 1.0;
+        }
+    }
+}
+
+struct KernelTable {
+    void (*clamp)(double*, size_t, double, double);
+    void (*raiseTo)(double*, size_t, double);
+    void (*lowerTo)(double*, size_t, double);
+    void (*map)(double*, size_t, double, double, double, double);
+    void (*fillDefined)(double*, size_t, double);
+    void (*resolve)(double*, size_t, double);
+    void (*weightedSums)(const double*, const double*, size_t, double*, double*);
+    void (*extremes)(const double*, size_t, double*, double*, double*);
+};
+
+static const KernelTable scalarKernels = {
+    [](double* v, size_t n, double lo, double hi) { clampScalar(v, 0, n, lo, hi); },
+    [](double* v, size_t n, double t) { raiseToScalar(v, 0, n, t); },
+    [](double* v, size_t n, double t) { lowerToScalar(v, 0, n, t); },
+    [](double* v, size_t n, double s, double sr, double d, double dr) { mapScalar(v, 0, n, s, sr, d, dr); },
+    [](double* v, size_t n, double x) { fillDefinedScalar(v, 0, n, x); },
+    [](double* v, size_t n, double x) { resolveScalar(v, 0, n, x); },
+    [](const double* v, const double* w, size_t n, double* weighted, double* total) {
+        weightedSumsScalar(v, w, 0, n, weighted, total);
+    },
+    [](const double* v, size_t n, double* lo, double* hi, double* count) {
+        extremesScalar(v, 0, n, lo, hi, count);
+    },
+};
+
+#ifdef LIST_KERNELS_X86
+// SSE2: two registers of two lanes stand in for one AVX2 register.
+static inline __m128d select2(__m128d mask, __m128d ifSet, __m128d ifClear) {
+    return _mm_or_pd(_mm_and_pd(mask, ifSet), _mm_andnot_pd(mask, ifClear));
+}
+
+static void clampSse2(double* v, size_t n, double lo, double hi) {
+    __m128d vlo = _mm_set1_pd(lo), vhi = _mm_set1_pd(hi);
+    size_t i = 0;
+    for (; i + 2 <= n; i += 2) {
+        __m128d x = _mm_loadu_pd(v + i);
+        __m128d upper = select2(_mm_cmpgt_pd(x, vhi), vhi, x);
+        _mm_storeu_pd(v + i, select2(_mm_cmplt_pd(x, vlo), vlo, upper));
+    }
+    clampScalar(v, i, n, lo, hi);
+}
+
+static void raiseToSse2(double* v, size_t n, double threshold) {
+    __m128d t = _mm_set1_pd(threshold);
+    size_t i = 0;
+    for (; i + 2 <= n; i += 2) {
+        __m128d x = _mm_loadu_pd(v + i);
+        _mm_storeu_pd(v + i, select2(_mm_cmplt_pd(x, t), t, x));
+    }
+    raiseToScalar(v, i, n, threshold);
+}
+
+static void lowerToSse2(double* v, size_t n, double threshold) {
+    __m128d t = _mm_set1_pd(threshold);
+    size_t i = 0;
+    for (; i + 2 <= n; i += 2) {
+        __m128d x = _mm_loadu_pd(v + i);
+        _mm_storeu_pd(v + i, select2(_mm_cmpgt_pd(x, t), t, x));
+    }
+    lowerToScalar(v, i, n, threshold);
+}
+
+static void mapSse2(double* v, size_t n, double srcStart, double srcRange, double dstStart, double dstRange) {
+    __m128d s = _mm_set1_pd(srcStart), sr = _mm_set1_pd(srcRange);
+    __m128d d = _mm_set1_pd(dstStart), dr = _mm_set1_pd(dstRange);
+    size_t i = 0;
+    for (; i + 2 <= n; i += 2) {
+        __m128d x = _mm_loadu_pd(v + i);
+        _mm_storeu_pd(v + i, _mm_add_pd(d, _mm_mul_pd(_mm_div_pd(_mm_sub_pd(x, s), sr), dr)));
+    }
+    mapScalar(v, i, n, srcStart, srcRange, dstStart, dstRange);
+}
+
+static void fillDefinedSse2(double* v, size_t n, double value) {
+    __m128d c = _mm_set1_pd(value);
+    size_t i = 0;
+    for (; i + 2 <= n; i += 2) {
+        __m128d x = _mm_loadu_pd(v + i);
+        _mm_storeu_pd(v + i, select2(_mm_cmpord_pd(x, x), c, x));
+    }
+    fillDefinedScalar(v, i, n, value);
+}
+
+static void resolveSse2(double* v, size_t n, double value) {
+    __m128d c = _mm_set1_pd(value);
+    size_t i = 0;
+    for (; i + 2 <= n; i += 2) {
+        __m128d x = _mm_loadu_pd(v + i);
+        _mm_storeu_pd(v + i, select2(_mm_cmpunord_pd(x, x), c, x));
+    }
+    resolveScalar(v, i, n, value);
+}
+
+static void weightedSumsSse2(const double* v, const double* w, size_t n, double* weighted, double* total) {
+    __m128d weightedLo = _mm_loadu_pd(weighted), weightedHi = _mm_loadu_pd(weighted + 2);
+    __m128d totalLo = _mm_loadu_pd(total), totalHi = _mm_loadu_pd(total + 2);
+    size_t i = 0;
+    for (; i + SUM_LANES <= n; i += SUM_LANES) {
+        __m128d xLo = _mm_loadu_pd(v + i), xHi = _mm_loadu_pd(v + i + 2);
+        __m128d wLo = _mm_loadu_pd(w + i), wHi = _mm_loadu_pd(w + i + 2);
+        __m128d definedLo = _mm_cmpord_pd(xLo, xLo), definedHi = _mm_cmpord_pd(xHi, xHi);
+        weightedLo = _mm_add_pd(weightedLo, _mm_and_pd(definedLo, _mm_mul_pd(xLo, wLo)));
+        weightedHi = _mm_add_pd(weightedHi, _mm_and_pd(definedHi, _mm_mul_pd(xHi, wHi)));
+        totalLo = _mm_add_pd(totalLo, _mm_and_pd(definedLo, wLo));
+        totalHi = _mm_add_pd(totalHi, _mm_and_pd(definedHi, wHi));
+    }
+    _mm_storeu_pd(weighted, weightedLo);
+    _mm_storeu_pd(weighted + 2, weightedHi);
+    _mm_storeu_pd(total, totalLo);
+    _mm_storeu_pd(total + 2, totalHi);
+    weightedSumsScalar(v, w, i, n, weighted, total);
+}
+
+// min and max return their second operand when the first is NaN, so undefined values never
+// replace an extreme
+static void extremesSse2(const double* v, size_t n, double* lo, double* hi, double* count) {
+    __m128d loLo = _mm_loadu_pd(lo), loHi = _mm_loadu_pd(lo + 2);
+    __m128d hiLo = _mm_loadu_pd(hi), hiHi = _mm_loadu_pd(hi + 2);
+    __m128d countLo = _mm_loadu_pd(count), countHi = _mm_loadu_pd(count + 2);
+    __m128d one = _mm_set1_pd(1.0);
+    size_t i = 0;
+    for (; i + SUM_LANES <= n; i += SUM_LANES) {
+        __m128d xLo = _mm_loadu_pd(v + i), xHi = _mm_loadu_pd(v + i + 2);
+        loLo = _mm_min_pd(xLo, loLo);
+        loHi = _mm_min_pd(xHi, loHi);
+        hiLo = _mm_max_pd(xLo, hiLo);
+        hiHi = _mm_max_pd(xHi, hiHi);
+        countLo = _mm_add_pd(countLo, _mm_and_pd(_mm_cmpord_pd(xLo, xLo), one));
+        countHi = _mm_add_pd(countHi, _mm_and_pd(_mm_cmpord_pd(xHi, xHi), one));
+    }
+    _mm_storeu_pd(lo, loLo);
+    _mm_storeu_pd(lo + 2, loHi);
+    _mm_storeu_pd(hi, hiLo);
+    _mm_storeu_pd(hi + 2, hiHi);
+    _mm_storeu_pd(count, countLo);
+    _mm_storeu_pd(count + 2, countHi);
+    extremesScalar(v, i, n, lo, hi, count);
+}
+
+static const KernelTable sse2Kernels = {
+    clampSse2, raiseToSse2, lowerToSse2, mapSse2, fillDefinedSse2, resolveSse2, weightedSumsSse2, extremesSse2,
+};
+
+#define AVX2_KERNEL __attribute__((target("avx2")))
+
+AVX2_KERNEL static void clampAvx2(double* v, size_t n, double lo, double hi) {
+    __m256d vlo = _mm256_set1_pd(lo), vhi = _mm256_set1_pd(hi);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m256d x = _mm256_loadu_pd(v + i);
+        __m256d upper = _mm256_blendv_pd(x, vhi, _mm256_cmp_pd(x, vhi, _CMP_GT_OQ));
+        _mm256_storeu_pd(v + i, _mm256_blendv_pd(upper, vlo, _mm256_cmp_pd(x, vlo, _CMP_LT_OQ)));
+    }
+    clampScalar(v, i, n, lo, hi);
+}
+
+AVX2_KERNEL static void raiseToAvx2(double* v, size_t n, double threshold) {
+    __m256d t = _mm256_set1_pd(threshold);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m256d x = _mm256_loadu_pd(v + i);
+        _mm256_storeu_pd(v + i, _mm256_blendv_pd(x, t, _mm256_cmp_pd(x, t, _CMP_LT_OQ)));
+    }
+    raiseToScalar(v, i, n, threshold);
+}
+
+AVX2_KERNEL static void lowerToAvx2(double* v, size_t n, double threshold) {
+    __m256d t = _mm256_set1_pd(threshold);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m256d x = _mm256_loadu_pd(v + i);
+        _mm256_storeu_pd(v + i, _mm256_blendv_pd(x, t, _mm256_cmp_pd(x, t, _CMP_GT_OQ)));
+    }
+    lowerToScalar(v, i, n, threshold);
+}
+
+AVX2_KERNEL static void mapAvx2(double* v, size_t n, double srcStart, double srcRange, double dstStart, double dstRange) {
+    __m256d s = _mm256_set1_pd(srcStart), sr = _mm256_set1_pd(srcRange);
+    __m256d d = _mm256_set1_pd(dstStart), dr = _mm256_set1_pd(dstRange);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m256d x = _mm256_loadu_pd(v + i);
+        _mm256_storeu_pd(v + i, _mm256_add_pd(d, _mm256_mul_pd(_mm256_div_pd(_mm256_sub_pd(x, s), sr), dr)));
+    }
+    mapScalar(v, i, n, srcStart, srcRange, dstStart, dstRange);
+}
+
+AVX2_KERNEL static void fillDefinedAvx2(double* v, size_t n, double value) {
+    __m256d c = _mm256_set1_pd(value);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m256d x = _mm256_loadu_pd(v + i);
+        _mm256_storeu_pd(v + i, _mm256_blendv_pd(x, c, _mm256_cmp_pd(x, x, _CMP_ORD_Q)));
+    }
+    fillDefinedScalar(v, i, n, value);
+}
+
+AVX2_KERNEL static void resolveAvx2(double* v, size_t n, double value) {
+    __m256d c = _mm256_set1_pd(value);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m256d x = _mm256_loadu_pd(v + i);
+        _mm256_storeu_pd(v + i, _mm256_blendv_pd(x, c, _mm256_cmp_pd(x, x, _CMP_UNORD_Q)));
+    }
+    resolveScalar(v, i, n, value);
+}
+
+AVX2_KERNEL static void weightedSumsAvx2(const double* v, const double* w, size_t n, double* weighted, double* total) {
+    __m256d weightedAcc = _mm256_loadu_pd(weighted), totalAcc = _mm256_loadu_pd(total);
+    size_t i = 0;
+    for (; i + SUM_LANES <= n; i += SUM_LANES) {
+        __m256d x = _mm256_loadu_pd(v + i);
+        __m256d wt = _mm256_loadu_pd(w + i);
+        __m256d defined = _mm256_cmp_pd(x, x, _CMP_ORD_Q);
+        weightedAcc = _mm256_add_pd(weightedAcc, _mm256_and_pd(defined, _mm256_mul_pd(x, wt)));
+        totalAcc = _mm256_add_pd(totalAcc, _mm256_and_pd(defined, wt));
+    }
+    _mm256_storeu_pd(weighted, weightedAcc);
+    _mm256_storeu_pd(total, totalAcc);
+    weightedSumsScalar(v, w, i, n, weighted, total);
+}
+
+AVX2_KERNEL static void extremesAvx2(const double* v, size_t n, double* lo, double* hi, double* count) {
+    __m256d loAcc = _mm256_loadu_pd(lo), hiAcc = _mm256_loadu_pd(hi), countAcc = _mm256_loadu_pd(count);
+    __m256d one = _mm256_set1_pd(1.0);
+    size_t i = 0;
+    for (; i + SUM_LANES <= n; i += SUM_LANES) {
+        __m256d x = _mm256_loadu_pd(v + i);
+        loAcc = _mm256_min_pd(x, loAcc);
+        hiAcc = _mm256_max_pd(x, hiAcc);
+        countAcc = _mm256_add_pd(countAcc, _mm256_and_pd(_mm256_cmp_pd(x, x, _CMP_ORD_Q), one));
+    }
+    _mm256_storeu_pd(lo, loAcc);
+    _mm256_storeu_pd(hi, hiAcc);
+    _mm256_storeu_pd(count, countAcc);
+    extremesScalar(v, i, n, lo, hi, count);
+}
+
+static const KernelTable avx2Kernels = {
+    clampAvx2, raiseToAvx2, lowerToAvx2, mapAvx2, fillDefinedAvx2, resolveAvx2, weightedSumsAvx2, extremesAvx2,
+};
+#endif
+
+static const KernelTable* tableFor(SimdLevel level) {
+#ifdef LIST_KERNELS_X86
+    if (level == SimdLevel::AVX2) return &avx2Kernels;
+    if (level == SimdLevel::SSE2) return &sse2Kernels;
+#endif
+    (void)level;
+    return &scalarKernels;
+}
+
+// chosen on first use rather than during static initialization, which may run before the
+// CPU feature data is set up or before other translation units use the kernels
+static std::atomic<SimdLevel> activeLevel(SimdLevel::SCALAR);
+static std::atomic<const KernelTable*> activeTable(nullptr);
+
+SimdLevel supportedSimdLevel() {
+#ifdef LIST_KERNELS_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) return SimdLevel::AVX2;
+    if (__builtin_cpu_supports("sse2")) return SimdLevel::SSE2;
+#endif
+    return SimdLevel::SCALAR;
+}
+
+static const KernelTable& kernels();
+
+SimdLevel activeSimdLevel() {
+    kernels();
+    return activeLevel.load(std::memory_order_relaxed);
+}
+
+SimdLevel setSimdLevel(SimdLevel level) {
+    SimdLevel supported = supportedSimdLevel();
+    if (static_cast<int>(level) > static_cast<int>(supported)) level = supported;
+    activeLevel.store(level, std::memory_order_relaxed);
+    activeTable.store(tableFor(level), std::memory_order_relaxed);
+    return level;
+}
+
+const char* simdLevelName(SimdLevel level) {
+    switch (level) {
+        case SimdLevel::SCALAR: return "scalar";
+        case SimdLevel::SSE2: return "sse2";
+        case SimdLevel::AVX2: return "avx2";
+    }
+    return "unknown";
+}
+
+static const KernelTable& kernels() {
+    const KernelTable* table = activeTable.load(std::memory_order_relaxed);
+    if (!table) {
+        // racing first calls all store the same choice
+        setSimdLevel(supportedSimdLevel());
+        table = activeTable.load(std::memory_order_relaxed);
+    }
+    return *table;
+}
+
+void clampValues(double* values, size_t n, double lo, double hi) {
+    kernels().clamp(values, n, lo, hi);
+}
+
+void raiseToValues(double* values, size_t n, double threshold) {
+    kernels().raiseTo(values, n, threshold);
+}
+
+void lowerToValues(double* values, size_t n, double threshold) {
+    kernels().lowerTo(values, n, threshold);
+}
+
+void mapValues(double* values, size_t n, double srcStart, double srcRange, double dstStart, double dstRange) {
+    kernels().map(values, n, srcStart, srcRange, dstStart, dstRange);
+}
+
+void fillDefinedValues(double* values, size_t n, double value) {
+    kernels().fillDefined(values, n, value);
+}
+
+void resolveValues(double* values, size_t n, double value) {
+    kernels().resolve(values, n, value);
+}
+
+void weightedSums(const double* values, const double* weights, size_t n, double& weightedTotal, double& totalWeight) {
+    double weighted[SUM_LANES] = {0, 0, 0, 0};
+    double total[SUM_LANES] = {0, 0, 0, 0};
+    kernels().weightedSums(values, weights, n, weighted, total);
+    reduceWeightedSums(weighted, total, weightedTotal, totalWeight);
+}
+
+void accumulateWeightedSums(const double* values, const double* weights, size_t n, double* weightedLanes, double* totalLanes) {
+    kernels().weightedSums(values, weights, n, weightedLanes, totalLanes);
+}
+
+void reduceWeightedSums(const double* weightedLanes, const double* totalLanes, double& weightedTotal, double& totalWeight) {
+    weightedTotal = reduceLanes(weightedLanes);
+    totalWeight = reduceLanes(totalLanes);
+}
+
+void definedExtremes(const double* values, size_t n, double& minValue, double& maxValue, size_t& count) {
+    const double inf = std::numeric_limits<double>::infinity();
+    double lo[SUM_LANES] = {inf, inf, inf, inf};
+    double hi[SUM_LANES] = {-inf, -inf, -inf, -inf};
+    double counts[SUM_LANES] = {0, 0, 0, 0};
+    kernels().extremes(values, n, lo, hi, counts);
+    // lanes combine in a fixed order, so every version picks the same zero of either sign
+    double lo01 = lo[1] < lo[0] ? lo[1] : lo[0], lo23 = lo[3] < lo[2] ? lo[3] : lo[2];
+    double hi01 = hi[1] > hi[0] ? hi[1] : hi[0], hi23 = hi[3] > hi[2] ? hi[3] : hi[2];
+    count = static_cast<size_t>(reduceLanes(counts));
+    minValue = count ? (lo23 < lo01 ? lo23 : lo01) : std::numeric_limits<double>::quiet_NaN();
+    maxValue = count ? (hi23 > hi01 ? hi23 : hi01) : std::numeric_limits<double>::quiet_NaN();
+}
@@ -0,0 +1,131 @@
+#include "list_pipeline.h"
+#include "list_kernels.h"
+#include <algorithm>
+#include <limits>
+
+// Lists are fused in blocks of this many entries (16 KiB of values and weights), small enough
+// for every stage to find the block in L1 again. A multiple of WEIGHTED_SUM_LANES, so that
+// block sums continue the lanes of a whole-list weightedSums.
+static const size_t BLOCK_SIZE = 1024;
+static_assert(BLOCK_SIZE % WEIGHTED_SUM_LANES == 0, "blocks must keep the lanes of weightedSums");
+
+size_t elementwiseParamCount(ElementwiseOp op) {
+    switch (op) {
+        case ElementwiseOp::RESOLVE: return 1;
+        case ElementwiseOp::CLAMP: return 2;
+        case ElementwiseOp::RAISE_TO: return 1;
+        case ElementwiseOp::LOWER_TO: return 1;
+        case ElementwiseOp::MAP: return 4;
+    }
+    return 0;
+}
+
+const char* elementwiseOpName(ElementwiseOp op) {
+    switch (op) {
+        case ElementwiseOp::RESOLVE: return "resolve";
+        case ElementwiseOp::CLAMP: return "clamp";
+        case ElementwiseOp::RAISE_TO: return "raiseTo";
+        case ElementwiseOp::LOWER_TO: return "lowerTo";
+        case ElementwiseOp::MAP: return "map";
+    }
+    return "?";
+}
+
+void applyElementwise(ElementwiseOp op, const double* params, double* values, size_t n) {
+    switch (op) {
+        case ElementwiseOp::RESOLVE:
+            resolveValues(values, n, params[0]);
+            break;
+        case ElementwiseOp::CLAMP:
+            clampValues(values, n, params[0], params[1]);
+            break;
+        case ElementwiseOp::RAISE_TO:
+            raiseToValues(values, n, params[0]);
+            break;
+        case ElementwiseOp::LOWER_TO:
+            lowerToValues(values, n, params[0]);
+            break;
+        case ElementwiseOp::MAP: {
+            double srcRange = params[1] - params[0];
+            double dstRange = params[3] - params[2];
+            if (srcRange == 0.0) {
+                // If source range is zero, set all defined values to the midpoint of the destination range
+                fillDefinedValues(values, n, params[2] + dstRange / 2.0);
+            } else {
+                mapValues(values, n, params[0], srcRange, params[2], dstRange);
+            }
+            break;
+        }
+    }
+}
+
+// Whether the pipeline may run fused for this source: the stages' operations are the ones it
+// was built for and the source is a list. Otherwise the original calls run.
+static bool runsFused(const ListPipeline& pipeline, const Datum& source, Context* ctx) {
+    return source.getType() == DataType::TYPE_LIST && ctx && ctx->operationProviders == pipeline.providers;
+}
+
+// The unfused calls, one stage after the other.
+static Datum runStages(const ListPipeline& pipeline, Datum source, Datum* params, Context* ctx) {
+    std::vector<Datum> args;
+    for (const ListPipeline::Stage& stage : pipeline.stages) {
+        args.clear();
+        size_t count = elementwiseParamCount(stage.op);
+        for (size_t i = 0; i < count; ++i) {
+            args.push_back(std::move(params[stage.firstParam + i]));
+        }
+        args.push_back(std::move(source));
+        source = stage.site->invoke(ctx, args);
+    }
+    return source;
+}
+
+// Converts the parameters like the native operations convert their grade arguments.
+static std::vector<double> gradeParams(const ListPipeline& pipeline, Datum* params) {
+    std::vector<double> grades(pipeline.paramCount);
+    for (size_t i = 0; i < grades.size(); ++i) {
+        grades[i] = params[i].toGrade();
+    }
+    return grades;
+}
+
+static void applyStages(const ListPipeline& pipeline, const double* grades, double* values, size_t n) {
+    for (const ListPipeline::Stage& stage : pipeline.stages) {
+        applyElementwise(stage.op, grades + stage.firstParam, values, n);
+    }
+}
+
+Datum runListPipeline(const ListPipeline& pipeline, Datum source, Datum* params, Context* ctx) {
+    if (!runsFused(pipeline, source, ctx)) return runStages(pipeline, std::move(source), params, ctx);
+    std::vector<double> grades = gradeParams(pipeline, params);
+    ListValue* lv = source.getList();
+    size_t n = lv->size();
+    // one copy-on-write clone at most, then every block goes through all stages in place
+    double* values = lv->mutableValues();
+    for (size_t begin = 0; begin < n; begin += BLOCK_SIZE) {
+        applyStages(pipeline, grades.data(), values + begin, std::min(BLOCK_SIZE, n - begin));
+    }
+    return source;
+}
+
+double runListPipelineMean(const ListPipeline& pipeline, Datum source, Datum* params, Context* ctx) {
+    if (!runsFused(pipeline, source, ctx)) return runStages(pipeline, std::move(source), params, ctx).toGrade();
+    std::vector<double> grades = gradeParams(pipeline, params);
+    const ListValue* lv = source.getList();
+    size_t n = lv->size();
+    // the source is only read: each block is transformed in a scratch buffer and summed
+    double block[BLOCK_SIZE];
+    double weighted[WEIGHTED_SUM_LANES] = {0, 0, 0, 0};
+    double total[WEIGHTED_SUM_LANES] = {0, 0, 0, 0};
+    for (size_t begin = 0; begin < n; begin += BLOCK_SIZE) {
+        size_t count = std::min(BLOCK_SIZE, n - begin);
+        std::copy(lv->values() + begin, lv->values() + begin + count, block);
+        applyStages(pipeline, grades.data(), block, count);
+        accumulateWeightedSums(block, lv->weights() + begin, count, weighted, total);
+    }
+    double weightedTotal, totalWeight;
+    reduceWeightedSums(weighted, total, weightedTotal, totalWeight);
+    // as ListValue::weightedMean
+    if (totalWeight == 0.0) return std::numeric_limits<double>::quiet_NaN();
+    return weightedTotal / totalWeight;
+}
@@ -0,0 +1,77 @@
+#include "loader.h"
+#include "parser.h"
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <string_view>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Closes the file descriptor and unmaps the file on every exit path, including parse errors.
+class MappedFile {
+private:
+    int fd;
+    void* data;
+    size_t length;
+public:
+    MappedFile(int fileDescriptor) : fd(fileDescriptor), data(MAP_FAILED), length(0) {}
+    ~MappedFile() {
+        if (data != MAP_FAILED) munmap(data, length);
+        if (fd >= 0) close(fd);
+    }
+    bool map(size_t size) {
+        data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data == MAP_FAILED) return false;
+        length = size;
+        // the parser reads the file front to back exactly once
+        madvise(data, length, MADV_SEQUENTIAL);
+        return true;
+    }
+    std::string_view view() const {
+        return std::string_view(static_cast<const char*>(data), length);
+    }
+};
+
+static std::runtime_error fileError(const std::string& what) {
+    return std::runtime_error(what + ": " + std::strerror(errno));
+}
+
+// Streaming fallback for pipes, character devices and files that cannot be mapped.
+static std::string readAll(int fd) {
+    std::string buffer;
+    char chunk[1 << 16];
+    while (true) {
+        ssize_t n = read(fd, chunk, sizeof(chunk));
+        if (n == 0) break;
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            throw fileError("Failed to read file");
+        }
+        buffer.append(chunk, static_cast<size_t>(n));
+    }
+    return buffer;
+}
+
+Program* loadProgramFile(const std::string& path) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw fileError("Failed to open file");
+    }
+    MappedFile file(fd);
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        throw fileError("Failed to stat file");
+    }
+    if (S_ISREG(st.st_mode)) {
+        if (st.st_size == 0) {
+            return parseProgram(std::string_view());
+        }
+        if (file.map(static_cast<size_t>(st.st_size))) {
+            return parseProgram(file.view());
+        }
+    }
+    std::string contents = readAll(fd);
+    return parseProgram(contents);
+}
@@ -1,8 +1,11 @@
 #include "operations.h"
-#include <queue>
+#include "list_kernels.h"
+#include "list_pipeline.h"
+#include <algorithm>
 #include <cmath>
 #include <functional>
 #include <iterator>
+#include <limits>
 
 // modify the list by dropping the lowest n values from the given list,
 // ignoring undefined values (NaN) and taking weights into account.
@@ -11,39 +14,34 @@ ListValue* drop(unsigned long long n, ListValue* lv) {
         return lv;
     }
 
-    // Min-heap to store the lowest n values
-    auto cmp = [](const std::pair<double, size_t>& a, const std::pair<double, size_t>& b) {
-        return a.first < b.first; // Min-heap based on value
-    };
-    std::priority_queue<std::pair<double, size_t>, std::vector<std::pair<double, size_t>>, decltype(cmp)> minHeap(cmp);
-
-    ListValueIterator it(lv);
-    size_t index = 0;
-    while (it.hasNext()) {
-        double value = it.getValue();
-        if (!std::isnan(value)) {
-            minHeap.emplace(value, index);
-            if (minHeap.size() > n) {
-                minHeap.pop();
-            }
-        }
-        it.advance();
-        index++;
+    // select the n-th lowest defined value; everything below it is dropped
+    std::vector<double> defined;
+    defined.reserve(lv->size());
+    const double* values = lv->values();
+    for (size_t i = 0; i < lv->size(); ++i) {
+        if (!std::isnan(values[i])) defined.push_back(values[i]);
     }
-
-    // Collect indices to remove
-    std::vector<size_t> indicesToRemove;
-    while (!minHeap.empty()) {
-        indicesToRemove.push_back(minHeap.top().second);
-        minHeap.pop();
+    if (defined.empty()) {
+        return lv;
     }
-    std::sort(indicesToRemove.begin(), indicesToRemove.end(), std::greater<size_t>());
-
-    // Remove elements from the list in reverse order
-    for (size_t idx : indicesToRemove) {
-        lv->removeAt(idx);
+    if (n >= defined.size()) {
+        lv->retainIf([](double value) { return std::isnan(value); });
+        return lv;
     }
-
+    auto nth = defined.begin() + static_cast<std::ptrdiff_t>(n - 1);
+    std::nth_element(defined.begin(), nth, defined.end());
+    double threshold = *nth;
+    size_t below = static_cast<size_t>(std::count_if(defined.begin(), nth, [&](double v) { return v < threshold; }));
+
+    // of the values equal to the threshold, the earliest are dropped and the latest kept
+    size_t tiesToDrop = n - below;
+    lv->retainIf([&](double value) {
+        if (std::isnan(value) || value > threshold) return true;
+        if (value < threshold) return false;
+        if (tiesToDrop == 0) return true;
+        --tiesToDrop;
+        return false;
+    });
     return lv;
 }
 
@@ -56,73 +54,36 @@ ListValue* top(unsigned long long n,  ListValue* lv) {
 // join modifies a list by extending it with the contents of another list by concatenating the two given listValues.
 // Either argument is deleted after joining.
 ListValue* join(ListValue* lv1, ListValue* lv2) {
-    ListValueIterator it2(lv2);
-
-    while (it2.hasNext()) {
-        lv1->addValue(it2.getValue(), it2.getWeight());
-        it2.advance();
-    }
-
+    lv1->append(*lv2);
     delete lv2;
     return lv1;
 }
 
+// The element-wise operations below share their kernels with fused pipelines (see list_pipeline.h).
+
 // resolve creates a new listValue where all undefined (NaN) values are replaced with the given default value.
 ListValue* resolve(double defaultValue, ListValue* lv) {
-    ListValueIterator it(lv);
-    while (it.hasNext()) {
-        double value = it.getValue();
-        if (std::isnan(value)) {
-            it.setValue(defaultValue);
-        }
-        it.advance();
-    }
+    applyElementwise(ElementwiseOp::RESOLVE, &defaultValue, lv->mutableValues(), lv->size());
     return lv;
 }
 
 // clamp modifies the given list in-place, replacing all values smaller than minValue with minValue,
 // and all values larger than maxValue with maxValue.
 ListValue* clamp(double minValue, double maxValue, ListValue* lv) {
-    ListValueIterator it(lv);
-    while (it.hasNext()) {
-        double value = it.getValue();
-        if (!std::isnan(value)) {
-            if (value < minValue) {
-                it.setValue(minValue);
-            } else if (value > maxValue) {
-                it.setValue(maxValue);
-            }
-        }
-        it.advance();
-    }
+    double params[] = { minValue, maxValue };
+    applyElementwise(ElementwiseOp::CLAMP, params, lv->mutableValues(), lv->size());
     return lv;
 }
 
 // maxOf replaces all values in the list smaller than the given threshold with the threshold value.
 ListValue* maxOf(double threshold, ListValue* lv) {
-    ListValueIterator it(lv);
-    while (it.hasNext()) {
-        double value = it.getValue();
-        if (!std::isnan(value) && value < threshold) {
-            value = threshold;
-            it.setValue(value);
-        }
-        it.advance();
-    }
+    applyElementwise(ElementwiseOp::RAISE_TO, &threshold, lv->mutableValues(), lv->size());
     return lv;
 }
 
 // minOf replaces all values in the list larger than the given threshold with the threshold value.
 ListValue* minOf(double threshold, ListValue* lv) {
-    ListValueIterator it(lv);
-    while (it.hasNext()) {
-        double value = it.getValue();
-        if (!std::isnan(value) && value > threshold) {
-            value = threshold;
-            it.setValue(value);
-        }
-        it.advance();
-    }
+    applyElementwise(ElementwiseOp::LOWER_TO, &threshold, lv->mutableValues(), lv->size());
     return lv;
 }
 
@@ -130,31 +91,8 @@ ListValue* minOf(double threshold, ListValue* lv) {
 // to the destination range [dstStart, dstEnd]. Values outside the source
 // ranges are not clamped but extrapolated.
 ListValue* map(double srcStart, double srcEnd, double dstStart, double dstEnd, ListValue* lv) {
-    double srcRange = srcEnd - srcStart;
-    double dstRange = dstEnd - dstStart;
-
-    if (srcRange == 0.0) {
-        // If source range is zero, set all defined values to the midpoint of the destination range
-        double midDst = dstStart + dstRange / 2.0;
-        ListValueIterator it(lv);
-        while (it.hasNext()) {
-            double value = it.getValue();
-            if (!std::isnan(value)) {
-                it.setValue(midDst);
-            }
-            it.advance();
-        }
-    } else {
-        ListValueIterator it(lv);
-        while (it.hasNext()) {
-            double value = it.getValue();
-            if (!std::isnan(value)) {
-                double mappedValue = dstStart + ((value - srcStart) / srcRange) * dstRange;
-                it.setValue(mappedValue);
-            }
-            it.advance();
-        }
-    }
+    double params[] = { srcStart, srcEnd, dstStart, dstEnd };
+    applyElementwise(ElementwiseOp::MAP, params, lv->mutableValues(), lv->size());
     return lv;
 }
 
@@ -170,6 +108,107 @@ double require(double value, double threshold) {
     return require(value, threshold, 0.0, 1.0);
 }
 
+// The list arguments of the reductions go through the list kernels in one call each.
+static void weightedTotals(const std::vector<Datum>& args, double& weightedTotal, double& totalWeight) {
+    weightedTotal = 0.0;
+    totalWeight = 0.0;
+    for (const Datum& arg : args) {
+        if (arg.getType() == DataType::TYPE_LIST) {
+            const ListValue* lv = arg.getList();
+            double weighted, weight;
+            weightedSums(lv->values(), lv->weights(), lv->size(), weighted, weight);
+            weightedTotal += weighted;
+            totalWeight += weight;
+        } else {
+            double value = arg.toGrade();
+            if (std::isnan(value)) continue;
+            weightedTotal += value;
+            totalWeight += 1.0;
+        }
+    }
+}
+
+static void extremes(const std::vector<Datum>& args, double& minValue, double& maxValue, size_t& count) {
+    minValue = std::numeric_limits<double>::quiet_NaN();
+    maxValue = std::numeric_limits<double>::quiet_NaN();
+    count = 0;
+    for (const Datum& arg : args) {
+        double lo, hi;
+        size_t defined;
+        if (arg.getType() == DataType::TYPE_LIST) {
+            const ListValue* lv = arg.getList();
+            definedExtremes(lv->values(), lv->size(), lo, hi, defined);
+        } else {
+            lo = hi = arg.toGrade();
+            defined = std::isnan(lo) ? 0 : 1;
+        }
+        if (defined == 0) continue;
+        // the first defined value wins among equal extremes, as in the kernels
+        if (count == 0 || lo < minValue) minValue = lo;
+        if (count == 0 || hi > maxValue) maxValue = hi;
+        count += defined;
+    }
+}
+
+Datum reduceSum(std::vector<Datum>& args) {
+    double weighted, weight;
+    weightedTotals(args, weighted, weight);
+    return Datum::makeGrade(weight == 0.0 ? std::numeric_limits<double>::quiet_NaN() : weighted);
+}
+
+Datum reduceAvg(std::vector<Datum>& args) {
+    double weighted, weight;
+    weightedTotals(args, weighted, weight);
+    return Datum::makeGrade(weight == 0.0 ? std::numeric_limits<double>::quiet_NaN() : weighted / weight);
+}
+
+Datum reduceMin(std::vector<Datum>& args) {
+    double lo, hi;
+    size_t count;
+    extremes(args, lo, hi, count);
+    return Datum::makeGrade(lo);
+}
+
+Datum reduceMax(std::vector<Datum>& args) {
+    double lo, hi;
+    size_t count;
+    extremes(args, lo, hi, count);
+    return Datum::makeGrade(hi);
+}
+
+Datum reduceCount(std::vector<Datum>& args) {
+    double lo, hi;
+    size_t count;
+    extremes(args, lo, hi, count);
+    return Datum::makeInteger(count);
+}
+
+Datum conditional(LazyArguments& args) {
+    double condition = args.evaluate(0).toGrade();
+    if (std::isnan(condition)) return Datum::makeGrade(condition);
+    if (condition != 0.0) return args.evaluate(1);
+    if (args.size() < 3) return Datum::makeGrade(std::numeric_limits<double>::quiet_NaN());
+    return args.evaluate(2);
+}
+
+Datum lazyRequire(LazyArguments& args) {
+    double value = args.evaluate(0).toGrade();
+    double threshold = args.evaluate(1).toGrade();
+    // the branch arguments: (above), or (below above)
+    bool below = value < threshold;
+    if (args.size() == 2) return Datum::makeGrade(below ? 0.0 : 1.0);
+    if (args.size() == 3) return Datum::makeGrade(below ? 0.0 : args.evaluate(2).toGrade());
+    return Datum::makeGrade(args.evaluate(below ? 2 : 3).toGrade());
+}
+
+Datum coalesce(LazyArguments& args) {
+    for (size_t i = 0; i < args.size(); ++i) {
+        Datum value = args.evaluate(i);
+        if (!std::isnan(value.toGrade())) return value;
+    }
+    return Datum::makeGrade(std::numeric_limits<double>::quiet_NaN());
+}
+
 BasicOperationProvider* createProvider() {
     BasicOperationProvider* provider = new BasicOperationProvider();
 
@@ -181,12 +220,31 @@ BasicOperationProvider* createProvider() {
     provider->registerOperation("maxOf", maxOf);
     provider->registerOperation("minOf", minOf);
     provider->registerOperation("map", map);
-    provider->registerOperation<double, double, double, double, double>("require", require);
-    provider->registerOperation<double, double, double, double>("require", require);
-    provider->registerOperation<double, double, double>("require", require);
+    provider->declareElementwise("resolve", ElementwiseOp::RESOLVE);
+    provider->declareElementwise("clamp", ElementwiseOp::CLAMP);
+    provider->declareElementwise("maxOf", ElementwiseOp::RAISE_TO);
+    provider->declareElementwise("minOf", ElementwiseOp::LOWER_TO);
+    provider->declareElementwise("map", ElementwiseOp::MAP);
+    provider->registerLazyOperation("if", 2, 3, conditional);
+    provider->registerLazyOperation("require", 2, 4, lazyRequire);
+    provider->registerLazyOperation("coalesce", 0, SIZE_MAX, coalesce);
+    // the reductions take any number of grades, which lists and integers cast to
+    const std::vector<DataType> grades = { DataType::TYPE_GRADE };
+    provider->registerOperation(OperationSignature("sum", grades, DataType::TYPE_GRADE, true), reduceSum);
+    provider->registerOperation(OperationSignature("avg", grades, DataType::TYPE_GRADE, true), reduceAvg);
+    provider->registerOperation(OperationSignature("min", grades, DataType::TYPE_GRADE, true), reduceMin);
+    provider->registerOperation(OperationSignature("max", grades, DataType::TYPE_GRADE, true), reduceMax);
+    provider->registerOperation(OperationSignature("count", grades, DataType::TYPE_INTEGER, true), reduceCount);
     provider->registerOperation("len", std::function<unsigned long long(ListValue*)>([](ListValue* lv) -> unsigned long long {
-        return static_cast<unsigned long long>(lv->size());
+        unsigned long long n = static_cast<unsigned long long>(lv->size());
+        delete lv; // operations consume their arguments
+        return n;
     }));
+    // every built-in is a plain function of its arguments
+    for (const char* name : { "drop", "top", "join", "resolve", "clamp", "maxOf", "minOf", "map", "if", "require",
+                              "coalesce", "sum", "avg", "min", "max", "count", "len" }) {
+        provider->declarePure(name);
+    }
 
     return provider;
 }
\ No newline at end of file
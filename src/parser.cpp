@@ -1,149 +1,218 @@
 #include "parser.h"
 #include "tokenizer.h"
+#include "dependency_graph.h"
 #include <stdexcept>
 #include <string>
-#include <cstdlib>
+#include <charconv>
+#include <memory>
+
+// One-token lookahead over either a token vector or a Lexer pulling tokens from the input.
+class TokenStream {
+private:
+    const std::vector<Token>* tokens;
+    size_t idx;
+    Lexer* lexer;
+    Token current;
+public:
+    // tokens must end with END_OF_FILE
+    TokenStream(const std::vector<Token>& toks) : tokens(&toks), idx(0), lexer(nullptr), current(toks.front()) {}
+    TokenStream(Lexer& lex) : tokens(nullptr), idx(0), lexer(&lex), current(lex.next()) {}
+
+    const Token& peek() const { return current; }
+    // moves to the next token; END_OF_FILE is sticky
+    void advance() {
+        if (current.type == TokenT::END_OF_FILE) return;
+        current = lexer ? lexer->next() : (*tokens)[++idx];
+    }
+};
+
+// Parser state: the token stream and the program whose arena receives the nodes. Children
+// are collected on shared scratch stacks and copied into the arena once a node is complete.
+struct ParseState {
+    TokenStream& ts;
+    Program* program;
+    std::vector<Expression*> args;
+    std::vector<ListElement> elems;
+};
 
 // forward declarations for helper token functions
-static Token peekToken(const std::vector<Token>& tokens, size_t idx);
-static Token consumeToken(const std::vector<Token>& tokens, size_t& idx);
-static void expectToken(const std::vector<Token>& tokens, size_t& idx, TokenT expected);
+static void expectToken(TokenStream& ts, TokenT expected);
 
 // forward declarations
-static Expression* parseExpr(const std::vector<Token>& tokens, size_t& idx);
-static ListExpr* parseList(const std::vector<Token>& tokens, size_t& idx);
+static Expression* parseExpr(ParseState& ps);
+static ListExpr* parseList(ParseState& ps);
 
-// Parses a program from the given tokens.
-Program* parseProgram(const std::vector<Token>& tokens) {
-    size_t idx = 0;
-    Program* program = new Program();
+// Rough arena bytes needed per input byte; reserving up front keeps a program in one block.
+static const size_t ARENA_BYTES_PER_INPUT_BYTE = 4;
+
+static Program* parseProgram(TokenStream& ts, size_t inputSize) {
+    std::unique_ptr<Program> program(new Program());
+    program->arena.reserve(inputSize * ARENA_BYTES_PER_INPUT_BYTE);
+    ParseState ps{ts, program.get(), {}, {}};
     while (true) {
-        Token t = peekToken(tokens, idx);
+        const Token& t = ts.peek();
         if (t.type == TokenT::END_OF_FILE) break;
         if (t.type == TokenT::IDENTIFIER) {
             // category: IDENTIFIER ':' expr
-            Token nameTok = consumeToken(tokens, idx);
-            Token colon = peekToken(tokens, idx);
+            std::string_view name = t.text;
+            ts.advance();
+            const Token& colon = ts.peek();
             if (colon.type != TokenT::COLON) {
                 throw std::runtime_error("Parse error: expected ':' after category name at position " + std::to_string(colon.position));
             }
             // consume colon
-            consumeToken(tokens, idx);
-            Expression* expr = parseExpr(tokens, idx);
-            program->categories[nameTok.text] = expr;
+            ts.advance();
+            Expression* expr = parseExpr(ps);
+            program->setCategory(name, expr);
             continue;
         }
         // skip unknown or other tokens until EOF (or error)
         throw std::runtime_error("Parse error: unexpected token at position " + std::to_string(t.position));
     }
-    return program;
+    program->dependencyGraph();
+    return program.release();
 }
 
-// Parses a program from the given input.
-Program* parseProgram(const std::string& input) {
-    std::vector<Token> toks = tokenize(input);
-    return parseProgram(toks);
+// Parses a program from the given tokens.
+Program* parseProgram(const std::vector<Token>& tokens) {
+    if (tokens.empty() || tokens.back().type != TokenT::END_OF_FILE) {
+        // the token stream relies on a trailing END_OF_FILE token
+        std::vector<Token> terminated = tokens;
+        terminated.emplace_back(TokenT::END_OF_FILE, std::string_view(), tokens.empty() ? 0 : tokens.back().position + 1);
+        return parseProgram(terminated);
+    }
+    TokenStream ts(tokens);
+    size_t textSize = 0;
+    for (const Token& t : tokens) textSize += t.text.size();
+    return parseProgram(ts, textSize);
 }
 
-static Token peekToken(const std::vector<Token>& tokens, size_t idx) {
-    if (idx < tokens.size()) return tokens[idx];
-    return Token(TokenT::END_OF_FILE, "", tokens.empty() ? 0 : tokens.back().position + 1);
+// Parses a program from the given input, tokenizing on demand.
+Program* parseProgram(std::string_view input) {
+    Lexer lexer(input);
+    TokenStream ts(lexer);
+    return parseProgram(ts, input.size());
 }
-static Token consumeToken(const std::vector<Token>& tokens, size_t& idx) {
-    Token t = peekToken(tokens, idx);
-    if (idx < tokens.size()) ++idx;
-    return t;
+
+// Parses a single expression spanning the whole input into owner's arena.
+Expression* parseExpression(std::string_view input, Program* owner) {
+    Lexer lexer(input);
+    TokenStream ts(lexer);
+    ParseState ps{ts, owner, {}, {}};
+    Expression* expr = parseExpr(ps);
+    if (ts.peek().type != TokenT::END_OF_FILE) {
+        throw std::runtime_error("Parse error: unexpected token after expression at position " + std::to_string(ts.peek().position));
+    }
+    return expr;
 }
-static void expectToken(const std::vector<Token>& tokens, size_t& idx, TokenT expected) {
-    Token t = peekToken(tokens, idx);
+
+static void expectToken(TokenStream& ts, TokenT expected) {
+    const Token& t = ts.peek();
     if (t.type != expected) {
         throw std::runtime_error("Parse error: expected token at position " + std::to_string(t.position));
     }
-    ++idx;
+    ts.advance();
 }
 
 // parse a list_item: expr ( ':' expr )?
-static ListElement* parseListItem(const std::vector<Token>& tokens, size_t& idx) {
-    Expression* valueExpr = parseExpr(tokens, idx);
+static ListElement parseListItem(ParseState& ps) {
+    Expression* valueExpr = parseExpr(ps);
     Expression* weightExpr = nullptr;
-    Token t = peekToken(tokens, idx);
-    if (t.type == TokenT::COLON) {
+    if (ps.ts.peek().type == TokenT::COLON) {
         // consume colon
-        consumeToken(tokens, idx);
-        weightExpr = parseExpr(tokens, idx);
+        ps.ts.advance();
+        weightExpr = parseExpr(ps);
     }
-    return new ListElement(valueExpr, weightExpr);
+    return ListElement(valueExpr, weightExpr);
 }
 
-static ListExpr* parseList(const std::vector<Token>& tokens, size_t& idx) {
-    // assume '{' already consumed
-    std::vector<ListElement*> elems;
-    Token t = peekToken(tokens, idx);
-    while (t.type != TokenT::RBRACE) {
-        if (t.type == TokenT::END_OF_FILE) {
-            throw std::runtime_error("Parse error: unexpected end of file inside list at position " + std::to_string(t.position));
+static ListExpr* parseList(ParseState& ps) {
+    // assume '{' already consumed; nested lists push above this list's base
+    TokenStream& ts = ps.ts;
+    size_t base = ps.elems.size();
+    while (ts.peek().type != TokenT::RBRACE) {
+        if (ts.peek().type == TokenT::END_OF_FILE) {
+            throw std::runtime_error("Parse error: unexpected end of file inside list at position " + std::to_string(ts.peek().position));
         }
-        elems.push_back(parseListItem(tokens, idx));
-        t = peekToken(tokens, idx);
+        ListElement el = parseListItem(ps);
+        ps.elems.push_back(el);
     }
     // consume '}'
-    expectToken(tokens, idx, TokenT::RBRACE);
-    return new ListExpr(elems);
+    expectToken(ts, TokenT::RBRACE);
+    size_t count = ps.elems.size() - base;
+    ListElement* elems = ps.program->arena.copyArray(ps.elems.data() + base, count);
+    ps.elems.resize(base, ListElement(nullptr));
+    return ps.program->arena.make<ListExpr>(elems, count);
 }
 
-static Expression* parseOperation(const std::vector<Token>& tokens, size_t& idx, const std::string& opName) {
-    // '(' already consumed by caller
-    std::vector<Expression*> args;
-    Token t = peekToken(tokens, idx);
-    while (t.type != TokenT::RPAREN) {
-        if (t.type == TokenT::END_OF_FILE) {
-            throw std::runtime_error("Parse error: unexpected end of file in operation '" + opName + "' at position " + std::to_string(t.position));
+static Expression* parseOperation(ParseState& ps, std::string_view opName) {
+    // '(' already consumed by caller; nested calls push above this call's base
+    TokenStream& ts = ps.ts;
+    size_t base = ps.args.size();
+    while (ts.peek().type != TokenT::RPAREN) {
+        if (ts.peek().type == TokenT::END_OF_FILE) {
+            throw std::runtime_error("Parse error: unexpected end of file in operation '" + std::string(opName) + "' at position " + std::to_string(ts.peek().position));
         }
-        args.push_back(parseExpr(tokens, idx));
-        t = peekToken(tokens, idx);
+        Expression* arg = parseExpr(ps);
+        ps.args.push_back(arg);
     }
     // consume ')'
-    expectToken(tokens, idx, TokenT::RPAREN);
-    return new OperationExpr(opName, args);
+    expectToken(ts, TokenT::RPAREN);
+    size_t count = ps.args.size() - base;
+    Expression** args = ps.program->arena.copyArray(ps.args.data() + base, count);
+    ps.args.resize(base);
+    return ps.program->arena.makeOwned<OperationExpr>(opName, args, count);
 }
 
-static Expression* parseExpr(const std::vector<Token>& tokens, size_t& idx) {
-    Token t = peekToken(tokens, idx);
+// Parses a number spanning the whole of text; throws on malformed or out-of-range input.
+template<typename T>
+static T parseNumber(std::string_view text, size_t position) {
+    T value{};
+    auto res = std::from_chars(text.data(), text.data() + text.size(), value);
+    if (res.ec != std::errc() || res.ptr != text.data() + text.size()) {
+        throw std::runtime_error("Parse error: invalid number '" + std::string(text) + "' at position " + std::to_string(position));
+    }
+    return value;
+}
+
+static Expression* parseExpr(ParseState& ps) {
+    TokenStream& ts = ps.ts;
+    Arena& arena = ps.program->arena;
+    const Token& t = ts.peek();
     if (t.type == TokenT::PERCENT) {
-        consumeToken(tokens, idx);
         // text includes '%', strip and parse
-        std::string num = t.text;
-        if (!num.empty() && num.back() == '%') num.pop_back();
-        double value = std::strtod(num.c_str(), nullptr) / 100.0;
-        return new ConstantExpr(new GradeValue(value));
+        std::string_view num = t.text;
+        if (!num.empty() && num.back() == '%') num.remove_suffix(1);
+        double value = parseNumber<double>(num, t.position) / 100.0;
+        ts.advance();
+        return arena.make<ConstantExpr>(Datum::makeGrade(value));
     }
     if (t.type == TokenT::UDOUBLE) {
-        consumeToken(tokens, idx);
-        double d = std::strtod(t.text.c_str(), nullptr);
-        return new ConstantExpr(new GradeValue(d));
+        double d = parseNumber<double>(t.text, t.position);
+        ts.advance();
+        return arena.make<ConstantExpr>(Datum::makeGrade(d));
     }
     if (t.type == TokenT::INTEGER) {
-        consumeToken(tokens, idx);
-        unsigned long long v = std::stoull(t.text);
-        return new ConstantExpr(new IntegerValue(v));
+        unsigned long long v = parseNumber<unsigned long long>(t.text, t.position);
+        ts.advance();
+        return arena.make<ConstantExpr>(Datum::makeInteger(v));
     }
     if (t.type == TokenT::IDENTIFIER) {
-        // could be operation or category ref
-        consumeToken(tokens, idx);
-        std::string name = t.text;
-        Token next = peekToken(tokens, idx);
-        if (next.type == TokenT::LPAREN) {
+        // could be operation or category ref; the token text stays valid because it points into the input
+        std::string_view name = t.text;
+        ts.advance();
+        if (ts.peek().type == TokenT::LPAREN) {
             // consume '('
-            consumeToken(tokens, idx);
-            return parseOperation(tokens, idx, name);
+            ts.advance();
+            return parseOperation(ps, name);
         } else {
-            return new CategoryRefExpr(name);
+            return arena.make<CategoryRefExpr>(arena.copyString(name));
         }
     }
     if (t.type == TokenT::LBRACE) {
-        consumeToken(tokens, idx);
-        return parseList(tokens, idx);
+        ts.advance();
+        return parseList(ps);
     }
 
     throw std::runtime_error("Parse error: unexpected token at position " + std::to_string(t.position));
-}
\ No newline at end of file
+}
@@ -0,0 +1,54 @@
+#include "subexpressions.h"
+#include <atomic>
+
+// serials start at 1 so that a memo key is never 0, which marks an unmemoized node
+static std::atomic<uint32_t> nextTableSerial(1);
+
+SubexpressionTable::SubexpressionTable() : serial(nextTableSerial.fetch_add(1)) {}
+
+uint32_t SubexpressionTable::intern(const std::string& key) {
+    auto res = ids.emplace(key, static_cast<uint32_t>(occurrences.size() + 1));
+    if (res.second) occurrences.push_back(0);
+    ++occurrences[res.first->second - 1];
+    return res.first->second;
+}
+
+void appendSubexpressionId(std::string& key, uint32_t id) {
+    key.append(reinterpret_cast<const char*>(&id), sizeof(id));
+}
+
+Expression* SubexpressionInterner::intern(const std::string& key, Expression* node, bool memoize) {
+    uint32_t id = table.intern(key);
+    auto res = canonical.emplace(id, node);
+    if (!res.second) {
+        ++shared;
+        return res.first->second;
+    }
+    node->subexpressionId = id;
+    if (memoize) memoizable.push_back(node);
+    return node;
+}
+
+size_t eliminateCommonSubexpressions(const std::vector<Program*>& programs, SubexpressionTable& table,
+                                     const std::vector<OperationProvider*>& ops) {
+    std::vector<SubexpressionInterner> interners;
+    interners.reserve(programs.size());
+    size_t shared = 0;
+    for (Program* prog : programs) {
+        interners.emplace_back(table, ops);
+        SubexpressionInterner& interner = interners.back();
+        for (auto& kv : prog->categories) {
+            if (kv.second) kv.second = kv.second->internSubexpressions(interner);
+        }
+        shared += interner.shared;
+    }
+    // occurrences are only complete once every program has been interned
+    for (SubexpressionInterner& interner : interners) {
+        for (Expression* node : interner.memoizable) {
+            if (table.occurrencesOf(node->subexpressionId) > 1) {
+                node->memoKey = table.memoKey(node->subexpressionId);
+            }
+        }
+    }
+    return shared;
+}
@@ -0,0 +1,16 @@
+#include "symbol_table.h"
+
+uint32_t SymbolTable::intern(std::string_view name) {
+    auto it = ids.find(name);
+    if (it != ids.end()) return it->second;
+    uint32_t id = static_cast<uint32_t>(names.size());
+    names.emplace_back(name);
+    ids.emplace(names.back(), id);
+    return id;
+}
+
+std::optional<uint32_t> SymbolTable::find(std::string_view name) const {
+    auto it = ids.find(name);
+    if (it == ids.end()) return std::nullopt;
+    return it->second;
+}
@@ -0,0 +1,89 @@
+#include "thread_pool.h"
+#include <algorithm>
+
+// the pool and queue index of the current thread, if it is a pool worker
+static thread_local const WorkStealingPool* currentPool = nullptr;
+static thread_local size_t currentQueue = 0;
+
+WorkStealingPool::WorkStealingPool(unsigned threads) : queued(0), nextQueue(0), waiters(0) {
+    if (threads == 0) {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    for (unsigned i = 0; i < threads; ++i) {
+        queues.emplace_back(new Queue());
+    }
+    for (unsigned i = 0; i < threads; ++i) {
+        workers.emplace_back(&WorkStealingPool::workerLoop, this, i);
+    }
+}
+
+WorkStealingPool::~WorkStealingPool() {
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        stopping = true;
+    }
+    workAvailable.notify_all();
+    for (auto& th : workers) th.join();
+}
+
+void WorkStealingPool::submit(Task task) {
+    size_t q = currentPool == this ? currentQueue : nextQueue.fetch_add(1) % queues.size();
+    // counted before it becomes visible, so queued never drops below the real number
+    queued.fetch_add(1);
+    {
+        std::lock_guard<std::mutex> lock(queues[q]->mutex);
+        queues[q]->tasks.push_back(std::move(task));
+    }
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+    }
+    workAvailable.notify_one();
+}
+
+bool WorkStealingPool::runOne(size_t home) {
+    Task task;
+    size_t n = queues.size();
+    for (size_t k = 0; k < n && !task; ++k) {
+        Queue& q = *queues[(home + k) % n];
+        std::lock_guard<std::mutex> lock(q.mutex);
+        if (q.tasks.empty()) continue;
+        if (k == 0) {
+            // own queue: newest first, its data is most likely still in cache
+            task = std::move(q.tasks.back());
+            q.tasks.pop_back();
+        } else {
+            task = std::move(q.tasks.front());
+            q.tasks.pop_front();
+        }
+    }
+    if (!task) return false;
+    queued.fetch_sub(1);
+    task();
+    if (waiters.load() > 0) {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        taskFinished.notify_all();
+    }
+    return true;
+}
+
+void WorkStealingPool::workerLoop(size_t index) {
+    currentPool = this;
+    currentQueue = index;
+    while (true) {
+        if (runOne(index)) continue;
+        std::unique_lock<std::mutex> lock(sleepMutex);
+        workAvailable.wait(lock, [&]() { return queued.load() > 0 || stopping; });
+        if (stopping && queued.load() == 0) return;
+    }
+}
+
+void WorkStealingPool::helpUntil(const std::function<bool()>& done) {
+    size_t home = currentPool == this ? currentQueue : nextQueue.fetch_add(1) % queues.size();
+    while (!done()) {
+        if (runOne(home)) continue;
+        std::unique_lock<std::mutex> lock(sleepMutex);
+        waiters.fetch_add(1);
+        taskFinished.wait(lock, [&]() { return done() || queued.load() > 0; });
+        waiters.fetch_sub(1);
+    }
+}
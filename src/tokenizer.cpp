@@ -1,95 +1,86 @@
 #include "tokenizer.h"
 #include <cctype>
 
-std::vector<Token> tokenize(const std::string& input) {
-    std::vector<Token> out;
-    size_t pos = 0;
-    size_t tokenStart = 0;
-    char state = ' '; // ' ' = default, 'i' = identifier, 'n' = number before dot, 'd' = number after dot
-    while (pos <= input.size()) {
-        char currentChar = (pos < input.size()) ? input[pos] : '\0';
-        if (state == ' ') {
-            // skip whitespace and comments using helper
-            pos = _consumeWhitespace(input, pos);
-            if (pos >= input.size()) {
-                out.emplace_back(TokenT::END_OF_FILE, "", pos);
-                break;
-            }
-            currentChar = input[pos];
-            // allow UDOUBLE starting with '.' when followed by a digit
-            if (currentChar == '.' && pos + 1 < input.size() && isdigit(static_cast<unsigned char>(input[pos + 1]))) {
-                state = 'd';
-                tokenStart = pos;
-                pos++; // consume the '.'
-            }
-            // NOTE: Removed '.' from start characters so a single '.' becomes UNKNOWN.
-            else if (isalpha(static_cast<unsigned char>(currentChar)) || currentChar == '_' || currentChar == '-' || currentChar == '/') {
-                state = 'i';
-                tokenStart = pos;
-                pos++;
-            } else if (isdigit(static_cast<unsigned char>(currentChar))) {
-                state = 'n';
-                tokenStart = pos;
-                pos++;
-            } else if (currentChar == ':') {
-                out.emplace_back(TokenT::COLON, ":", pos);
-                pos++;
-            } else if (currentChar == '(') {
-                out.emplace_back(TokenT::LPAREN, "(", pos);
-                pos++;
-            } else if (currentChar == ')') {
-                out.emplace_back(TokenT::RPAREN, ")", pos);
-                pos++;
-            } else if (currentChar == '{') {
-                out.emplace_back(TokenT::LBRACE, "{", pos);
-                pos++;
-            } else if (currentChar == '}') {
-                out.emplace_back(TokenT::RBRACE, "}", pos);
-                pos++;
-            } else {
-                out.emplace_back(TokenT::UNKNOWN, std::string(1, currentChar), pos);
-                pos++;
-            }
-        } else if (state == 'i') {
-            // allow '.' inside identifiers so things like "special-id/1.2" are a single IDENTIFIER
-            if (isalnum(static_cast<unsigned char>(currentChar)) || currentChar == '_' || currentChar == '-' || currentChar == '/' || currentChar == '.') {
-                pos++;
-            } else {
-                out.emplace_back(TokenT::IDENTIFIER, input.substr(tokenStart, pos - tokenStart), tokenStart);
-                state = ' ';
-            }
-        } else if (state == 'n') {
-            if (isdigit(static_cast<unsigned char>(currentChar))) {
-                pos++;
-            } else if (currentChar == '.') {
-                state = 'd';
-                pos++;
-            } else if (currentChar == '%') {
-                out.emplace_back(TokenT::PERCENT, input.substr(tokenStart, pos - tokenStart) + "%", tokenStart);
-                pos++;
-                state = ' ';
-            } else {
-                out.emplace_back(TokenT::INTEGER, input.substr(tokenStart, pos - tokenStart), tokenStart);
-                state = ' ';
-            }
-        } else if (state == 'd') {
-            if (isdigit(static_cast<unsigned char>(currentChar))) {
-                pos++;
-            } else if (currentChar == '%') {
-                out.emplace_back(TokenT::PERCENT, input.substr(tokenStart, pos - tokenStart) + "%", tokenStart);
-                pos++;
-                state = ' ';
-            } else {
-                out.emplace_back(TokenT::UDOUBLE, input.substr(tokenStart, pos - tokenStart), tokenStart);
-                state = ' ';
-            }
+static bool isIdentifierStart(char c) {
+    return isalpha(static_cast<unsigned char>(c)) || c == '_' || c == '-' || c == '/';
+}
+
+// allow '.' inside identifiers so things like "special-id/1.2" are a single IDENTIFIER
+static bool isIdentifierChar(char c) {
+    return isalnum(static_cast<unsigned char>(c)) || c == '_' || c == '-' || c == '/' || c == '.';
+}
+
+static bool isDigitAt(std::string_view input, size_t pos) {
+    return pos < input.size() && isdigit(static_cast<unsigned char>(input[pos]));
+}
+
+// scans the digits after a decimal point; the token is a PERCENT if a '%' follows
+Token Lexer::scanFraction(size_t tokenStart) {
+    while (isDigitAt(input, pos)) pos++;
+    if (pos < input.size() && input[pos] == '%') {
+        pos++;
+        return Token(TokenT::PERCENT, input.substr(tokenStart, pos - tokenStart), tokenStart);
+    }
+    return Token(TokenT::UDOUBLE, input.substr(tokenStart, pos - tokenStart), tokenStart);
+}
+
+Token Lexer::next() {
+    // skip whitespace and comments using helper
+    pos = _consumeWhitespace(input, pos);
+    if (pos >= input.size()) {
+        return Token(TokenT::END_OF_FILE, std::string_view(), pos);
+    }
+    size_t tokenStart = pos;
+    char currentChar = input[pos];
+    // allow UDOUBLE starting with '.' when followed by a digit
+    if (currentChar == '.' && isDigitAt(input, pos + 1)) {
+        pos++; // consume the '.'
+        return scanFraction(tokenStart);
+    }
+    // NOTE: '.' is not a start character, so a single '.' becomes UNKNOWN.
+    if (isIdentifierStart(currentChar)) {
+        pos++;
+        while (pos < input.size() && isIdentifierChar(input[pos])) pos++;
+        return Token(TokenT::IDENTIFIER, input.substr(tokenStart, pos - tokenStart), tokenStart);
+    }
+    if (isdigit(static_cast<unsigned char>(currentChar))) {
+        while (isDigitAt(input, pos)) pos++;
+        if (pos < input.size() && input[pos] == '.') {
+            pos++;
+            return scanFraction(tokenStart);
+        }
+        if (pos < input.size() && input[pos] == '%') {
+            pos++;
+            return Token(TokenT::PERCENT, input.substr(tokenStart, pos - tokenStart), tokenStart);
         }
+        return Token(TokenT::INTEGER, input.substr(tokenStart, pos - tokenStart), tokenStart);
+    }
+    TokenT type;
+    switch (currentChar) {
+        case ':': type = TokenT::COLON; break;
+        case '(': type = TokenT::LPAREN; break;
+        case ')': type = TokenT::RPAREN; break;
+        case '{': type = TokenT::LBRACE; break;
+        case '}': type = TokenT::RBRACE; break;
+        default: type = TokenT::UNKNOWN; break;
     }
+    pos++;
+    return Token(type, input.substr(tokenStart, 1), tokenStart);
+}
+
+std::vector<Token> tokenize(std::string_view input) {
+    std::vector<Token> out;
+    // most tokens span several characters; avoid regrowing the vector on large inputs
+    out.reserve(input.size() / 4 + 1);
+    Lexer lexer(input);
+    do {
+        out.push_back(lexer.next());
+    } while (out.back().type != TokenT::END_OF_FILE);
     return out;
 }
 
 // comments are c-style: // to end of line, /* to */
-size_t _consumeWhitespace(const std::string& input, size_t startPos) {
+size_t _consumeWhitespace(std::string_view input, size_t startPos) {
     size_t pos = startPos;
     while (pos < input.size()) {
         char currentChar = input[pos];
@@ -2,18 +2,27 @@
 #include <sstream>
 #include <iostream>
 #include <string>
+#include <limits>
+#include <cmath>
+#include <algorithm>
 #include "parser.h"
+#include "loader.h"
+#include "operations.h"
+#include "batch.h"
+#include "bytecode.h"
+#include "dependency_graph.h"
+#include "thread_pool.h"
+#include "list_kernels.h"
+#include "list_pipeline.h"
+#include "subexpressions.h"
+#include "eval_plan.h"
+#include "symbol_table.h"
+#include "goal_seek.h"
 
 bool isValidProgramFile(const std::string& path, std::string& errorMsg) {
-    std::ifstream in(path);
-    if (!in) {
-        return false;
-    }
-    std::stringstream ss;
-    ss << in.rdbuf();
     Program* prog = nullptr;
     try {
-        prog = parseProgram(ss.str());
+        prog = loadProgramFile(path);
         if (!prog) {
             delete prog;
             return false;
@@ -156,8 +165,1424 @@ bool runTests() {
     return true;
 }
 
+// Per-student exam scores, looked up for a group of students at a time.
+class ExamStore : public RosterStore {
+public:
+    std::unordered_map<std::string, double> exams;
+    std::atomic<size_t> requests{0};
+    std::atomic<size_t> largestRequest{0};
+    bool fail = false;
+    std::vector<std::vector<Value*>> getStudentValues(const std::vector<std::string>& studentIds,
+                                                      const std::vector<std::string>& categoryNames) override {
+        if (fail) throw std::runtime_error("store unavailable");
+        ++requests;
+        size_t largest = largestRequest.load();
+        while (studentIds.size() > largest && !largestRequest.compare_exchange_weak(largest, studentIds.size())) {}
+        std::vector<std::vector<Value*>> values;
+        for (const std::string& id : studentIds) {
+            values.emplace_back();
+            for (const std::string& name : categoryNames) {
+                auto it = exams.find(id);
+                values.back().push_back(name == "exam" && it != exams.end() ? new GradeValue(it->second) : nullptr);
+            }
+        }
+        return values;
+    }
+};
+
+bool runBatchTests() {
+    std::string errorMsg;
+    Program* policy = parseProgram(std::string(
+        "homework: {80% 90% 70%}\n"
+        "final_grade: { drop(1 homework): 0.4 exam: 0.6 }\n"
+        "passed: require(final_grade 0.7)\n"));
+    std::istringstream csv(
+        "id, exam, homework\n"
+        "alice, 90%, \n"
+        "bob, 50%, {60% 100% 40%}\n"
+        "carol, , \n");
+    Roster* roster = parseRoster(csv);
+    ASSERT_TRUE(roster->columns.size() == 2 && roster->rows.size() == 3);
+
+    OperationProvider* ops = createProvider();
+    BatchEvaluator evaluator({ policy }, { ops });
+    std::vector<BatchRow> rows = evaluator.run(*roster, { "final_grade", "passed" }, 2);
+    ASSERT_TRUE(rows.size() == 3);
+    ASSERT_TRUE(rows[0].cells[0] == "{0.85:0.4 0.9:0.6}" && rows[0].cells[1] == "1");
+    ASSERT_TRUE(rows[1].cells[0] == "{0.8:0.4 0.5:0.6}" && rows[1].cells[1] == "0");
+    ASSERT_TRUE(rows[2].cells[0] == "{0.85:0.4 undef:0.6}" && rows[2].cells[1] == "1");
+    ASSERT_TRUE(rows[0].error.empty() && rows[1].error.empty() && rows[2].error.empty());
+
+    // categories no column reaches are computed once and shared by every row, also by symbol
+    Program* curved = parseProgram(std::string(
+        "curve: map(0 1 0.1 1 {50% 70%})\n"
+        "cutoff: { curve 0.6 }\n"
+        "scaled: { exam: 0.5 cutoff: 0.5 }\n"
+        "result: require(scaled cutoff fail pass)\n"));
+    const std::vector<std::string> curvedTargets = { "result", "scaled", "cutoff" };
+    std::vector<std::string> expected;
+    for (const RosterRow& row : roster->rows) {
+        Context ctx;
+        ctx.dataProviders = { row.inputs, curved };
+        ctx.operationProviders = { ops };
+        for (const std::string& target : curvedTargets) expected.push_back(formatBatchValue(ctx.getCategoryValue(target)));
+    }
+    SymbolTable symbols;
+    for (const SymbolTable* table : { static_cast<const SymbolTable*>(nullptr), static_cast<const SymbolTable*>(&symbols) }) {
+        if (table) {
+            curved->bindSymbols(symbols);
+            for (RosterRow& row : roster->rows) row.inputs->bindSymbols(symbols);
+        }
+        BatchEvaluator hoisting({ curved }, { ops }, table);
+        BatchStats stats;
+        rows = hoisting.run(*roster, curvedTargets, 2, &stats);
+        ASSERT_TRUE(stats.invariantCategories == 2 && stats.perStudentCategories == 2);
+        ASSERT_TRUE(stats.savedEvaluations(roster->rows.size()) == 4 && stats.sharedReads >= 6);
+        for (size_t r = 0; r < rows.size(); ++r) {
+            for (size_t t = 0; t < curvedTargets.size(); ++t) {
+                ASSERT_TRUE(rows[r].cells[t] == expected[r * curvedTargets.size() + t]);
+            }
+        }
+    }
+
+    // the store fills in what the roster leaves out, one request per group of rows
+    ExamStore store;
+    store.exams = { { "alice", 0.1 }, { "carol", 0.8 } };
+    BatchEvaluator stored({ policy }, { ops }, nullptr, &store);
+    BatchStats storeStats;
+    rows = stored.run(*roster, { "final_grade", "passed" }, 2, &storeStats);
+    ASSERT_TRUE(rows[0].cells[0] == "{0.85:0.4 0.9:0.6}" && rows[1].cells[0] == "{0.8:0.4 0.5:0.6}");
+    ASSERT_TRUE(rows[2].cells[0] == "{0.85:0.4 0.8:0.6}" && rows[2].cells[1] == "1");
+    ASSERT_TRUE(store.requests == 1 && storeStats.storeRequests == 1);
+    std::string manyCsv = "id, homework, exam\n";
+    for (int i = 0; i < 40; ++i) {
+        manyCsv += "s" + std::to_string(i) + ", , \n";
+        store.exams["s" + std::to_string(i)] = i / 100.0;
+    }
+    std::istringstream many(manyCsv);
+    Roster* large = parseRoster(many);
+    store.requests = 0;
+    rows = stored.run(*large, { "final_grade" }, 3);
+    ASSERT_TRUE(store.requests == 3 && store.largestRequest == 16);
+    for (int i = 0; i < 40; ++i) {
+        std::ostringstream want;
+        want << "{0.85:0.4 " << i / 100.0 << ":0.6}";
+        ASSERT_TRUE(rows[i].cells[0] == want.str() && rows[i].error.empty());
+    }
+    store.fail = true;
+    rows = stored.run(*roster, { "final_grade", "passed" }, 1);
+    ASSERT_TRUE(rows[0].cells[1] == "error" && rows[2].error == "input store: store unavailable");
+    delete large;
+
+    std::istringstream badCsv("id,exam\nalice,90% 10%\n");
+    bool threw = false;
+    try {
+        delete parseRoster(badCsv);
+    } catch (const std::exception&) {
+        threw = true;
+    }
+    ASSERT_TRUE(threw);
+
+    delete roster;
+    delete ops;
+    delete curved;
+    delete policy;
+    std::cout << "All batch tests passed." << std::endl;
+    return true;
+}
+
+// Evaluates one category through the tree walker or the VM; errors are rendered as "error: ...".
+static std::string evaluateFormatted(DataProvider* provider, OperationProvider* ops, const std::string& category,
+                                     const SymbolTable* symbols = nullptr) {
+    Context ctx;
+    ctx.setSymbolTable(symbols);
+    ctx.dataProviders.push_back(provider);
+    ctx.operationProviders.push_back(ops);
+    try {
+        return formatBatchValue(ctx.getCategoryValue(category));
+    } catch (const std::exception& ex) {
+        return std::string("error: ") + ex.what();
+    }
+}
+
+// Differential test: the unlinked tree walk is the reference; the optimized (folded, CSE,
+// fused, symbol-bound) and linked tree walk and the bytecode VM compiled from it must agree
+// with it on every category.
+bool bytecodeMatchesTreeWalk(Program* prog, std::string& errorMsg) {
+    OperationProvider* ops = createProvider();
+    std::vector<std::pair<std::string, std::string>> expected;
+    for (const auto& kv : prog->categories) {
+        expected.emplace_back(kv.first, evaluateFormatted(prog, ops, std::string(kv.first)));
+    }
+    prog->foldConstants({ ops });
+    SubexpressionTable table;
+    eliminateCommonSubexpressions({ prog }, table, { ops });
+    prog->fuseListPipelines({ ops });
+    SymbolTable symbols;
+    prog->bindSymbols(symbols);
+    prog->link({ ops });
+    CompiledProgram* compiled = compileProgram(*prog);
+    bool same = true;
+    for (const auto& e : expected) {
+        std::string linked = evaluateFormatted(prog, ops, e.first, &symbols);
+        std::string actual = evaluateFormatted(compiled, ops, e.first, &symbols);
+        if (e.second != linked || e.second != actual) {
+            errorMsg = e.first + ": tree walk gave " + e.second + ", linked tree walk gave " + linked + ", bytecode gave " + actual;
+            same = false;
+            break;
+        }
+    }
+    delete compiled;
+    delete ops;
+    delete prog;
+    return same;
+}
+
+bool bytecodeMatchesTreeWalk(const std::string& path, std::string& errorMsg) {
+    errorMsg = path;
+    return bytecodeMatchesTreeWalk(loadProgramFile(path), errorMsg);
+}
+
+bool runBytecodeTests() {
+    std::string errorMsg;
+    for (int i = 1; i <= 50; ++i) {
+        std::string prefix = (i < 10 ? "0" : "") + std::to_string(i) + "_";
+        for (const char* name : {
+                "midterm_clamp", "homework_final", "drop_lowest", "pass_fail", "resolve_undef",
+                "simple_int", "simple_double", "simple_percent", "ref_to_other", "op_sum",
+                "op_weighted", "list_basic", "list_weighted", "nested_list", "op_nested",
+                "two_assignments", "percent_and_double", "complex_op", "op_with_refs", "list_with_ops",
+                "special_chars_name", "empty_op", "integer_list_weights", "nested_operations", "big_float",
+                "int_and_percent", "id_with_dots", "category_mix", "deep_nest", "list_of_lists",
+                "op_and_list", "zero_percent", "multiple_ids", "operation_many_args", "mixed_types",
+                "weight_with_expr", "paren_chain", "single_list_item", "nested_mixed", "ref_simple",
+                "trailing_comments", "multiple_assignments", "op_with_percent", "zero_double", "long_list",
+                "op_no_space", "mixed_ops", "complex_list", "many_slash_id", "hyphen_slash_ok" }) {
+            std::string path = "test/examples/" + prefix + name + ".txt";
+            std::ifstream probe(path);
+            if (probe) ASSERT_TRUE(bytecodeMatchesTreeWalk(path, errorMsg));
+        }
+    }
+    ASSERT_TRUE(bytecodeMatchesTreeWalk(parseProgram(std::string(
+        "raw: {55% undef 90% 120% 70%:2}\n"
+        "scaled: map(0 1 0 100 clamp(0 1 resolve(0 raw)))\n"
+        "best: top(2 raw)\n"
+        "rest: drop(1 join(raw {40% 60%}))\n"
+        "count: len(raw)\n"
+        "bounded: minOf(0.8 maxOf(0.6 raw))\n"
+        "final: { best: 0.5 rest: count scaled: 1 }\n"
+        "passed: require(final 0.7 fail require(final 0.9 0.8 pass))\n"
+        "deep: require(require(require(require(0.5 0.4) 0.5) 0.5) 0.5)\n"
+        "missing: no_such_op(raw)\n")), errorMsg));
+
+    // constant arguments bind at link time; category references go through the inline cache
+    Program* prog = parseProgram(std::string("a: sum(0.5 0.25)\nb: sum(x 0.25)\nc: len({1 2})\nd: require(0.5 0.7)\n"));
+    OperationProvider* ops = createProvider();
+    prog->link({ ops });
+    auto callSite = [&](const char* name) -> const OperationCallSite& {
+        return static_cast<OperationExpr*>(prog->categories[name])->getCallSite();
+    };
+    ASSERT_TRUE(callSite("a").isStaticallyBound());
+    ASSERT_TRUE(callSite("c").isStaticallyBound() && callSite("c").staticReturnType() == DataType::TYPE_INTEGER);
+    ASSERT_FALSE(callSite("b").isStaticallyBound());
+    // lazy operations are never bound: they take their arguments unevaluated
+    ASSERT_TRUE(callSite("d").isLazy() && !callSite("d").isStaticallyBound());
+    ASSERT_FALSE(callSite("a").isLazy());
+    Program* inputs = parseProgram(std::string("x: 0.9\n"));
+    Context ctx;
+    ctx.dataProviders = { inputs, prog };
+    ctx.operationProviders = { ops };
+    ASSERT_TRUE(formatBatchValue(ctx.getCategoryValue("a")) == "0.75");
+    ASSERT_TRUE(formatBatchValue(ctx.getCategoryValue("b")) == "1.15");
+    ASSERT_TRUE(formatBatchValue(ctx.getCategoryValue("c")) == "2");
+    ASSERT_TRUE(formatBatchValue(ctx.getCategoryValue("d")) == "0");
+
+    // expressions parsed into an existing program share its arena; the name is copied in
+    inputs->setCategory(std::string("y"), parseExpression("len({1 2 3})", inputs));
+    ASSERT_TRUE(inputs->categories.size() == 2 && inputs->categories.count("y") == 1);
+    Context rowCtx;
+    rowCtx.dataProviders = { inputs };
+    rowCtx.operationProviders = { ops };
+    ASSERT_TRUE(formatBatchValue(rowCtx.getCategoryValue("y")) == "3");
+    bool threw = false;
+    try {
+        parseExpression("0.5 0.7", inputs);
+    } catch (const std::exception&) {
+        threw = true;
+    }
+    ASSERT_TRUE(threw);
+    delete inputs;
+    delete prog;
+
+    // constant operations and lists fold once; anything touching a category or failing stays
+    Program* folding = parseProgram(std::string(
+        "a: require(85% 60%)\n"
+        "b: map(0 1 0 100 {0.5 0.25:2})\n"
+        "c: { a b:2 raw }\n"
+        "d: nope(1 2)\n"
+        "e: len({1 2 {3 4}})\n"
+        "f: clamp(0 1 join(raw {2}))\n"));
+    std::string unfoldedD = evaluateFormatted(folding, ops, "d");
+    ASSERT_TRUE(folding->foldConstants({ ops }) == 7);
+    ASSERT_TRUE(folding->categories["a"]->constantValue() && folding->categories["b"]->constantValue());
+    ASSERT_TRUE(!folding->categories["c"]->constantValue() && !folding->categories["d"]->constantValue());
+    ASSERT_TRUE(evaluateFormatted(folding, ops, "e") == "3");
+    ASSERT_TRUE(evaluateFormatted(folding, ops, "b") == "{50 25:2}" && evaluateFormatted(folding, ops, "d") == unfoldedD);
+    // every evaluation shares the folded list's entries
+    Context foldCtx;
+    foldCtx.dataProviders = { folding };
+    foldCtx.operationProviders = { ops };
+    ASSERT_TRUE(static_cast<ListValue*>(foldCtx.getCategoryValue("b"))->isShared());
+    ASSERT_TRUE(folding->foldConstants({ ops }) == 0);
+
+    // registered operations fold only once they are declared pure
+    BasicOperationProvider* registered = new BasicOperationProvider();
+    registered->registerOperation("twice", std::function<double(double)>([](double g) { return 2 * g; }));
+    Program* undeclared = parseProgram(std::string("g: twice(0.25)\n"));
+    ASSERT_TRUE(!registered->isPure("twice") && undeclared->foldConstants({ registered, ops }) == 0);
+    registered->declarePure("twice");
+    ASSERT_TRUE(undeclared->foldConstants({ registered, ops }) == 1 && undeclared->categories["g"]->constantValue());
+    delete undeclared;
+    delete registered;
+    delete folding;
+    delete ops;
+    std::cout << "All bytecode tests passed." << std::endl;
+    return true;
+}
+
+// Counts how often a list operation actually runs.
+static size_t tallyCalls = 0;
+static ListValue* tally(ListValue* lv) {
+    ++tallyCalls;
+    return lv;
+}
+
+static std::vector<std::string> evaluateAll(const std::vector<DataProvider*>& programs, OperationProvider* ops, const std::vector<std::string>& names) {
+    Context ctx;
+    ctx.dataProviders = programs;
+    ctx.operationProviders = { ops };
+    std::vector<std::string> out;
+    for (const std::string& name : names) out.push_back(formatBatchValue(ctx.getCategoryValue(name)));
+    return out;
+}
+
+bool runSubexpressionTests() {
+    std::string errorMsg;
+    const char* policy =
+        "hw: {50% undef 90% 70%}\n"
+        "a: { drop(1 tally(resolve(0 hw))) 1 }\n"
+        "b: clamp(0 0.8 drop(1 tally(resolve(0 hw))))\n";
+    const char* extra = "c: top(1 drop(1 tally(resolve(0 hw))))\n";
+    std::vector<std::string> names = { "a", "b", "c" };
+    BasicOperationProvider* ops = createProvider();
+    ops->registerOperation("tally", tally);
+    ops->declarePure("tally"); // counts evaluations, but its result depends only on its argument
+
+    Program* plain1 = parseProgram(std::string(policy));
+    Program* plain2 = parseProgram(std::string(extra));
+    tallyCalls = 0;
+    std::vector<std::string> expected = evaluateAll({ plain1, plain2 }, ops, names);
+    ASSERT_TRUE(tallyCalls == 3 && expected[1] == "{0.5 0.8 0.7}");
+
+    // the repeated subtree is one node within a file and one memo entry across both files
+    Program* prog1 = parseProgram(std::string(policy));
+    Program* prog2 = parseProgram(std::string(extra));
+    SubexpressionTable table;
+    ASSERT_TRUE(eliminateCommonSubexpressions({ prog1, prog2 }, table, { ops }) > 0);
+    tallyCalls = 0;
+    ASSERT_TRUE(evaluateAll({ prog1, prog2 }, ops, names) == expected && tallyCalls == 1);
+    ASSERT_TRUE(evaluateAll({ prog1, prog2 }, ops, names) == expected && tallyCalls == 2);
+    prog1->link({ ops });
+    prog2->link({ ops });
+    CompiledProgram* compiled1 = compileProgram(*prog1);
+    CompiledProgram* compiled2 = compileProgram(*prog2);
+    tallyCalls = 0;
+    ASSERT_TRUE(evaluateAll({ compiled1, compiled2 }, ops, names) == expected && tallyCalls == 1);
+
+    // a later program shares with the earlier ones from its own side
+    Program* prog3 = parseProgram(std::string("d: drop(1 tally(resolve(0 hw)))\n"));
+    eliminateCommonSubexpressions({ prog3 }, table, { ops });
+    tallyCalls = 0;
+    std::vector<std::string> withLater = evaluateAll({ prog1, prog2, prog3 }, ops, { "a", "d", "b", "c" });
+    ASSERT_TRUE(withLater[0] == expected[0] && withLater[1] == "{0.5 0.9 0.7}" && tallyCalls == 1);
+
+    // calls of operations registered without declarePure are never shared
+    BasicOperationProvider* impure = new BasicOperationProvider();
+    impure->registerOperation("tally", tally);
+    impure->registerOperation("drop", drop);
+    impure->registerOperation("resolve", resolve);
+    impure->declarePure("drop");
+    impure->declarePure("resolve");
+    Program* unshared = parseProgram(std::string("a: drop(1 tally(resolve(0 {1})))\nb: drop(1 tally(resolve(0 {1})))\n"));
+    eliminateCommonSubexpressions({ unshared }, table, { impure });
+    tallyCalls = 0;
+    evaluateAll({ unshared }, impure, { "a", "b" });
+    ASSERT_TRUE(tallyCalls == 2);
+    // declaring it pure lets a fresh elimination share it
+    impure->declarePure("tally");
+    Program* declared = parseProgram(std::string("a: drop(1 tally(resolve(0 {1})))\nb: drop(1 tally(resolve(0 {1})))\n"));
+    SubexpressionTable fresh;
+    ASSERT_TRUE(eliminateCommonSubexpressions({ declared }, fresh, { impure }) > 0);
+    tallyCalls = 0;
+    evaluateAll({ declared }, impure, { "a", "b" });
+    ASSERT_TRUE(tallyCalls == 1);
+
+    delete declared;
+    delete unshared;
+    delete impure;
+    delete prog3;
+    delete compiled2;
+    delete compiled1;
+    delete prog2;
+    delete prog1;
+    delete plain2;
+    delete plain1;
+    delete ops;
+    std::cout << "All subexpression tests passed." << std::endl;
+    return true;
+}
+
+bool runPlanTests() {
+    std::string errorMsg;
+    Program* base = parseProgram(std::string(
+        "hw: clamp(0 1 { raw raw bonus })\n"
+        "exam: 90%\n"
+        "unused: { exam exam }\n"
+        "loop: { loop }\n"));
+    Program* policy = parseProgram(std::string(
+        "total: { hw: 0.4 exam: 0.6 }\n"
+        "report: require(total 0.5 fail pass)\n"
+        "stuck: { loop total }\n"));
+    OperationProvider* ops = createProvider();
+    policy->link({ ops });
+    CompiledProgram* compiled = compileProgram(*policy);
+
+    // only what report reaches, across both programs, dependencies first
+    EvalPlan plan({ compiled, base }, { "report", "raw" });
+    ASSERT_TRUE(plan.size() == 4 && !plan.slotOf("unused") && !plan.slotOf("loop") && plan.cyclicCount() == 0);
+    ASSERT_TRUE(*plan.slotOf("hw") < *plan.slotOf("total") && *plan.slotOf("exam") < *plan.slotOf("total"));
+    ASSERT_TRUE(plan.targetSlot(0) == *plan.slotOf("report") && plan.targetSlot(1) == EvalPlan::NO_SLOT);
+    ASSERT_TRUE(plan.steps()[*plan.slotOf("hw")].provider == base && plan.steps()[*plan.slotOf("total")].provider == compiled);
+    ASSERT_TRUE(plan.inputs().size() == 4 && plan.inputs()[0] == "bonus" && plan.inputs()[3] == "raw");
+    // what an input or a category reaches, through the steps in between
+    std::vector<char> fromRaw = plan.dependentsOf({ "raw" });
+    ASSERT_TRUE(fromRaw[*plan.slotOf("hw")] && fromRaw[*plan.slotOf("report")] && !fromRaw[*plan.slotOf("exam")]);
+    std::vector<char> fromExam = plan.dependentsOf({ "exam", "nowhere" });
+    ASSERT_TRUE(fromExam[*plan.slotOf("exam")] && fromExam[*plan.slotOf("total")] && !fromExam[*plan.slotOf("hw")]);
+
+    // the same values as looking the targets up, also with a provider ahead of the plan's
+    Program* row = parseProgram(std::string("raw: 60%\nexam: 40%\n"));
+    for (DataProvider* first : { static_cast<DataProvider*>(nullptr), static_cast<DataProvider*>(row) }) {
+        Context planned;
+        Context direct;
+        planned.dataProviders = direct.dataProviders = { first, compiled, base };
+        planned.operationProviders = direct.operationProviders = { ops };
+        std::vector<Value*> values = planned.evaluatePlan(plan);
+        ASSERT_TRUE(values.size() == 2);
+        ASSERT_TRUE(formatBatchValue(values[0]) == formatBatchValue(direct.getCategoryValue("report")));
+        ASSERT_TRUE(formatBatchValue(values[1]) == formatBatchValue(direct.getCategoryValue("raw")));
+        ASSERT_TRUE(formatBatchValue(planned.getCategoryValue("total")) == formatBatchValue(direct.getCategoryValue("total")));
+    }
+
+    // a target behind a cycle has no slot and reports the cycle like a lookup would
+    EvalPlan cyclic({ compiled, base }, { "stuck", "exam" });
+    ASSERT_TRUE(cyclic.targetSlot(0) == EvalPlan::NO_SLOT && cyclic.cyclicCount() == 2);
+    Context ctx;
+    ctx.dataProviders = { compiled, base };
+    ctx.operationProviders = { ops };
+    try {
+        ctx.evaluatePlan(cyclic);
+    } catch (const std::exception& ex) {
+        errorMsg = ex.what();
+    }
+    ASSERT_TRUE(errorMsg == "Circular dependency: loop -> loop");
+    errorMsg.clear();
+
+    // a plan only runs in Contexts whose providers end with its own
+    bool threw = false;
+    Context other;
+    other.dataProviders = { base, compiled };
+    try {
+        other.evaluatePlan(plan);
+    } catch (const std::invalid_argument&) {
+        threw = true;
+    }
+    ASSERT_TRUE(threw);
+
+    delete row;
+    delete compiled;
+    delete ops;
+    delete policy;
+    delete base;
+    std::cout << "All plan tests passed." << std::endl;
+    return true;
+}
+
+bool runSymbolTests() {
+    std::string errorMsg;
+    Program* base = parseProgram(std::string(
+        "hw: clamp(0 1 { raw raw bonus })\n"
+        "exam: 90%\n"));
+    Program* policy = parseProgram(std::string(
+        "total: { hw: 0.4 exam: 0.6 }\n"
+        "report: require(total 0.5 fail pass)\n"
+        "loop: { again }\n"
+        "again: { loop }\n"));
+    OperationProvider* ops = createProvider();
+    SymbolTable symbols;
+    base->bindSymbols(symbols);
+    policy->bindSymbols(symbols);
+    policy->link({ ops });
+    CompiledProgram* compiled = compileProgram(*policy);
+    // ids are dense and shared: names used by both programs are interned once
+    ASSERT_TRUE(symbols.size() == 10 && symbols.name(*symbols.find("hw")) == "hw" && !symbols.find("missing"));
+    ASSERT_TRUE(symbols.intern("exam") == *symbols.find("exam") && symbols.size() == 10);
+
+    Program* row = parseProgram(std::string("raw: 60%\nexam: 40%\n"));
+    row->bindSymbols(symbols);
+    for (DataProvider* first : { static_cast<DataProvider*>(nullptr), static_cast<DataProvider*>(row) }) {
+        for (DataProvider* rest : { static_cast<DataProvider*>(policy), static_cast<DataProvider*>(compiled) }) {
+            Context bound;
+            Context byName;
+            bound.setSymbolTable(&symbols);
+            bound.dataProviders = byName.dataProviders = { first, rest, base };
+            bound.operationProviders = byName.operationProviders = { ops };
+            for (const char* name : { "report", "total", "hw", "exam", "raw", "pass", "missing" }) {
+                ASSERT_TRUE(formatBatchValue(bound.getCategoryValue(name)) == formatBatchValue(byName.getCategoryValue(name)));
+            }
+            // values are cached once, whichever way they are looked up
+            uint32_t total = *symbols.find("total");
+            ASSERT_TRUE(bound.getSymbolValue(total) == bound.getCategoryValue("total"));
+            try {
+                bound.getCategoryValue("loop");
+            } catch (const std::exception& ex) {
+                errorMsg = ex.what();
+            }
+            ASSERT_TRUE(errorMsg == "Circular dependency: loop -> again -> loop");
+            errorMsg.clear();
+        }
+    }
+
+    // names interned after the Context took the table are cached by name
+    Program* later = parseProgram(std::string("late: { total exam }\n"));
+    Context ctx;
+    ctx.setSymbolTable(&symbols);
+    later->bindSymbols(symbols);
+    ctx.dataProviders = { later, compiled, base };
+    ctx.operationProviders = { ops };
+    ASSERT_TRUE(*symbols.find("late") >= 10 && formatBatchValue(ctx.getCategoryValue("late")) == "{0.9 0.9}");
+    ASSERT_TRUE(ctx.getSymbolValue(*symbols.find("late")) == ctx.getCategoryValue("late"));
+
+    // a plan built with the table fills the slots directly
+    EvalPlan plan({ compiled, base }, { "report" }, &symbols);
+    ASSERT_TRUE(plan.steps()[*plan.slotOf("exam")].symbol == *symbols.find("exam"));
+    Context planned;
+    planned.setSymbolTable(&symbols);
+    planned.dataProviders = { row, compiled, base };
+    planned.operationProviders = { ops };
+    Value* report = planned.evaluatePlan(plan)[0];
+    ASSERT_TRUE(report == planned.getSymbolValue(*symbols.find("report")) && formatBatchValue(report) == "0");
+
+    delete later;
+    delete row;
+    delete compiled;
+    delete ops;
+    delete policy;
+    delete base;
+    std::cout << "All symbol tests passed." << std::endl;
+    return true;
+}
+
+bool runIncrementalTests() {
+    std::string errorMsg;
+    // score feeds hw and, through a repeated subexpression, curved; bonus only feeds extra
+    const std::string source =
+        "hw: { score 80% }\n"
+        "curved: clamp(0 1 { score score })\n"
+        "total: { hw: 0.5 curved: 0.5 }\n"
+        "extra: { bonus }\n"
+        "report: { total extra }\n";
+    OperationProvider* ops = createProvider();
+    Program* tree = parseProgram(source);
+    Program* optimized = parseProgram(source);
+    SubexpressionTable table;
+    SymbolTable symbols;
+    optimized->foldConstants({ ops });
+    eliminateCommonSubexpressions({ optimized }, table, { ops });
+    optimized->bindSymbols(symbols);
+    optimized->link({ ops });
+    CompiledProgram* compiled = compileProgram(*optimized);
+
+    for (DataProvider* provider : { static_cast<DataProvider*>(tree), static_cast<DataProvider*>(compiled) }) {
+        Context ctx;
+        ctx.setSymbolTable(provider == compiled ? &symbols : nullptr);
+        ctx.dataProviders = { provider };
+        ctx.operationProviders = { ops };
+        ctx.trackDependencies();
+        ASSERT_TRUE(ctx.setCategoryValue("score", new GradeValue(0.5)) == 0);
+        ctx.setCategoryValue("bonus", new GradeValue(0.1));
+        Value* before = ctx.getCategoryValue("report");
+        ASSERT_TRUE(formatBatchValue(before) == "{0.575 0.1}" && ctx.recomputedCount() == 0);
+
+        // only score's dependents are recomputed; extra keeps its cached value
+        Value* extra = ctx.getCategoryValue("extra");
+        ASSERT_TRUE(ctx.setCategoryValue("score", new GradeValue(0.9)) == 4);
+        ASSERT_TRUE(formatBatchValue(ctx.getCategoryValue("report")) == "{0.875 0.1}" && ctx.recomputedCount() == 4);
+        ASSERT_TRUE(ctx.getCategoryValue("extra") == extra && formatBatchValue(before) == "{0.575 0.1}");
+        ASSERT_TRUE(ctx.setCategoryValue("bonus", new GradeValue(0.3)) == 2);
+        ASSERT_TRUE(formatBatchValue(ctx.getCategoryValue("report")) == "{0.875 0.3}" && ctx.recomputedCount() == 6);
+
+        // a fresh Context with the same inputs agrees
+        Context fresh;
+        fresh.dataProviders = { provider };
+        fresh.operationProviders = { ops };
+        fresh.trackDependencies();
+        fresh.setCategoryValue("score", new GradeValue(0.9));
+        fresh.setCategoryValue("bonus", new GradeValue(0.3));
+        ASSERT_TRUE(formatBatchValue(fresh.getCategoryValue("report")) == "{0.875 0.3}");
+    }
+
+    bool threw = false;
+    Context plain;
+    try {
+        plain.setCategoryValue("score", new GradeValue(0.5));
+    } catch (const std::runtime_error&) {
+        threw = true;
+    }
+    ASSERT_TRUE(threw);
+
+    delete compiled;
+    delete optimized;
+    delete tree;
+    delete ops;
+    std::cout << "All incremental tests passed." << std::endl;
+    return true;
+}
+
+bool runForkTests() {
+    std::string errorMsg;
+    Program* prog = parseProgram(std::string(
+        "hw: {80% 90% 70%}\n"
+        "total: { hw: 0.4 exam: 0.6 }\n"
+        "passed: require(total 0.7)\n"
+        "summary: { hw hw }\n"));
+    OperationProvider* ops = createProvider();
+    SymbolTable symbols;
+    prog->bindSymbols(symbols);
+    prog->link({ ops });
+    CompiledProgram* compiled = compileProgram(*prog);
+
+    for (const SymbolTable* table : { static_cast<const SymbolTable*>(nullptr), static_cast<const SymbolTable*>(&symbols) }) {
+        Context base;
+        base.setSymbolTable(table);
+        base.dataProviders = { compiled };
+        base.operationProviders = { ops };
+        base.trackDependencies();
+        base.setCategoryValue("exam", new GradeValue(0.5));
+        Value* hw = base.getCategoryValue("hw");
+        ASSERT_TRUE(formatBatchValue(base.getCategoryValue("passed")) == "0");
+
+        // a fork shares everything the override does not reach, and leaves its parent alone
+        Context* fork = base.fork();
+        ASSERT_TRUE(fork->setCategoryValue("exam", new GradeValue(0.9)) == 2);
+        ASSERT_TRUE(formatBatchValue(fork->getCategoryValue("passed")) == "1" && fork->recomputedCount() == 2);
+        ASSERT_TRUE(fork->getCategoryValue("hw") == hw && formatBatchValue(fork->getCategoryValue("summary")) == "{0.8 0.8}");
+        ASSERT_TRUE(formatBatchValue(base.getCategoryValue("passed")) == "0");
+        // forks of forks see the overrides of every ancestor
+        Context* nested = fork->fork();
+        nested->setCategoryValue("hw", new GradeValue(0.0));
+        ASSERT_TRUE(formatBatchValue(nested->getCategoryValue("total")) == "{0:0.4 0.9:0.6}");
+        ASSERT_TRUE(formatBatchValue(fork->getCategoryValue("total")) == "{0.8:0.4 0.9:0.6}");
+        delete nested;
+        delete fork;
+
+        // passing needs 0.4 * 0.8 + 0.6 * exam >= 0.7
+        GoalSeekResult seek = goalSeek(base, "exam", "total", 0.7, 0.0, 1.0, 1e-9);
+        ASSERT_TRUE(seek.reached && std::fabs(seek.input - 0.38 / 0.6) < 1e-6 && seek.value >= 0.7);
+        // each probe recomputes total alone
+        ASSERT_TRUE(seek.probes > 2 && seek.recomputed == seek.probes);
+        ASSERT_TRUE(!goalSeek(base, "exam", "total", 0.95).reached);
+    }
+
+    bool threw = false;
+    Context plain;
+    try {
+        delete plain.fork();
+    } catch (const std::runtime_error&) {
+        threw = true;
+    }
+    ASSERT_TRUE(threw);
+
+    delete compiled;
+    delete prog;
+    delete ops;
+    std::cout << "All fork tests passed." << std::endl;
+    return true;
+}
+
+static double pickGrade(double) { return 1.0; }
+static double pickInteger(unsigned long long) { return 2.0; }
+
+static std::string callFormatted(BasicOperationProvider* provider, const std::string& name, std::vector<Value*> args) {
+    std::vector<Datum> datums;
+    for (Value* arg : args) datums.push_back(Datum::take(arg));
+    Value* v = provider->executeOperation(name, datums).box();
+    std::string out = formatBatchValue(v);
+    delete v;
+    return out;
+}
+
+bool runOperationTests() {
+    std::string errorMsg;
+    BasicOperationProvider* provider = createProvider();
+    // overloads are ranked in registration order: an INTEGER argument also casts to a grade
+    provider->registerOperation("pick", pickGrade);
+    provider->registerOperation("pick", pickInteger);
+    provider->registerOperation("pick2", pickInteger);
+    provider->registerOperation("pick2", pickGrade);
+    ASSERT_TRUE(callFormatted(provider, "pick", { new IntegerValue(3) }) == "1");
+    ASSERT_TRUE(callFormatted(provider, "pick2", { new IntegerValue(3) }) == "2");
+    ASSERT_TRUE(callFormatted(provider, "pick2", { new GradeValue(0.5) }) == "1");
+    ASSERT_TRUE(callFormatted(provider, "require", { new GradeValue(0.5), new IntegerValue(1), new GradeValue(0.25) }) == "0");
+    ASSERT_TRUE(provider->resolveOperation("pick", { DataType::TYPE_LIST }).fn != nullptr);
+    ASSERT_TRUE(provider->resolveOperation("pick", { DataType::TYPE_GRADE, DataType::TYPE_GRADE }).fn == nullptr);
+    ASSERT_FALSE(provider->hasOperation("pick3"));
+
+    // a large registry still resolves every name to its own overload
+    for (int i = 0; i < 2000; ++i) {
+        provider->registerOperation("lib" + std::to_string(i), pickGrade);
+    }
+    ASSERT_TRUE(provider->hasOperation("lib1999") && callFormatted(provider, "lib1234", { new GradeValue(0) }) == "1");
+    ASSERT_TRUE(callFormatted(provider, "len", { new ListValue() }) == "0");
+
+    // Datums hold scalars inline and own their list; moves leave an undefined grade behind
+    Datum grade = Datum::makeGrade(0.25);
+    Datum moved = std::move(grade);
+    ASSERT_TRUE(moved.getType() == DataType::TYPE_GRADE && moved.getGrade() == 0.25 && std::isnan(grade.getGrade()));
+    ASSERT_TRUE(Datum::makeInteger(4).toGrade() == 4.0 && std::isnan(Datum().toGrade()));
+    ListValue* owned = new ListValue();
+    owned->addValue(0.5);
+    owned->addValue(1.0, 3);
+    Datum list = Datum::makeList(owned);
+    Datum listCopy = list.copy();
+    ASSERT_TRUE(listCopy.getList() != owned && listCopy.getList()->isShared() && list.toGrade() == 0.875);
+    list = Datum::makeInteger(7);
+    ASSERT_TRUE(list.getType() == DataType::TYPE_INTEGER && !listCopy.getList()->isShared());
+    Value* boxed = listCopy.box();
+    ASSERT_TRUE(boxed->getType() == DataType::TYPE_LIST && std::isnan(listCopy.getGrade()));
+    Datum back = Datum::take(boxed);
+    ASSERT_TRUE(back.getType() == DataType::TYPE_LIST && back.getList() == boxed);
+    std::vector<Datum> requireArgs;
+    requireArgs.push_back(Datum::makeInteger(1));
+    requireArgs.push_back(Datum::makeGrade(0.5));
+    Datum required = provider->executeOperation("require", requireArgs);
+    ASSERT_TRUE(required.getType() == DataType::TYPE_GRADE && required.getGrade() == 1.0);
+    requireArgs.clear();
+    requireArgs.push_back(Datum::makeGrade(0.5));
+    try {
+        provider->executeOperation("len", requireArgs);
+    } catch (const std::exception& ex) {
+        errorMsg = ex.what();
+    }
+    ASSERT_TRUE(errorMsg == "Operation not found: len");
+    errorMsg.clear();
+
+    // list copies share their entries until one of them is written
+    ListValue* scores = new ListValue();
+    scores->addValue(0.4);
+    scores->addValue(std::numeric_limits<double>::quiet_NaN(), 2);
+    scores->addValue(0.9);
+    ListValue* shared = scores->copy();
+    ASSERT_TRUE(scores->isShared() && shared->isShared());
+    ASSERT_TRUE(callFormatted(provider, "clamp", { new GradeValue(0.5), new GradeValue(0.8), scores->copy() }) == "{0.5 undef:2 0.8}");
+    ASSERT_TRUE(callFormatted(provider, "resolve", { new GradeValue(0), scores->copy() }) == "{0.4 0:2 0.9}");
+    ASSERT_TRUE(callFormatted(provider, "drop", { new IntegerValue(1), scores->copy() }) == "{undef:2 0.9}");
+    ASSERT_TRUE(callFormatted(provider, "join", { scores->copy(), shared->copy() }) == "{0.4 undef:2 0.9 0.4 undef:2 0.9}");
+    ASSERT_TRUE(formatBatchValue(scores) == "{0.4 undef:2 0.9}" && formatBatchValue(shared) == "{0.4 undef:2 0.9}");
+    shared->setValueAt(0, 1.0);
+    ASSERT_TRUE(!scores->isShared() && !shared->isShared());
+    ASSERT_TRUE(scores->getValueAt(0) == 0.4 && shared->getValueAt(0) == 1.0);
+    delete shared;
+    delete scores;
+
+    // drop/top: undefined entries are never dropped; of equal values the earliest go first,
+    // whatever their weights
+    const double nan = std::numeric_limits<double>::quiet_NaN();
+    ListValue* tied = new ListValue();
+    tied->addValue(0.5, 1);
+    tied->addValue(nan);
+    tied->addValue(0.5, 2);
+    tied->addValue(0.7);
+    tied->addValue(0.5, 3);
+    ASSERT_TRUE(callFormatted(provider, "drop", { new IntegerValue(1), tied->copy() }) == "{undef 0.5:2 0.7 0.5:3}");
+    ASSERT_TRUE(callFormatted(provider, "drop", { new IntegerValue(2), tied->copy() }) == "{undef 0.7 0.5:3}");
+    ASSERT_TRUE(callFormatted(provider, "drop", { new IntegerValue(9), tied->copy() }) == "{undef}");
+    ASSERT_TRUE(callFormatted(provider, "top", { new IntegerValue(2), tied->copy() }) == "{undef 0.7}");
+    ASSERT_TRUE(callFormatted(provider, "top", { new IntegerValue(9), tied->copy() }) == formatBatchValue(tied));
+    delete tied;
+    // against a stable sort by value, earliest first among ties, on short weighted lists full of ties
+    uint32_t seed = 7;
+    auto next = [&seed](uint32_t bound) {
+        seed = seed * 1664525u + 1013904223u;
+        return (seed >> 8) % bound;
+    };
+    for (size_t c = 0; c < 2000; ++c) {
+        ListValue list;
+        size_t length = next(12);
+        for (size_t i = 0; i < length; ++i) {
+            list.addValue(next(7) == 0 ? nan : next(4) / 4.0, 1.0 + next(3));
+        }
+        unsigned long long n = next(13);
+        std::vector<size_t> order;
+        for (size_t i = 0; i < length; ++i) {
+            if (!std::isnan(list.getValueAt(i))) order.push_back(i);
+        }
+        std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return list.getValueAt(a) < list.getValueAt(b); });
+        std::vector<bool> dropped(length, false);
+        for (size_t k = 0; k < n && k < order.size(); ++k) dropped[order[k]] = true;
+        ListValue expected;
+        for (size_t i = 0; i < length; ++i) {
+            if (!dropped[i]) expected.addValue(list.getValueAt(i), list.getWeightAt(i));
+        }
+        ListValue* result = drop(n, list.copy());
+        ASSERT_TRUE(formatBatchValue(result) == formatBatchValue(&expected));
+        delete result;
+    }
+
+    // variadic reductions skip undefined values and weigh list entries as toGrade does
+    ListValue* marks = new ListValue();
+    marks->addValue(0.4);
+    marks->addValue(nan, 2);
+    marks->addValue(0.8, 3);
+    ASSERT_TRUE(callFormatted(provider, "sum", { new IntegerValue(1), new GradeValue(0.5), marks->copy() }) == "4.3");
+    GradeValue* mean = marks->toGrade();
+    ASSERT_TRUE(callFormatted(provider, "avg", { marks->copy() }) == formatBatchValue(mean));
+    delete mean;
+    ASSERT_TRUE(callFormatted(provider, "avg", { new IntegerValue(1), new GradeValue(0.5), marks->copy() }) == "0.716667");
+    ASSERT_TRUE(callFormatted(provider, "min", { new GradeValue(0.7), marks->copy(), new GradeValue(nan) }) == "0.4");
+    ASSERT_TRUE(callFormatted(provider, "max", { new GradeValue(0.7), marks->copy(), new GradeValue(nan) }) == "0.8");
+    ASSERT_TRUE(callFormatted(provider, "count", { new GradeValue(0.7), marks->copy(), new GradeValue(nan) }) == "3");
+    ASSERT_TRUE(callFormatted(provider, "sum", {}) == "undef" && callFormatted(provider, "count", {}) == "0");
+    ASSERT_TRUE(callFormatted(provider, "max", { new GradeValue(nan), new ListValue() }) == "undef");
+    delete marks;
+    // the reductions resolve statically for any argument types
+    ASSERT_TRUE(provider->resolveOperation("sum", { DataType::TYPE_GRADE, DataType::TYPE_LIST, DataType::TYPE_INTEGER }).fn != nullptr);
+    ASSERT_TRUE(provider->resolveOperation("count", { DataType::TYPE_LIST }).returnType == DataType::TYPE_INTEGER);
+
+    // a variadic signature repeats its last type after a fixed prefix; fixed arities win
+    OperationFn countArgs = [](std::vector<Datum>& args) { return Datum::makeInteger(args.size()); };
+    provider->registerOperation(OperationSignature("rest", { DataType::TYPE_INTEGER, DataType::TYPE_LIST }, DataType::TYPE_INTEGER, true), countArgs);
+    provider->registerOperation("rest", std::function<unsigned long long(unsigned long long)>([](unsigned long long) -> unsigned long long { return 99; }));
+    ASSERT_TRUE(callFormatted(provider, "rest", { new IntegerValue(2) }) == "99");
+    ASSERT_TRUE(callFormatted(provider, "rest", { new IntegerValue(2), new ListValue(), new ListValue() }) == "3");
+    ASSERT_TRUE(provider->resolveOperation("rest", { DataType::TYPE_GRADE, DataType::TYPE_LIST }).fn == nullptr);
+    ASSERT_TRUE(provider->resolveOperation("rest", { DataType::TYPE_INTEGER, DataType::TYPE_GRADE }).fn == nullptr);
+    bool threw = false;
+    try {
+        provider->registerOperation(OperationSignature("none", {}, DataType::TYPE_GRADE, true), countArgs);
+    } catch (const std::invalid_argument&) {
+        threw = true;
+    }
+    ASSERT_TRUE(threw && !provider->hasOperation("none"));
+    delete provider;
+    std::cout << "All operation tests passed." << std::endl;
+    return true;
+}
+
+static std::string cycleText(const DependencyGraph& graph) {
+    std::string out;
+    for (uint32_t i : graph.cycle()) {
+        if (!out.empty()) out += " ";
+        out += std::string(graph.name(i));
+    }
+    return out;
+}
+
+bool runDependencyTests() {
+    std::string errorMsg;
+    Program* prog = parseProgram(std::string(
+        "total: { hw: 0.4 exam: 0.6 }\n"
+        "hw: clamp(0 1 { raw raw bonus })\n"
+        "exam: 90%\n"
+        "report: require(total 0.5 fail pass)\n"));
+    const DependencyGraph& graph = *prog->dependencyGraph();
+    uint32_t total = *graph.indexOf("total");
+    uint32_t hw = *graph.indexOf("hw");
+    uint32_t exam = *graph.indexOf("exam");
+    uint32_t report = *graph.indexOf("report");
+    ASSERT_TRUE(graph.size() == 4 && !graph.indexOf("raw") && !graph.hasCycle());
+    ASSERT_TRUE(graph.dependencies(total).size() == 2 && graph.dependencies(hw).empty());
+    ASSERT_TRUE(graph.dependents(total).size() == 1 && *graph.dependents(total).begin() == report);
+    ASSERT_TRUE(graph.dependents(exam).size() == 1 && *graph.dependents(exam).begin() == total);
+    ASSERT_TRUE(graph.externalNames().size() == 4 && graph.externalNames()[0] == "bonus" && graph.externalNames()[3] == "raw");
+    ASSERT_TRUE(graph.externalDependencies(hw).size() == 2 && graph.externalNames()[*graph.externalDependencies(hw).begin()] == "bonus");
+    ASSERT_TRUE(graph.externalDependencies(total).empty() && graph.externalDependencies(report).size() == 2);
+    std::vector<size_t> position(graph.size());
+    for (size_t k = 0; k < graph.topologicalOrder().size(); ++k) position[graph.topologicalOrder()[k]] = k;
+    ASSERT_TRUE(graph.topologicalOrder().size() == 4 && position[hw] < position[total] && position[exam] < position[total] && position[total] < position[report]);
+    // redefining a category rebuilds the graph
+    prog->setCategory("exam", parseExpression("{ report }", prog));
+    ASSERT_TRUE(prog->dependencyGraph()->hasCycle() && cycleText(*prog->dependencyGraph()) == "exam report total exam");
+    ASSERT_TRUE(prog->dependencyGraph()->topologicalOrder().size() == 1);
+
+    // evaluating a cycle reports it instead of recursing until the stack overflows
+    OperationProvider* ops = createProvider();
+    Context ctx;
+    ctx.dataProviders = { prog };
+    ctx.operationProviders = { ops };
+    try {
+        ctx.getCategoryValue("report");
+    } catch (const std::exception& ex) {
+        errorMsg = ex.what();
+    }
+    ASSERT_TRUE(errorMsg == "Circular dependency: report -> total -> exam -> report");
+    errorMsg.clear();
+    prog->link({ ops });
+    CompiledProgram* compiled = compileProgram(*prog);
+    Context vmCtx;
+    vmCtx.dataProviders = { compiled };
+    vmCtx.operationProviders = { ops };
+    try {
+        vmCtx.getCategoryValue("exam");
+    } catch (const std::exception& ex) {
+        errorMsg = ex.what();
+    }
+    ASSERT_TRUE(errorMsg == "Circular dependency: exam -> report -> total -> exam");
+    errorMsg.clear();
+    // an earlier provider that supplies a category breaks the cycle
+    Program* inputs = parseProgram(std::string("exam: 0.8\n"));
+    Context brokenCtx;
+    brokenCtx.dataProviders = { inputs, compiled };
+    brokenCtx.operationProviders = { ops };
+    ASSERT_TRUE(formatBatchValue(brokenCtx.getCategoryValue("report")) == "1");
+
+    Program* self = parseProgram(std::string("a: max(a 1)\n"));
+    ASSERT_TRUE(cycleText(*self->dependencyGraph()) == "a a");
+    delete self;
+    delete inputs;
+    delete compiled;
+    delete prog;
+    delete ops;
+    std::cout << "All dependency tests passed." << std::endl;
+    return true;
+}
+
+// A provider without a dependency graph; parallel evaluation runs its categories as single tasks.
+class OpaqueProvider : public DataProvider {
+public:
+    Value* getCategoryValue(const std::string& categoryName, Context* ctx) override {
+        if (categoryName != "opaque") return nullptr;
+        Value* unit = ctx->getCategoryValue("unit3")->copy();
+        Value* grade = castValue(unit, DataType::TYPE_GRADE);
+        double half = static_cast<GradeValue*>(grade)->getVal() / 2;
+        if (grade != unit) delete grade;
+        delete unit;
+        return new GradeValue(half);
+    }
+};
+
+bool runParallelTests() {
+    std::string errorMsg;
+    // many independent units feeding one final grade, plus a cycle and an opaque provider
+    std::string source;
+    std::string final = "final: {";
+    for (int u = 0; u < 200; ++u) {
+        std::string unit = "unit" + std::to_string(u);
+        source += unit + "hw: {" + std::to_string(u % 10) + "0% 90% undef}\n";
+        source += unit + "lab: clamp(0 1 " + unit + "hw)\n";
+        source += unit + ": { " + unit + "hw: 0.3 " + unit + "lab: 0.7 }\n";
+        final += " " + unit;
+    }
+    source += final + " opaque }\nloopA: loopB\nloopB: { loopA }\n";
+    Program* prog = parseProgram(source);
+    OperationProvider* ops = createProvider();
+    prog->link({ ops });
+    CompiledProgram* compiled = compileProgram(*prog);
+    OpaqueProvider opaque;
+    std::vector<std::string> targets = { "final", "unit7", "loopA", "nothing" };
+
+    Context sequential;
+    sequential.dataProviders = { &opaque, compiled };
+    sequential.operationProviders = { ops };
+    std::vector<std::string> expected;
+    for (const char* t : { "final", "unit7", "nothing" }) {
+        expected.push_back(formatBatchValue(sequential.getCategoryValue(t)));
+    }
+
+    for (unsigned threads : { 1u, 4u }) {
+        WorkStealingPool pool(threads);
+        for (DataProvider* dp : std::vector<DataProvider*>{ compiled, prog }) {
+            Context ctx;
+            ctx.dataProviders = { &opaque, dp };
+            ctx.operationProviders = { ops };
+            errorMsg.clear();
+            try {
+                ctx.evaluateParallel(targets, pool);
+            } catch (const std::exception& ex) {
+                errorMsg = ex.what();
+            }
+            // errors surface as for sequential lookups, in request order
+            ASSERT_TRUE(errorMsg == "Circular dependency: loopA -> loopB -> loopA");
+            std::vector<Value*> values = ctx.evaluateParallel({ "final", "unit7", "nothing" }, pool);
+            ASSERT_TRUE(formatBatchValue(values[0]) == expected[0] && formatBatchValue(values[1]) == expected[1]);
+            ASSERT_TRUE(values[2] == &undefinedGrade && expected[2] == "undef");
+        }
+    }
+
+    // the pool runs every task once, including tasks submitted by tasks
+    WorkStealingPool pool(4);
+    std::atomic<int> ran(0);
+    for (int i = 0; i < 100; ++i) {
+        pool.submit([&]() {
+            for (int k = 0; k < 10; ++k) pool.submit([&]() { ran.fetch_add(1); });
+            ran.fetch_add(1);
+        });
+    }
+    pool.helpUntil([&]() { return ran.load() == 1100; });
+    ASSERT_TRUE(ran.load() == 1100);
+
+    delete compiled;
+    delete prog;
+    delete ops;
+    std::cout << "All parallel tests passed." << std::endl;
+    return true;
+}
+
+static bool sameDouble(double a, double b) {
+    return (std::isnan(a) && std::isnan(b)) || a == b;
+}
+
+// Runs op on a copy of list at every SIMD level and checks each value with expect(original).
+template<typename Op, typename Expect>
+static bool kernelMatches(const ListValue& list, Op op, Expect expect) {
+    SimdLevel saved = activeSimdLevel();
+    bool ok = true;
+    for (SimdLevel level : { SimdLevel::SCALAR, SimdLevel::SSE2, SimdLevel::AVX2 }) {
+        setSimdLevel(level);
+        ListValue* out = op(list.copy());
+        for (size_t i = 0; i < list.size(); ++i) {
+            ok = ok && sameDouble(out->getValueAt(i), expect(list.getValueAt(i))) && out->getWeightAt(i) == list.getWeightAt(i);
+        }
+        delete out;
+    }
+    setSimdLevel(saved);
+    return ok;
+}
+
+bool runListKernelTests() {
+    std::string errorMsg = std::string("supported SIMD level ") + simdLevelName(supportedSimdLevel());
+    const double nan = std::numeric_limits<double>::quiet_NaN();
+    // lengths around the vector widths exercise the scalar tails
+    for (size_t n : { 0, 1, 3, 4, 5, 8, 1001 }) {
+        ListValue list;
+        for (size_t i = 0; i < n; ++i) {
+            list.addValue(i % 7 == 3 ? nan : static_cast<double>((i * 37) % 101) / 80.0, 1.0 + static_cast<double>(i % 5));
+        }
+        ASSERT_TRUE(kernelMatches(list, [](ListValue* lv) { return clamp(0.25, 0.75, lv); },
+            [](double v) { return std::isnan(v) ? v : (v < 0.25 ? 0.25 : (v > 0.75 ? 0.75 : v)); }));
+        ASSERT_TRUE(kernelMatches(list, [](ListValue* lv) { return clamp(0.75, 0.25, lv); },
+            [](double v) { return std::isnan(v) ? v : (v < 0.75 ? 0.75 : (v > 0.25 ? 0.25 : v)); }));
+        ASSERT_TRUE(kernelMatches(list, [](ListValue* lv) { return maxOf(0.5, lv); },
+            [](double v) { return !std::isnan(v) && v < 0.5 ? 0.5 : v; }));
+        ASSERT_TRUE(kernelMatches(list, [](ListValue* lv) { return minOf(0.5, lv); },
+            [](double v) { return !std::isnan(v) && v > 0.5 ? 0.5 : v; }));
+        ASSERT_TRUE(kernelMatches(list, [](ListValue* lv) { return map(0, 1, 0, 100, lv); },
+            [](double v) { return std::isnan(v) ? v : 0 + ((v - 0) / 1) * 100; }));
+        ASSERT_TRUE(kernelMatches(list, [](ListValue* lv) { return map(1, 1, 0, 1, lv); },
+            [](double v) { return std::isnan(v) ? v : 0.5; }));
+        ASSERT_TRUE(kernelMatches(list, [](ListValue* lv) { return resolve(0.1, lv); },
+            [](double v) { return std::isnan(v) ? 0.1 : v; }));
+
+        // the weighted mean rounds identically at every level and stays close to a plain sum
+        double sum = 0, weight = 0;
+        for (size_t i = 0; i < n; ++i) {
+            if (std::isnan(list.getValueAt(i))) continue;
+            sum += list.getValueAt(i) * list.getWeightAt(i);
+            weight += list.getWeightAt(i);
+        }
+        double expected = weight == 0 ? nan : sum / weight;
+        SimdLevel saved = activeSimdLevel();
+        setSimdLevel(SimdLevel::SCALAR);
+        double scalarMean = list.weightedMean();
+        setSimdLevel(SimdLevel::SSE2);
+        double sse2Mean = list.weightedMean();
+        setSimdLevel(SimdLevel::AVX2);
+        double avx2Mean = list.weightedMean();
+        setSimdLevel(saved);
+        ASSERT_TRUE(sameDouble(scalarMean, sse2Mean) && sameDouble(scalarMean, avx2Mean));
+        ASSERT_TRUE(sameDouble(scalarMean, expected) || std::fabs(scalarMean - expected) < 1e-12);
+
+        // extremes and counts of the defined values agree at every level
+        double lo = nan, hi = nan;
+        size_t defined = 0;
+        for (size_t i = 0; i < n; ++i) {
+            double v = list.getValueAt(i);
+            if (std::isnan(v)) continue;
+            lo = defined == 0 || v < lo ? v : lo;
+            hi = defined == 0 || v > hi ? v : hi;
+            ++defined;
+        }
+        for (SimdLevel level : { SimdLevel::SCALAR, SimdLevel::SSE2, SimdLevel::AVX2 }) {
+            setSimdLevel(level);
+            double minValue, maxValue;
+            size_t count;
+            definedExtremes(list.values(), n, minValue, maxValue, count);
+            ASSERT_TRUE(sameDouble(minValue, lo) && sameDouble(maxValue, hi) && count == defined);
+        }
+        setSimdLevel(saved);
+    }
+    ASSERT_TRUE(setSimdLevel(SimdLevel::AVX2) == supportedSimdLevel());
+    std::cout << "All list kernel tests passed." << std::endl;
+    return true;
+}
+
+// Supplies "raw", a list longer than a fusion block, with undefined values and uneven weights.
+class RawListProvider : public DataProvider {
+public:
+    ListValue raw;
+    Value* getCategoryValue(const std::string& categoryName, Context* /*ctx*/) override {
+        return categoryName == "raw" ? raw.copy() : nullptr;
+    }
+};
+
+// Whether two category values are the same down to the last bit (errors as nullptr).
+static bool sameValue(const Value* a, const Value* b) {
+    if (!a || !b || a->getType() != b->getType()) return a == b;
+    Datum x = Datum::fromValue(a), y = Datum::fromValue(b);
+    if (x.getType() != DataType::TYPE_LIST) return sameDouble(x.toGrade(), y.toGrade());
+    const ListValue* l = x.getList();
+    const ListValue* r = y.getList();
+    bool same = l->size() == r->size();
+    for (size_t i = 0; same && i < l->size(); ++i) {
+        same = sameDouble(l->getValueAt(i), r->getValueAt(i)) && l->getWeightAt(i) == r->getWeightAt(i);
+    }
+    return same;
+}
+
+static Value* evaluateOrNull(Context& ctx, const std::string& category) {
+    try {
+        return ctx.getCategoryValue(category);
+    } catch (const std::exception&) {
+        return nullptr;
+    }
+}
+
+bool runFusionTests() {
+    std::string errorMsg;
+    const std::string source =
+        "lo: 0.3\n"
+        "scaled: map(0 1 0 100 clamp(0 1 resolve(0 raw)))\n"
+        "bounded: minOf(0.8 maxOf(lo raw))\n"
+        "mean: { map(0 100 0 1 clamp(0.1 0.9 resolve(lo raw))) minOf(0.9 raw): 2 }\n"
+        "flat: map(0.5 0.5 0 1 raw)\n"
+        "shared: { clamp(0 1 raw) maxOf(0.2 clamp(0 1 raw)) }\n"
+        "scalar: clamp(0 1 lo)\n";
+    const std::vector<std::string> names = { "scaled", "bounded", "mean", "flat", "shared", "scalar" };
+    RawListProvider input;
+    const double nan = std::numeric_limits<double>::quiet_NaN();
+    for (size_t i = 0; i < 2500; ++i) {
+        input.raw.addValue(i % 11 == 4 ? nan : static_cast<double>((i * 53) % 131) / 100.0 - 0.1, 0.5 + static_cast<double>(i % 3));
+    }
+    OperationProvider* ops = createProvider();
+    Program* reference = parseProgram(source);
+    Program* fused = parseProgram(source);
+    SubexpressionTable table;
+    eliminateCommonSubexpressions({ fused }, table, { ops });
+    // the shared clamp is fused once and ends the chain of the maxOf around it
+    ASSERT_TRUE(fused->fuseListPipelines({ ops }) == 13);
+    fused->link({ ops });
+    CompiledProgram* compiled = compileProgram(*fused);
+    std::ostringstream code;
+    compiled->disassemble(code);
+    ASSERT_TRUE(code.str().find("PIPELINE_MEAN resolve clamp map") != std::string::npos);
+
+    // fused results match the unfused calls bit for bit, at every SIMD level
+    SimdLevel saved = activeSimdLevel();
+    for (SimdLevel level : { SimdLevel::SCALAR, SimdLevel::SSE2, SimdLevel::AVX2 }) {
+        setSimdLevel(level);
+        Context expected, tree, vm;
+        expected.dataProviders = { &input, reference };
+        tree.dataProviders = { &input, fused };
+        vm.dataProviders = { &input, compiled };
+        for (Context* ctx : { &expected, &tree, &vm }) ctx->operationProviders = { ops };
+        for (const std::string& name : names) {
+            errorMsg = name + " at " + simdLevelName(level);
+            Value* want = evaluateOrNull(expected, name);
+            ASSERT_TRUE(sameValue(want, evaluateOrNull(tree, name)) && sameValue(want, evaluateOrNull(vm, name)));
+        }
+    }
+    setSimdLevel(saved);
+
+    // Contexts with other operation providers run the original calls
+    BasicOperationProvider* identity = new BasicOperationProvider();
+    identity->registerOperation("clamp", std::function<ListValue*(double, double, ListValue*)>([](double, double, ListValue* lv) { return lv; }));
+    Context expected, tree;
+    expected.dataProviders = { &input, reference };
+    tree.dataProviders = { &input, fused };
+    for (Context* ctx : { &expected, &tree }) ctx->operationProviders = { identity, ops };
+    for (const std::string& name : names) {
+        errorMsg = name + " with other providers";
+        ASSERT_TRUE(sameValue(evaluateOrNull(expected, name), evaluateOrNull(tree, name)));
+    }
+    errorMsg.clear();
+    Context plain;
+    plain.dataProviders = { &input, fused };
+    plain.operationProviders = { ops };
+    ASSERT_TRUE(!sameValue(evaluateOrNull(tree, "scaled"), evaluateOrNull(plain, "scaled")));
+
+    delete identity;
+    delete compiled;
+    delete fused;
+    delete reference;
+    delete ops;
+    std::cout << "All fusion tests passed." << std::endl;
+    return true;
+}
+
+bool runLazyTests() {
+    std::string errorMsg;
+    const std::string source =
+        "x: 0.9\n"
+        "pick: if(x tick(1) tick(2))\n"
+        "other: if(0 tick(1) tick(2))\n"
+        "none: if({} tick(1) tick(2))\n"
+        "missing: if(0 tick(1))\n"
+        "chosen: if(x {80% 90%} 0)\n"
+        "gate: require(x 0.7 tick(0) tick(1))\n"
+        "guarded: require(x 0.95 0.5 no_such_op(x))\n"
+        "first: coalesce({} tick(0.4) tick(0.6))\n"
+        "empty: coalesce()\n";
+    // name -> (result, operations evaluated)
+    const std::vector<std::pair<std::string, std::pair<std::string, int>>> expected = {
+        { "pick", { "1", 1 } }, { "other", { "2", 1 } }, { "none", { "undef", 0 } }, { "missing", { "undef", 0 } },
+        { "chosen", { "{0.8 0.9}", 0 } }, { "gate", { "1", 1 } }, { "guarded", { "0.5", 0 } },
+        { "first", { "0.4", 1 } }, { "empty", { "undef", 0 } },
+    };
+    int ticks = 0;
+    BasicOperationProvider* counting = new BasicOperationProvider();
+    counting->registerOperation("tick", std::function<double(double)>([&ticks](double g) { ++ticks; return g; }));
+    OperationProvider* ops = createProvider();
+    Program* tree = parseProgram(source);
+    tree->link({ counting, ops });
+    CompiledProgram* compiled = compileProgram(*tree);
+    std::ostringstream code;
+    compiled->disassemble(code);
+    ASSERT_TRUE(code.str().find("CALL_LAZY if/3 args") != std::string::npos);
+
+    // untaken arguments are never evaluated, by the tree walk or the VM
+    for (DataProvider* provider : { static_cast<DataProvider*>(tree), static_cast<DataProvider*>(compiled) }) {
+        Context ctx;
+        ctx.dataProviders = { provider };
+        ctx.operationProviders = { counting, ops };
+        for (const auto& entry : expected) {
+            errorMsg = entry.first + (provider == tree ? " in the tree" : " in the VM");
+            ticks = 0;
+            ASSERT_TRUE(formatBatchValue(ctx.getCategoryValue(entry.first)) == entry.second.first);
+            ASSERT_TRUE(ticks == entry.second.second);
+        }
+    }
+    errorMsg.clear();
+
+    // providers that define the operation eagerly get every argument evaluated
+    BasicOperationProvider* eager = new BasicOperationProvider();
+    eager->registerOperation("if", std::function<double(double, double, double)>([](double c, double t, double e) { return c != 0.0 ? t : e; }));
+    for (DataProvider* provider : { static_cast<DataProvider*>(tree), static_cast<DataProvider*>(compiled) }) {
+        Context ctx;
+        ctx.dataProviders = { provider };
+        ctx.operationProviders = { eager, counting, ops };
+        ticks = 0;
+        ASSERT_TRUE(formatBatchValue(ctx.getCategoryValue("pick")) == "1" && ticks == 2);
+    }
+
+    // called eagerly, lazy operations give the same results
+    std::vector<Datum> args;
+    args.push_back(Datum::makeInteger(0));
+    args.push_back(Datum::makeGrade(0.25));
+    args.push_back(Datum::makeGrade(0.75));
+    ASSERT_TRUE(ops->isLazy("if") && ops->executeOperation("if", args).getGrade() == 0.75);
+    args.clear();
+    args.push_back(Datum::makeGrade(std::numeric_limits<double>::quiet_NaN()));
+    args.push_back(Datum::makeInteger(3));
+    Datum first = ops->executeOperation("coalesce", args);
+    ASSERT_TRUE(first.getType() == DataType::TYPE_INTEGER && first.getInteger() == 3);
+
+    // arity is checked, and names are either lazy or overloaded
+    bool threw = false;
+    try {
+        args.clear();
+        args.push_back(Datum::makeGrade(1.0));
+        ops->executeOperation("if", args);
+    } catch (const std::invalid_argument&) {
+        threw = true;
+    }
+    ASSERT_TRUE(threw);
+    threw = false;
+    try {
+        static_cast<BasicOperationProvider*>(ops)->registerLazyOperation("sum", 0, 1, coalesce);
+    } catch (const std::invalid_argument&) {
+        threw = true;
+    }
+    ASSERT_TRUE(threw);
+
+    // reactive Contexts record only the branch that was read
+    Program* reactive = parseProgram(std::string("report: if(flag a b)\n"));
+    reactive->link({ ops });
+    CompiledProgram* reactiveCompiled = compileProgram(*reactive);
+    for (DataProvider* provider : { static_cast<DataProvider*>(reactive), static_cast<DataProvider*>(reactiveCompiled) }) {
+        Context ctx;
+        ctx.dataProviders = { provider };
+        ctx.operationProviders = { ops };
+        ctx.trackDependencies();
+        ctx.setCategoryValue("flag", new GradeValue(1.0));
+        ctx.setCategoryValue("a", new GradeValue(0.5));
+        ctx.setCategoryValue("b", new GradeValue(0.25));
+        ASSERT_TRUE(formatBatchValue(ctx.getCategoryValue("report")) == "0.5");
+        ASSERT_TRUE(ctx.setCategoryValue("b", new GradeValue(0.125)) == 0);
+        ASSERT_TRUE(ctx.setCategoryValue("a", new GradeValue(0.75)) == 1);
+        ASSERT_TRUE(formatBatchValue(ctx.getCategoryValue("report")) == "0.75");
+    }
+
+    delete reactiveCompiled;
+    delete reactive;
+    delete eager;
+    delete compiled;
+    delete tree;
+    delete ops;
+    delete counting;
+    std::cout << "All lazy operation tests passed." << std::endl;
+    return true;
+}
+
+// A gradebook store that answers bulk requests in one lookup and counts both kinds of request.
+// Its graph lists the scores it holds, so Contexts know it defines nothing else.
+class GradebookStore : public DataProvider {
+public:
+    std::unordered_map<std::string, double> scores;
+    std::unique_ptr<DependencyGraph> graph;
+    size_t lookups = 0;
+    size_t bulkRequests = 0;
+    size_t bulkNames = 0;
+    bool failBulk = false;
+    Value* getCategoryValue(const std::string& categoryName, Context* /*ctx*/) override {
+        ++lookups;
+        auto it = scores.find(categoryName);
+        return it == scores.end() ? nullptr : new GradeValue(it->second);
+    }
+    std::vector<Value*> getCategoryValues(const std::vector<std::string>& categoryNames, Context* /*ctx*/) override {
+        if (failBulk) throw std::runtime_error("store unavailable");
+        ++bulkRequests;
+        bulkNames += categoryNames.size();
+        std::vector<Value*> values;
+        for (const std::string& name : categoryNames) {
+            auto it = scores.find(name);
+            values.push_back(it == scores.end() ? nullptr : new GradeValue(it->second));
+        }
+        return values;
+    }
+    const DependencyGraph* dependencyGraph() const override { return graph.get(); }
+    void indexScores() {
+        std::vector<std::string_view> names;
+        for (const auto& kv : scores) names.push_back(kv.first);
+        graph.reset(new DependencyGraph(std::move(names), [](std::string_view, std::vector<std::string_view>&) {}));
+    }
+};
+
+bool runPrefetchTests() {
+    std::string errorMsg;
+    Program* policy = parseProgram(std::string(
+        "hw: clamp(0 1 { raw raw bonus })\n"
+        "total: { hw: 0.4 exam: 0.6 }\n"
+        "report: require(total 0.5 fail pass)\n"));
+    OperationProvider* ops = createProvider();
+    policy->link({ ops });
+    CompiledProgram* compiled = compileProgram(*policy);
+    EvalPlan plan({ compiled }, { "report", "total" });
+    GradebookStore store;
+    store.scores = { { "raw", 0.5 }, { "bonus", 0.25 }, { "exam", 0.75 } };
+    store.indexScores();
+    Context direct;
+    direct.dataProviders = { &store, compiled };
+    direct.operationProviders = { ops };
+    const std::string report = formatBatchValue(direct.getCategoryValue("report"));
+    const std::string total = formatBatchValue(direct.getCategoryValue("total"));
+
+    // one bulk request for the inputs not cached yet (pass and fail are), and no lookups during evaluation
+    store.lookups = 0;
+    Context ctx;
+    ctx.dataProviders = { &store, compiled };
+    ctx.operationProviders = { ops };
+    std::vector<Value*> values = ctx.evaluatePlan(plan);
+    ASSERT_TRUE(formatBatchValue(values[0]) == report && formatBatchValue(values[1]) == total);
+    ASSERT_TRUE(store.bulkRequests == 1 && store.bulkNames == 3 && store.lookups == 0);
+
+    // providers ahead of the store keep precedence and are only asked for what they define
+    Program* row = parseProgram(std::string("exam: 40%\nextra: 10%\n"));
+    Context overridden;
+    overridden.dataProviders = { row, &store, compiled };
+    overridden.operationProviders = { ops };
+    ASSERT_TRUE(overridden.prefetchCategoryValues({ "exam", "raw", "bonus", "pass", "nowhere" }) == 3);
+    ASSERT_TRUE(store.bulkRequests == 2 && store.bulkNames == 5);
+    ASSERT_TRUE(formatBatchValue(overridden.getCategoryValue("exam")) == "0.4" && store.lookups == 0);
+
+    // a failing bulk request leaves the inputs to the lookups
+    store.failBulk = true;
+    Context fallback;
+    fallback.dataProviders = { &store, compiled };
+    fallback.operationProviders = { ops };
+    values = fallback.evaluatePlan(plan);
+    ASSERT_TRUE(formatBatchValue(values[0]) == report && store.lookups == 3);
+
+    // scores the course gives defaults for are plan steps, and still come in the one request
+    Program* defaults = parseProgram(std::string("exam: 0%\ntotal: { raw exam }\n"));
+    defaults->link({ ops });
+    EvalPlan defaulted({ defaults }, { "total" });
+    ASSERT_TRUE(defaulted.slotOf("exam") && defaulted.inputs().size() == 1);
+    store.failBulk = false;
+    store.lookups = store.bulkRequests = store.bulkNames = 0;
+    Context withDefaults;
+    withDefaults.dataProviders = { &store, defaults };
+    withDefaults.operationProviders = { ops };
+    values = withDefaults.evaluatePlan(defaulted);
+    ASSERT_TRUE(formatBatchValue(values[0]) == "{0.5 0.75}");
+    ASSERT_TRUE(store.bulkRequests == 1 && store.bulkNames == 2 && store.lookups == 0);
+    delete defaults;
+
+    // reactive Contexts fetch name by name, so a row's definitions record what they read
+    Program* course = parseProgram(std::string("exam: 0%\ncurve: 10%\ntotal: { exam }\n"));
+    course->link({ ops });
+    EvalPlan curved({ course }, { "total" });
+    Program* curvedRow = parseProgram(std::string("exam: curve\n"));
+    curvedRow->link({ ops });
+    Context reactive;
+    reactive.dataProviders = { curvedRow, course };
+    reactive.operationProviders = { ops };
+    reactive.trackDependencies();
+    ASSERT_TRUE(reactive.prefetchCategoryValues({ "exam" }) == 0);
+    ASSERT_TRUE(formatBatchValue(reactive.evaluatePlan(curved)[0]) == "{0.1}");
+    ASSERT_TRUE(reactive.setCategoryValue("curve", new GradeValue(0.5)) == 2);
+    ASSERT_TRUE(formatBatchValue(reactive.getCategoryValue("total")) == "{0.5}");
+    delete curvedRow;
+    delete course;
+
+    // the default fetches name by name
+    std::vector<Value*> fetched = row->DataProvider::getCategoryValues({ "extra", "raw" }, &fallback);
+    ASSERT_TRUE(fetched.size() == 2 && formatBatchValue(fetched[0]) == "0.1" && !fetched[1]);
+    for (Value* value : fetched) delete value;
+
+    delete row;
+    delete compiled;
+    delete ops;
+    delete policy;
+    std::cout << "All prefetch tests passed." << std::endl;
+    return true;
+}
+
 int main() {
-    if (!runTests()) {
+    if (!runTests() || !runBatchTests() || !runBytecodeTests() || !runOperationTests() || !runDependencyTests() ||
+        !runParallelTests() || !runListKernelTests() ||
+        !runSubexpressionTests() || !runPlanTests() ||
+        !runSymbolTests() || !runIncrementalTests() ||
+        !runForkTests() || !runFusionTests() || !runLazyTests() || !runPrefetchTests()) {
         return 1;
     }
     return 0;